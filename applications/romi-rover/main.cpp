@@ -66,6 +66,7 @@
 #include <ui/CrystalDisplay.h>
 #include <ui/JoystickInputDevice.h>
 #include <weeder/Weeder.h>
+#include <weeder/RoverOdometry.h>
 #include <api/IDisplay.h>
 #include <ui/LinuxJoystick.h>
 #include <ui/UIEventMapper.h>
@@ -282,14 +283,6 @@ int main(int argc, char** argv)
                 romi::PipelineFactory pipeline_factory;
                 romi::IPipeline& pipeline = pipeline_factory.build(range, config);
 
-                // Weeder
-                r_info("main: Creating weeder");
-                double z0 = (double) config["weeder"]["z0"];
-                double speed = (double) config["weeder"]["speed"];
-                double diameter_tool = (double) config["weeder"]["diameter-tool"];
-                romi::Weeder weeder(*camera, pipeline, oquam, z0, speed,
-                                    diameter_tool, session);
-
                 // Motor driver
                 r_info("main: Creating motor driver");
                 nlohmann::json rover_settings = config.at("navigation").at("rover");
@@ -308,6 +301,22 @@ int main(int argc, char** argv)
                 romi::WheelOdometry wheelodometry(rover_config, motor_driver);
                 romi::LocationTracker distance_measure(wheelodometry, wheelodometry);
 
+                // Weeder
+                r_info("main: Creating weeder");
+                double z0 = (double) config["weeder"]["z0"];
+                double speed = (double) config["weeder"]["speed"];
+                double diameter_tool = (double) config["weeder"]["diameter-tool"];
+                // The forward direction of the rover in the axes of
+                // the CNC workspace
+                std::vector<double> forward = config["weeder"].value("forward",
+                                                                     std::vector<double>{1.0, 0.0});
+                auto odometry = std::make_shared<romi::RoverOdometry>(wheelodometry,
+                                                                      romi::v3(forward.at(0),
+                                                                               forward.at(1),
+                                                                               0.0));
+                romi::Weeder weeder(*camera, pipeline, oquam, z0, speed,
+                                    diameter_tool, session, odometry);
+
                 // Track follower
 
                 std::string track_follower_name = config["navigation"]["track-follower"];
@@ -0,0 +1,119 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+/*
+  Compares the double and the fixed-point versions of the
+  SelfOrganizedMap on the same cities: the computation time, the
+  convergence and the length of the path.
+
+  Usage: som_benchmark [cities-file [repeat]]
+ */
+
+#include <fstream>
+#include <chrono>
+#include <cmath>
+
+#include <rcom/Linux.h>
+#include "data_provider/RomiDeviceData.h"
+#include "data_provider/SoftwareVersion.h"
+#include "data_provider/GpsLocationProvider.h"
+#include "data_provider/Gps.h"
+#include "session/Session.h"
+#include "som/SelfOrganizedMap.h"
+
+using namespace romi;
+
+static double path_length(Path& path)
+{
+        double length = 0.0;
+        for (size_t i = 0; i < path.size(); i++) {
+                v3& a = path[i];
+                v3& b = path[(i + 1) % path.size()];
+                length += std::hypot(b.x() - a.x(), b.y() - a.y());
+        }
+        return length;
+}
+
+template <typename T>
+static void run(const char *name, ISession& session,
+                std::vector<double>& cx, std::vector<double>& cy, int repeat)
+{
+        int num_cities = static_cast<int>(cx.size());
+        double total = 0.0;
+        bool success = false;
+        Path path;
+
+        for (int i = 0; i < repeat; i++) {
+                auto start = std::chrono::steady_clock::now();
+                SelfOrganizedMap<T> som(num_cities, (int) (2.5 * num_cities),
+                                        0.2, 1.2, 0.01);
+                som.init_cities(&cx[0], &cy[0]);
+                som.make_circle(0.1);
+                success = som.compute_path(session);
+                std::chrono::duration<double, std::milli> elapsed
+                        = std::chrono::steady_clock::now() - start;
+                total += elapsed.count();
+                
+                path.clear();
+                som.get_path(path, 1.0, 1.0);
+        }
+
+        std::cout << name << ": " << std::fixed << total / repeat << " ms"
+                  << ", success " << (success? "yes" : "no")
+                  << ", length " << path_length(path) << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+        const char *filename = (argc > 1)? argv[1] : "cities.txt";
+        int repeat = (argc > 2)? atoi(argv[2]) : 1;
+        
+        std::vector<double> cx;
+        std::vector<double> cy;
+        std::ifstream file(filename);
+        double x, y;
+        while (file >> x >> y) {
+                cx.push_back(x);
+                cy.push_back(y);
+        }
+        if (cx.empty() || repeat < 1) {
+                std::cout << "Usage: som_benchmark [cities-file [repeat]]" << std::endl;
+                return 1;
+        }
+        
+        rcom::Linux linux;
+        RomiDeviceData romiDeviceData;
+        SoftwareVersion softwareVersion;
+        romi::Gps gps;
+        std::unique_ptr<ILocationProvider> locationPrivider
+                = std::make_unique<GpsLocationProvider>(gps);
+        std::string session_directory(".");
+        romi::Session session(linux, session_directory, romiDeviceData,
+                              softwareVersion, std::move(locationPrivider));
+        session.start("som_benchmark");
+
+        std::cout << cx.size() << " cities" << std::endl;
+        run<double>("double", session, cx, cy, repeat);
+        run<fixed_t>("fixed", session, cx, cy, repeat);
+}
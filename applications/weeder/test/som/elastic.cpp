@@ -52,6 +52,7 @@ int main(int argc, char **argv)
         session.start("elastic");
         std::string dump_filename("dump.out");
         bool print = false;
+        bool dump = false;
         double alpha = 0.2;
         double beta = 2.0;
         double epsilon = 0.01;
@@ -73,6 +74,7 @@ int main(int argc, char **argv)
                 switch (c) {
                 case 'd':
                         OPEN_DUMP(session.current_path()/dump_filename);
+                        dump = true;
                         break;
                 case 'p':
                         print = true;
@@ -107,14 +109,15 @@ int main(int argc, char **argv)
 
         auto start = std::chrono::high_resolution_clock::now();
 
-        SelfOrganizedMap<double> som(num_cities_test,
-                                     test_circle_length,
-                                     alpha, beta, epsilon);
-
+        SelfOrganizedMap<double, SampledTracer> som(num_cities_test,
+                                                    test_circle_length,
+                                                    alpha, beta, epsilon);
+        if (print || dump)
+                som.tracer().set_sampling(1, SelfOrganizedMap<double>::kMaxIterations);
 
         som.init_cities(&cx[0], &cy[0]);
         som.init_path(&px[0], &py[0]);
-        som.compute_path(session, print);
+        som.compute_path(session);
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
         std::cout << "calculation time: " << std::fixed << elapsed.count() << "ms\n";
 }
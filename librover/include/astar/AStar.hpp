@@ -6,6 +6,7 @@
 #ifndef __ASTAR_HPP_8F637DB91972F6C878D41D63F7E7214F__
 #define __ASTAR_HPP_8F637DB91972F6C878D41D63F7E7214F__
 
+#include <cstdint>
 #include <vector>
 #include <functional>
 #include <set>
@@ -25,40 +26,73 @@ namespace AStar
         using HeuristicFunction = std::function<uint(Vec2i, Vec2i)>;
         using CoordinateList = std::vector<Vec2i>;
         
-        struct Node
-        {
-                uint G, H;
-                Vec2i coordinates;
-                Node *parent;
-
-                Node(Vec2i coord_, Node *parent_ = nullptr);
-                uint getScore();
-        };
-
-        using NodeSet = std::vector<Node*>;
-
         class Generator
         {
                 bool detectCollision(Vec2i coordinates_);
-                Node* findNodeOnList(NodeSet& nodes_, Vec2i coordinates_);
-                void releaseNodes(NodeSet& nodes_);
+                bool isInWorld(Vec2i coordinates_);
+                void updateWallMap();
+                void resetSearch();
+                void openCell(int cell_, uint G_, uint H_, int parent_);
+                void pushCell(int cell_);
+                CoordinateList findJumpPointPath(Vec2i source_, Vec2i target_);
+                int jumpDirections(int cell_, Vec2i *directions_);
+                bool jump(Vec2i start_, Vec2i d_, Vec2i target_, Vec2i& jumpPoint_);
+                bool isFree(int x_, int y_);
 
         public:
                 Generator();
                 void setWorldSize(Vec2i worldSize_);
                 void setDiagonalMovement(bool enable_);
                 void setHeuristic(HeuristicFunction heuristic_);
+                // Uses Jump Point Search when diagonal moves are
+                // enabled. The paths have the same cost but fewer
+                // cells are expanded.
+                void setJumpPointSearch(bool enable_);
                 CoordinateList findPath(Vec2i source_, Vec2i target_);
                 void addCollision(Vec2i coordinates_);
                 void removeCollision(Vec2i coordinates_);
                 void clearCollisions();
 
         private:
+                // An entry of the open set. Among the cells with the
+                // lowest score, the search picks the one that was
+                // opened last. A cell whose score drops is pushed
+                // again, and the old entry is skipped when it is
+                // popped.
+                struct OpenEntry
+                {
+                        uint score;
+                        uint order;
+                        int cell;
+                };
+
+                static bool isWorse(const OpenEntry& a_, const OpenEntry& b_);
+                
                 HeuristicFunction heuristic;
                 CoordinateList direction;
                 CoordinateList walls;
                 Vec2i worldSize;
                 uint directions;
+
+                // The walls as one byte per cell, rebuilt from the
+                // list of walls when either changed.
+                std::vector<uint8_t> wallMap;
+                bool wallMapChanged;
+
+                // The state of the cells, indexed by y * width + x.
+                // A cell only belongs to the current search when its
+                // stamp equals searchStamp, so that nothing needs to
+                // be cleared between searches.
+                std::vector<uint> stamp;
+                std::vector<uint> costG;
+                std::vector<uint> costH;
+                std::vector<uint> openOrder;
+                std::vector<int> parent;
+                std::vector<uint8_t> closed;
+                std::vector<OpenEntry> openSet;
+                uint searchStamp;
+                uint openCount;
+                bool jumpPoints;
         };
 
         class Heuristic
@@ -0,0 +1,79 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#ifndef __ROMI_DISTANCE_MATRIX_H
+#define __ROMI_DISTANCE_MATRIX_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <api/Path.h>
+#include "parallel/ThreadPool.h"
+#include "weeder/DistanceTransform.h"
+
+namespace romi {
+
+        /* A symmetric matrix of distances between n nodes. Only the
+         * upper triangle, without the diagonal, is stored, row after
+         * row, in a single buffer of n(n-1)/2 values. */
+        class DistanceMatrix
+        {
+        public:
+                using DistanceFunction = std::function<int64_t(size_t i, size_t j)>;
+
+                static constexpr int64_t kCrossingCost = 10000;
+
+                /* The cost of going straight from a to b: the
+                 * length of the segment in pixels, or kCrossingCost
+                 * if it crosses a plant. */
+                static int64_t segment_cost(v3 a, v3 b, const DistanceTransform& distances);
+                
+        protected:
+                size_t size_;
+                std::vector<int64_t> data_;
+
+                size_t index(size_t i, size_t j) const {
+                        // Offset of row i, plus column j in that row
+                        return i * (2 * size_ - i - 1) / 2 + (j - i - 1);
+                }
+
+        public:
+                explicit DistanceMatrix(size_t n);
+                virtual ~DistanceMatrix() = default;
+
+                size_t size() const;
+
+                int64_t operator()(size_t i, size_t j) const {
+                        if (i == j)
+                                return 0;
+                        return (i < j)? data_[index(i, j)] : data_[index(j, i)];
+                }
+                
+                /* Calls distance(i, j) once for each pair i < j. The
+                 * pairs are split evenly over the threads of the
+                 * pool, so distance() must be thread-safe. */
+                void fill(ThreadPool& pool, const DistanceFunction& distance);
+        };
+}
+
+#endif // __ROMI_DISTANCE_MATRIX_H
@@ -39,8 +39,12 @@
 #include <ortools/constraint_solver/routing_index_manager.h>
 #include <ortools/constraint_solver/routing_parameters.h>
 
+#include <mutex>
+
 #include "session/ISession.h"
 #include "weeder/IPathPlanner.h"
+#include "parallel/ThreadPool.h"
+#include "DistanceMatrix.h"
 #include "../som/Superpixels.h"
 
 namespace romi {
@@ -49,20 +53,65 @@ namespace romi {
         {
 
         public:
+                static constexpr size_t kMaxThreads = 64;
+                static constexpr size_t kMaxPreviousRoutes = 16;
+
+                /* The figures of the last call to trace_path() to
+                 * finish, to weigh the length of the path against
+                 * the time spent computing it. The wall time is in
+                 * milliseconds, the objective in pixels. */
+                struct SolveStats {
+                        size_t nodes;
+                        bool warm_started;
+                        double wall_time;
+                        int64_t objective;
+                        SolveStats() : nodes(0), warm_started(false),
+                                       wall_time(0.0), objective(0) {}
+                };
+                
                 explicit GConstraintSolver(nlohmann::json& params);
                 ~GConstraintSolver() override = default;
                 
                 Path trace_path(ISession& session, Centers& centers, Image& mask) override;
+                bool is_thread_safe() override;
+                void set_distance_transform(
+                        std::shared_ptr<DistanceTransform> distances) override;
+                void set_scale(double meters_to_pixels, double tool_diameter) override;
+                void set_displacement(double dx, double dy) override;
+
+                SolveStats stats() const;
                 
         private:
                 Path compute_path(std::vector<std::vector<int>>& locations,
-                                  const Image& mask);
+                                  const DistanceTransform& distances);
                 
                 Path build_path(const operations_research::RoutingIndexManager &manager,
                                 const operations_research::RoutingModel &routing,
                                 const operations_research::Assignment &solution,
                                 const std::vector<std::vector<int>> &locations);
+                bool remap_previous_route(const std::vector<std::vector<int>>& locations,
+                                          const DistanceMatrix& distances,
+                                          std::vector<size_t>& route,
+                                          std::vector<Path>::iterator& previous);
+                void store_route(Path& path, std::vector<Path>::iterator previous);
+                
                 bool print_;
+                size_t threads_;
+                std::shared_ptr<ThreadPool> pool_;
+                std::shared_ptr<DistanceTransform> distances_;
+                double time_limit_;
+                bool guided_local_search_;
+                bool warm_start_;
+                double warm_start_distance_;
+                double meters_to_pixels_;
+                std::vector<Path> previous_routes_;
+                // Whether set_displacement() was called since the
+                // previous image
+                bool displaced_;
+                // The components can be planned in parallel, see
+                // is_thread_safe()
+                mutable std::mutex stats_mutex_;
+                SolveStats stats_;
         };
 }
 
@@ -0,0 +1,113 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __ROMI_THREAD_POOL_H
+#define __ROMI_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace romi {
+
+        /*
+          A fixed-size pool of worker threads.
+
+          A pool of size N uses N-1 worker threads: the thread that
+          calls parallel_for() executes one of the chunks
+          itself. With N=1, all the work is done in the calling
+          thread.
+
+          Calls made from within one of the pool's own workers run
+          inline. This avoids dead-locks when a task submitted to the
+          pool calls back into it.
+         */
+        class ThreadPool
+        {
+        public:
+                using ChunkFunction = std::function<void(size_t chunk,
+                                                         size_t begin,
+                                                         size_t end)>;
+                
+        protected:
+                std::vector<std::thread> _workers;
+                std::deque<std::function<void()>> _tasks;
+                std::mutex _mutex;
+                std::condition_variable _condition;
+                bool _quit;
+
+                void run_worker();
+                void push(std::function<void()> task);
+                bool is_worker() const;
+                
+        public:
+                explicit ThreadPool(size_t num_threads);
+                virtual ~ThreadPool();
+                
+                ThreadPool(const ThreadPool&) = delete;
+                ThreadPool& operator=(const ThreadPool&) = delete;
+
+                /* The number of threads, including the calling
+                 * thread, that execute the work. */
+                size_t size() const;
+
+                /* Splits [0, count) into size() contiguous chunks
+                 * and calls fn(chunk, begin, end) for each non-empty
+                 * chunk. Blocks until all chunks are done. The chunk
+                 * boundaries only depend on count and size(), so
+                 * that a per-chunk reduction done in chunk order is
+                 * deterministic. The first exception thrown by a
+                 * chunk is rethrown. */
+                void parallel_for(size_t count, const ChunkFunction& fn);
+
+                /* Queues a task and returns its future. The task
+                 * runs immediately in the calling thread when the
+                 * pool has no workers or when called from a
+                 * worker. */
+                template <typename F>
+                auto submit(F&& f) -> std::future<decltype(f())> {
+                        using R = decltype(f());
+                        auto task = std::make_shared<std::packaged_task<R()>>(
+                                std::forward<F>(f));
+                        std::future<R> result = task->get_future();
+                        if (_workers.empty() || is_worker()) {
+                                (*task)();
+                        } else {
+                                push([task]() { (*task)(); });
+                        }
+                        return result;
+                }
+
+                /* The number of threads to use when the
+                 * configuration asks for 0 (= all cores). */
+                static size_t default_size();
+        };
+}
+
+#endif // __ROMI_THREAD_POOL_H
@@ -0,0 +1,133 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __ROMI_CORRELATION_H
+#define __ROMI_CORRELATION_H
+
+#include <complex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cv/Image.h>
+#include "parallel/ThreadPool.h"
+
+namespace romi {
+
+        /*
+          Correlates a BW image with the bell-shaped kernel used by
+          the quincunx planner. The value at (x,y) is the sum of the
+          products of the kernel, centered on (x,y), with the image,
+          divided by the area of the kernel that overlaps the image.
+
+          Three methods are available:
+
+          - kDirect: the straightforward sum over the kernel. Exact
+            but O(W.H.w^2).
+          
+          - kSeparable: the 2D Gaussian is applied as a horizontal
+            and a vertical 1D pass, O(W.H.w). The kernel is not cut
+            off at the 3-sigma circle, the values in the corners of
+            the square are below exp(-4.5).
+            
+          - kFFT: the product of the spectra of the image and of the
+            kernel, O(N.log(N)) with N the padded size of the image,
+            independent of the kernel width. Uses the same kernel as
+            kDirect.
+
+          kAuto selects kSeparable for narrow kernels and kFFT for
+          the wide ones. Its values for the narrow kernels therefore
+          differ slightly from those of kDirect (by less than 1e-3
+          for a binary mask).
+
+          The image can be correlated with bells of several widths,
+          for plants of different sizes, in one call. The output then
+          keeps, for each pixel, the largest value over all the
+          widths. The kernels that use the FFT share the spectrum of
+          the image.
+
+          The kernels, their 1D Gaussians, and their spectra are
+          cached by width (the plant size times the image scale), so
+          they are only computed once for a given set-up.
+
+          The rows of the image (or of the padded spectrum) are split
+          over the threads of the pool. Each output value is computed
+          by a single thread in the same order as in the
+          single-threaded case so the result doesn't depend on the
+          number of threads.
+         */
+        class Correlation
+        {
+        public:
+                enum Method { kAuto, kDirect, kSeparable, kFFT };
+
+                // Kernels that are at least this wide use the FFT in
+                // kAuto mode.
+                static constexpr size_t kMinFFTWidth = 32;
+                // The maximum number of kernels in the cache
+                static constexpr size_t kMaxKernels = 16;
+                
+                static Method parse_method(const std::string& name);
+                
+        protected:
+                struct Kernel {
+                        size_t width;
+                        Image bell;
+                        std::vector<float> gaussian;
+                        // The spectrum of the bell, padded to nx-by-ny
+                        size_t nx;
+                        size_t ny;
+                        std::vector<std::complex<float>> spectrum;
+
+                        explicit Kernel(size_t w);
+                };
+                
+                Method _method;
+                std::shared_ptr<ThreadPool> _pool;
+                std::vector<Kernel> _kernels;
+
+                Method select_method(size_t w);
+                Kernel& get_kernel(size_t w);
+                const std::vector<std::complex<float>>&
+                get_kernel_spectrum(Kernel& kernel, size_t nx, size_t ny);
+                
+        public:
+                explicit Correlation(Method method = kAuto,
+                                     std::shared_ptr<ThreadPool> pool = nullptr);
+                virtual ~Correlation() = default;
+
+                /* Computes the correlation of the image with a bell
+                 * of width w. Returns the average value of the
+                 * output. */
+                float compute(Image& image, size_t w, Image& out);
+
+                /* Computes the correlation of the image with bells
+                 * of the given widths and keeps the largest value
+                 * for each pixel. Returns the average value of the
+                 * output. */
+                float compute(Image& image, const std::vector<size_t>& widths,
+                              Image& out);
+        };
+}
+
+#endif // __ROMI_CORRELATION_H
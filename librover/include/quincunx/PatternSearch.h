@@ -0,0 +1,139 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __ROMI_PATTERN_SEARCH_H
+#define __ROMI_PATTERN_SEARCH_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cv/Image.h>
+#include "parallel/ThreadPool.h"
+#include "point.h"
+
+namespace romi {
+
+        /*
+          Finds the offset of the quincunx pattern in the
+          probability map: the position (x,y), with 0 <= x <= d_rows
+          and 0 <= y <= d_plants, for which the sum of the map at the
+          ten plant positions of the pattern is the largest.
+
+          The rows of the map that the pattern can reach are
+          collected in a plane. Rows that lie inside the image point
+          directly into the image data; the others are padded with
+          zeros, the value that Image::get() returns outside the
+          image. The score of a row of offsets is then the sum of
+          ten shifted rows of the plane, computed four offsets at a
+          time. The sums are done in the same order as the original
+          scalar code so the scores are bit-identical.
+
+          kExhaustive scores all the offsets and is the default. It
+          returns the same offset and score as the original code.
+          kPyramid first scores the offsets on a grid that is
+          kPyramidFactor times coarser in both directions, which
+          works because the map is already smoothed by the bell
+          kernel, and then scores the small windows around the best
+          kCandidates grid points at full resolution. It is faster
+          but can miss the best offset when a narrow peak falls
+          between the grid points, so it must be asked for.
+         */
+        class PatternSearch
+        {
+        public:
+                enum Method { kExhaustive, kPyramid };
+                
+                static constexpr int kPyramidFactor = 4;
+                static constexpr size_t kCandidates = 4;
+                // The extra margin, in pixels, around a grid cell
+                // that is searched at full resolution.
+                static constexpr int kRefineMargin = 2 * kPyramidFactor;
+                // Below this number of offsets, the pyramid isn't
+                // worth it.
+                static constexpr int kMinPyramidOffsets = 64 * 64;
+
+                static Method parse_method(const std::string& name);
+                
+        protected:
+                
+                struct Plane {
+                        // A row of zeros, followed by the rows that are
+                        // only partly in the image
+                        std::vector<float> padding;
+                        std::vector<const float*> rows;
+                        int width;
+                        int height;
+                        // The map coordinates of the plane's origin
+                        int x0;
+                        int y0;
+                        
+                        Plane() : padding(), rows(), width(0), height(0), x0(0), y0(0) {}
+                };
+
+                struct Pattern {
+                        // The offsets of the ten plants, relative to
+                        // (x,y), in the same order as the sum in
+                        // the original implementation.
+                        int dx[10];
+                        int dy[10];
+                };
+                
+                Method _method;
+                std::shared_ptr<ThreadPool> _pool;
+                Plane _plane;
+                
+                static void make_pattern(int dp, int dr, Pattern& pattern);
+                void make_plane(Image& map, int dp, int dr);
+                void score_row(const Pattern& pattern, int y,
+                               int x_begin, int x_end, float *out);
+                float score(const Pattern& pattern, int x, int y);
+                float search_window(const Pattern& pattern,
+                                    int x_begin, int x_end, int y_begin, int y_end,
+                                    int& x_max, int& y_max);
+                float search_pyramid(int dp, int dr, int& x_max, int& y_max);
+                float search_around(int dp, int dr, int cx, int cy, int radius,
+                                    int& x_max, int& y_max);
+
+        public:
+                explicit PatternSearch(Method method = kExhaustive,
+                                       std::shared_ptr<ThreadPool> pool = nullptr);
+                virtual ~PatternSearch() = default;
+
+                /* Returns the score of the best position and stores
+                 * the position in pos. */
+                float estimate(Image& map, float d_plants, float d_rows, point_t& pos);
+
+                /* Same as estimate() but only searches the offsets
+                 * within radius pixels of the predicted offset. The
+                 * prediction doesn't have to lie in the search
+                 * domain: it is wrapped using the periodicity of the
+                 * pattern, d_plants along y, and d_rows along x with
+                 * a shift of d_plants/2 along y. */
+                float estimate_around(Image& map, float d_plants, float d_rows,
+                                      const point_t& predicted, int radius,
+                                      point_t& pos);
+        };
+}
+
+#endif // __ROMI_PATTERN_SEARCH_H
@@ -27,18 +27,63 @@
 
 #include "weeder/IPathPlanner.h"
 #include "point.h"
+#include "Correlation.h"
+#include "PatternSearch.h"
+#include "parallel/ThreadPool.h"
 
 namespace romi {
         
         class Quincunx : public IPathPlanner
         {
+        public:
+                static constexpr size_t kMaxThreads = 64;
+                // Points of the path closer than this, in pixels, to
+                // the line through their neighbours are dropped.
+                static constexpr float kRedundancyEpsilon = 0.5f;
+                // The simplified path may touch a zone up to this
+                // distance, in pixels, to absorb the rounding of the
+                // arcs' tangents.
+                static constexpr float kZoneEpsilon = 0.01f;
+                
         protected:
                 double _distance_plants;
                 double _distance_rows;
                 double _radius_zones;
                 double _threshold;
+                std::vector<double> _plant_sizes;
+                // The largest distance, in meters, between the path
+                // around a zone and the zone's circle
+                double _arc_tolerance;
+                size_t _threads;
+                std::shared_ptr<ThreadPool> _pool;
+                Correlation _correlation;
+                PatternSearch _pattern_search;
+
+                // Tracking: the pattern offset found in the previous
+                // frame, in pixels, its score, the scale of that
+                // frame, and the displacement of the field since
+                // then, in meters.
+                bool _tracking;
+                double _tracking_window;
+                double _tracking_ratio;
+                bool _tracked;
+                point_t _tracked_position;
+                float _tracked_p_max;
+                double _tracked_scale;
+                double _displacement_x;
+                double _displacement_y;
+
+                // Set by the pipeline, see set_scale()
+                double _meters_to_pixels;
+                double _tool_diameter;
 
                 void assert_settings();
+                bool valid_plant_sizes();
+                float find_pattern(Image& p_map, double meters_to_pixels,
+                                   point_t& ptn_pos);
+                std::vector<point_t> compute_positions(Image &mask,
+                                                       double meters_to_pixels,
+                                                       float& confidence);
                 
         public:
                 explicit Quincunx(nlohmann::json& params);
@@ -51,6 +96,10 @@ namespace romi {
                                 double tool_diameter,
                                 double meters_to_pixels,
                                 Path &path);
+
+                void set_displacement(double dx, double dy) override;
+                bool needs_centers() override;
+                void set_scale(double meters_to_pixels, double tool_diameter) override;
         };
 }
 
@@ -34,19 +34,46 @@ namespace romi {
         
         class SOM : public IPathPlanner
         {
+        public:
+                static constexpr size_t kMaxThreads = 64;
+                static constexpr size_t kMaxPreviousPaths = 16;
+
         protected:
                 double _alpha;
                 double _beta;
                 double _epsilon;
                 bool _print;
+                int _print_interval;
+                bool _prune;
+                double _prune_cutoff;
+                size_t _threads;
+                std::shared_ptr<ThreadPool> _pool;
+                double _time_budget;
+                bool _warm_start;
+                double _warm_start_k;
+                double _meters_to_pixels;
+                // The latest paths, in pixels, used to warm-start
+                // the map
+                std::vector<Path> _previous_paths;
+                // Whether set_displacement() was called since the
+                // previous image
+                bool _displaced;
 
                 void assert_settings();
+                void store_centers(ISession &session, Centers& centers, Image &mask);
+                template <typename Map>
+                Path run_map(ISession &session, Map& som, Centers& centers, Image &mask);
+                std::vector<Path>::iterator find_previous_path(Centers& centers);
+                void store_path(Path& path, std::vector<Path>::iterator previous);
 
         public:
                 explicit SOM(nlohmann::json& params);
                 ~SOM() override = default;
                 
                 Path trace_path(ISession& session, Centers& centers, Image& mask) override;
+                bool is_thread_safe() override;
+                void set_scale(double meters_to_pixels, double tool_diameter) override;
+                void set_displacement(double dx, double dy) override;
                 
                 bool trace_path(ISession &session,
                                 Image &mask,
@@ -25,13 +25,26 @@
 #ifndef __ROMI_SELF_ORGANIZED_MAP_H
 #define __ROMI_SELF_ORGANIZED_MAP_H
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
 #include "debug_tools/debug_data_dumper.h"
 #include "session/ISession.h"
+#include "parallel/ThreadPool.h"
 #include "fixed.h"
 
 namespace romi {
 
+// The table of the fixed-point exponential: NE + 1 values of
+// exp(-x) for x in [0, KE], with NE / KE = 2^EXP_SHIFT.
+#define NE 4096
+#define KE 8.0
+#define EXP_SHIFT 9
+
         //-----------------------------------------------------------
         // TBD: Some of them do nothing.
         static inline double radd(double const& a, double const& b) {
@@ -50,9 +63,16 @@ namespace romi {
                 return a / b;
         }
         
-        static inline double rexp(double const& a) {
+        static inline double rexp(double const& a, const double *table) {
+                (void)(table);
                 return std::exp(a);
         }
+
+        // The exponent below which exp() rounds to zero
+        static inline double rexp_min(double r) {
+                (void)(r);
+                return -746.0;
+        }
         
         static inline double rsquare(double const& a) {
                 return std::pow(a, 2.0);
@@ -99,8 +119,25 @@ namespace romi {
                 return fxdiv(a, b);
         }
         
-        static inline fixed_t rexp(fixed_t const& a) {
-                return static_cast<fixed_t>(std::exp(a));
+        /* Interpolates the table of exp(-x), see above, for a <= 0.
+         * Exponents beyond -KE are reduced with exp(-KE). */
+        static inline fixed_t rexp(fixed_t const& a, const fixed_t *table) {
+                const int shift = FIXED_FBITS - EXP_SHIFT;
+                uint32_t u = (a < 0)? (uint32_t) -(int64_t) a : 0u;
+                uint32_t position = u >> shift;
+                int64_t fraction = u & ((1u << shift) - 1);
+                uint32_t q = position / NE;
+                uint32_t i = position % NE;
+                fixed_t r = (fixed_t) (table[i] + (((int64_t) (table[i+1] - table[i])
+                                                    * fraction) >> shift));
+                for (; q > 0 && r > 0; q--)
+                        r = fxmul(r, table[NE]);
+                return r;
+        }
+
+        static inline double rexp_min(fixed_t r) {
+                (void)(r);
+                return -(FIXED_FBITS + 1) * M_LN2;
         }
         
         static inline fixed_t rsquare(fixed_t const& a) {
@@ -128,24 +165,163 @@ namespace romi {
         static inline fixed_t rneg(fixed_t a) {
                 return -a;
         }
+
+        // The sums of the weights can exceed the range of fixed_t
+        static inline double_fixed_t radd(double_fixed_t const& a, fixed_t const& b) {
+                return a + b;
+        }
+
+        static inline fixed_t rdiv(fixed_t const& a, double_fixed_t const& b) {
+                return fxdiv_wide(a, b);
+        }
+
+        template <typename T> struct rwide { typedef T type; };
+        template <> struct rwide<fixed_t> { typedef double_fixed_t type; };
+
+        //-----------------------------------------------------------
+
+        /* The tracers observe the iterations of the map. The map
+         * asks wants(n) at every iteration and hands over the path
+         * only when the answer is true. The tracer passes its
+         * output to the session in finish(), after the last
+         * iteration. */
+        class NullTracer
+        {
+        public:
+                void begin(int num_cities, int path_length) {
+                        (void) num_cities;
+                        (void) path_length;
+                }
+                
+                template <typename R>
+                void cities(const R *x, const R *y) {
+                        (void) x;
+                        (void) y;
+                }
+                
+                bool wants(int iteration) {
+                        (void) iteration;
+                        return false;
+                }
+                
+                template <typename R>
+                void path(int iteration, const R *x, const R *y) {
+                        (void) iteration;
+                        (void) x;
+                        (void) y;
+                }
+                
+                void finish(ISession &session) {
+                        (void) session;
+                }
+        };
+
+        /* Copies the path of every n-th iteration into a ring of
+         * snapshots that is allocated in begin(). When the ring is
+         * full, the oldest snapshots are overwritten. */
+        class SampledTracer
+        {
+        protected:
+                int _interval;
+                size_t _capacity;
+                size_t _num_cities;
+                size_t _path_length;
+                size_t _count;
+                std::vector<int> _iterations;
+                std::vector<double> _x;
+                std::vector<double> _y;
+                std::vector<double> _cities_x;
+                std::vector<double> _cities_y;
+
+        public:
+                SampledTracer()
+                        : _interval(0), _capacity(0), _num_cities(0), _path_length(0),
+                          _count(0), _iterations(), _x(), _y(), _cities_x(), _cities_y() {
+                }
+
+                /* An interval of zero turns the sampling off. */
+                void set_sampling(int interval, size_t capacity) {
+                        _interval = interval;
+                        _capacity = capacity;
+                }
+                
+                void begin(int num_cities, int path_length) {
+                        _num_cities = static_cast<size_t>(num_cities);
+                        _path_length = static_cast<size_t>(path_length);
+                        _count = 0;
+                        _iterations.resize(_capacity);
+                        _x.resize(_capacity * _path_length);
+                        _y.resize(_capacity * _path_length);
+                        _cities_x.resize(_num_cities);
+                        _cities_y.resize(_num_cities);
+                }
+                
+                template <typename R>
+                void cities(const R *x, const R *y) {
+                        for (size_t i = 0; i < _num_cities; i++) {
+                                _cities_x[i] = rtod(x[i]);
+                                _cities_y[i] = rtod(y[i]);
+                        }
+                }
+                
+                bool wants(int iteration) {
+                        return _interval > 0 && _capacity > 0
+                                && (iteration % _interval) == 0;
+                }
+                
+                template <typename R>
+                void path(int iteration, const R *x, const R *y) {
+                        size_t slot = _count % _capacity;
+                        double *sx = &_x[slot * _path_length];
+                        double *sy = &_y[slot * _path_length];
+                        for (size_t i = 0; i < _path_length; i++) {
+                                sx[i] = rtod(x[i]);
+                                sy[i] = rtod(y[i]);
+                        }
+                        _iterations[slot] = iteration;
+                        _count++;
+                }
+                
+                void finish(ISession &session) {
+                        int n = static_cast<int>(_num_cities);
+                        int m = static_cast<int>(_path_length);
+                        if (n > 0)
+                                DUMP_INTERLEAVE("cities", n, &_cities_x[0], &_cities_y[0]);
+                        
+                        size_t first = (_count > _capacity)? _count - _capacity : 0;
+                        for (size_t i = first; i < _count; i++) {
+                                size_t slot = i % _capacity;
+                                double *sx = &_x[slot * _path_length];
+                                double *sy = &_y[slot * _path_length];
+                                DUMP_INTERLEAVE("path", m, sx, sy);
+                                
+                                Path path;
+                                for (size_t j = 0; j < _path_length; j++)
+                                        path.emplace_back(v3(sx[j], sy[j], 0.0));
+                                session.store_path("Path", _iterations[slot], path);
+                        }
+                }
+        };
         
         
-        template <typename T> 
+        template <typename T, typename Tracer = NullTracer> 
         class SelfOrganizedMap
         {
+        public:
+                static constexpr int kMaxIterations = 10000;
+                
         protected:
-#define NE 4096
-#define KE 8.0
-#define NE_KE -512
+                typedef typename rwide<T>::type wide_t;
 
                 T _alpha;
                 T _beta;
                 T _epsilon;
                 T _k;
+                // The value of _k at the start of compute_path()
+                double _initial_k;
                 T _dmax2;
-                T _exp[NE];
+                T _exp[NE + 1];
                 int _n;
-                T _ne_ke;
 
 
                 int _num_cities;
@@ -158,81 +334,113 @@ namespace romi {
                 T *_dfy;
                 T *_tx;
                 T *_ty;
-                T *_dx;
-                T *_dy;
-                T *_d2;
-                T *_w;
-                T *_sum;
+                // The work is split over the threads of the pool
+                // (see update_distance_forces()). Each thread has
+                // its own rows for the differences and weights
+                // between one city and all the nodes. The rows of
+                // thread i start at i * _stride.
+                std::shared_ptr<ThreadPool> _pool;
+                size_t _stride;
+                T *_row_dx;
+                T *_row_dy;
+                T *_row_w;
+                // The largest squared city-node distance found by
+                // each thread
+                std::vector<T> _d2max;
+                // For each city: the sum of its weights, the
+                // nearest node when all of them underflowed (-1
+                // otherwise), and whether it only weighs the nodes
+                // of the pruning grid
+                std::vector<wide_t> _sum;
+                std::vector<int> _nearest;
+                std::vector<bool> _pruned;
                 T _two;
+                // exp(x) rounds to zero for x below this value
+                T _exp_min;
+
+                // Pruning: only the nodes within _cutoff times _k of
+                // a city are taken into account. The nodes are
+                // bucketed in a grid of _cutoff.k-wide cells.
+                bool _prune;
+                double _cutoff;
+                bool _use_grid;
+                double _grid_x0;
+                double _grid_y0;
+                double _grid_cell;
+                int _grid_w;
+                int _grid_h;
+                std::vector<int> _cell_start;
+                std::vector<int> _cell_nodes;
+                std::vector<int> _node_cell;
+                std::vector<int> _cell_fill;
+                std::vector<std::vector<int>> _candidates;
+
+                // The arrays are aligned on a cache line so that the
+                // loops over the nodes vectorise well.
+                static constexpr size_t kAlignment = 64;
+                
+                static T *allocate(int n) {
+                        return allocate(static_cast<size_t>(n));
+                }
+                
+                static T *allocate(size_t n) {
+                        size_t size = n * sizeof(T);
+                        if (size == 0)
+                                size = kAlignment;
+                        size = (size + kAlignment - 1) / kAlignment * kAlignment;
+                        void *p = std::aligned_alloc(kAlignment, size);
+                        if (p == nullptr)
+                                throw std::bad_alloc();
+                        return static_cast<T*>(p);
+                }
+
+                static void release(T *p) {
+                        std::free(p);
+                }
 
                 void exp_init() {
-                        for (int i = 0; i < NE; i++) {
+                        for (int i = 0; i <= NE; i++) {
                                 double x = (double) -KE * (double) i / (double) NE;
                                 double e = std::exp(x);
                                 _exp[i] = dtor(_exp[i], e);
                         }
-                        _ne_ke = itor(_ne_ke, NE_KE);
                 }
 
-                T exp_lookup(T x) {
-                        T tmp = rmul(_ne_ke, x);
-                        int32_t i = rtoi(tmp);
-                        if (i < NE)
-                                return _exp[i];
-                        else return 0;
-                }
-                
+                // The fixed-point version interpolates _exp
                 T exponential(T x) {
-                        //return exp_lookup(x);
-                        return rexp(x);
+                        return rexp(x, _exp);
                 }
 
                 void update();
-                void update_distance_forces();                
+                void update_distance_forces();
+                void clear_forces();
+                void weigh_city(int city, T coeff, size_t chunk, T& d2max);
+                void weigh_all_nodes(int city, T coeff, size_t chunk, T& d2max);
+                bool weigh_candidates(int city, T coeff, size_t chunk, T& d2max);
+                void pull_nodes(int city, size_t chunk);
+                void pull_node_range(int city, T coeff, size_t chunk, int begin, int end);
+                void pull_node(int node, T cx, T cy, T coeff, wide_t sum);
+                bool build_grid();
+                void gather_candidates(int city, std::vector<int>& candidates);
                 void update_tension();
                 void update_positions();
 
-                void dump_path() {
-                        std::vector<double> x;
-                        std::vector<double> y;
-                        for (int i = 0; i < _path_length; i++) {
-                                x.push_back(rtod(_px[i]));
-                                y.push_back(rtod(_py[i]));
-                        }
-                        DUMP_INTERLEAVE("path", _path_length, &x[0], &y[0]);
-                }
-
-                void print_path(ISession &session, int n) {
-//                        std::vector<double> x;
-//                        std::vector<double> y;
-//                        for (int i = 0; i < _path_length; i++) {
-//                                x.push_back(rtod(_px[i]));
-//                                y.push_back(rtod(_py[i]));
-//                        }
-//                        session.print_path(&x[0], &y[0], _path_length, n);
-                        Path sessionPath;
-                        for (int i = 0; i < _path_length; i++) {
-                                sessionPath.emplace_back(v3(rtod(_px[i]), rtod(_py[i]), 0.0));
-                        }
-                        session.store_path("Path", n, sessionPath);
-                }
-
-                void dump_cities() {
-                        std::vector<double> x;
-                        std::vector<double> y;
-                        for (int i = 0; i < _num_cities; i++) {
-                                x.push_back(rtod(_cx[i]));
-                                y.push_back(rtod(_cy[i]));
-                        }
-                        DUMP_INTERLEAVE("cities", _num_cities, &x[0], &y[0]);
-                }
+                Tracer _tracer;
                 
         public:
                 SelfOrganizedMap(int num_cities, int path_length,
-                                 double alpha, double beta, double epsilon)
-                                 : _alpha(), _beta(), _epsilon(), _k(), _dmax2(), _n(0), _ne_ke(), _num_cities(0), _path_length(0),
+                                 double alpha, double beta, double epsilon,
+                                 std::shared_ptr<ThreadPool> pool = nullptr)
+                                 : _alpha(), _beta(), _epsilon(), _k(), _initial_k(0.2), _dmax2(), _n(0), _num_cities(0), _path_length(0),
                                  _cx(nullptr), _cy(nullptr), _px(nullptr), _py(nullptr), _dfx(nullptr), _dfy(nullptr), _tx(nullptr), _ty(nullptr),
-                                 _dx(nullptr), _dy(nullptr), _d2(nullptr), _w(nullptr), _sum(nullptr), _two()
+                                 _pool(pool), _stride(0),
+                                 _row_dx(nullptr), _row_dy(nullptr), _row_w(nullptr),
+                                 _d2max(), _sum(), _nearest(), _pruned(), _two(), _exp_min(),
+                                 _prune(false), _cutoff(4.0), _use_grid(false),
+                                 _grid_x0(0.0), _grid_y0(0.0), _grid_cell(0.0),
+                                 _grid_w(0), _grid_h(0), _cell_start(), _cell_nodes(),
+                                 _node_cell(), _cell_fill(), _candidates(),
+                                 _tracer()
 
                 {
                         exp_init();
@@ -245,21 +453,39 @@ namespace romi {
                         _num_cities = num_cities;
                         _path_length = path_length;
 
-                        // TBD: Vectors.
-                        _cx = new T[num_cities];
-                        _cy = new T[num_cities];
-                        _px = new T[path_length];
-                        _py = new T[path_length];
-                        _dfx = new T[path_length];        
-                        _dfy = new T[path_length];
-                        _tx = new T[path_length];
-                        _ty = new T[path_length];
-                        _dx = new T[_num_cities * _path_length];
-                        _dy = new T[_num_cities * _path_length];
-                        _d2 = new T[_num_cities * _path_length];
-                        _w = new T[_num_cities * _path_length];
-                        _sum = new T[_num_cities];
+                        _cx = allocate(num_cities);
+                        _cy = allocate(num_cities);
+                        _px = allocate(path_length);
+                        _py = allocate(path_length);
+                        _dfx = allocate(path_length);
+                        _dfy = allocate(path_length);
+                        _tx = allocate(path_length);
+                        _ty = allocate(path_length);
+
+                        if (!_pool)
+                                _pool = std::make_shared<ThreadPool>(1);
+                        size_t chunks = _pool->size();
+                        size_t per_line = kAlignment / sizeof(T);
+                        _stride = (static_cast<size_t>(path_length) + per_line - 1)
+                                / per_line * per_line;
+                        _row_dx = allocate(chunks * _stride);
+                        _row_dy = allocate(chunks * _stride);
+                        _row_w = allocate(chunks * _stride);
+                        _d2max.resize(chunks);
+                        _sum.resize(static_cast<size_t>(num_cities));
+                        _nearest.resize(static_cast<size_t>(num_cities));
+                        _pruned.resize(static_cast<size_t>(num_cities));
+                        _candidates.resize(chunks);
+
+                        // The pruned update keeps the number of cells
+                        // in the order of 4 * path_length.
+                        size_t nodes = static_cast<size_t>(path_length);
+                        _cell_start.reserve(4 * nodes + 1);
+                        _cell_fill.reserve(4 * nodes);
+                        _cell_nodes.resize(nodes);
+                        _node_cell.resize(nodes);
                         _two = dtor(_two, 2.0);
+                        _exp_min = dtor(_exp_min, rexp_min(_exp_min));
                 }
 
             SelfOrganizedMap(const SelfOrganizedMap&) = delete;
@@ -267,19 +493,17 @@ namespace romi {
 
                 
                 virtual ~SelfOrganizedMap() {
-                        delete[] _cx;
-                        delete[] _cy;
-                        delete[] _px;
-                        delete[] _py;
-                        delete[] _dfx;
-                        delete[] _dfy;
-                        delete[] _tx;
-                        delete[] _ty;
-                        delete[] _dx;
-                        delete[] _dy;
-                        delete[] _d2;
-                        delete[] _w;
-                        delete[] _sum;
+                        release(_cx);
+                        release(_cy);
+                        release(_px);
+                        release(_py);
+                        release(_dfx);
+                        release(_dfy);
+                        release(_tx);
+                        release(_ty);
+                        release(_row_dx);
+                        release(_row_dy);
+                        release(_row_w);
                 }
 
                 void set_alpha(double alpha) {
@@ -294,6 +518,15 @@ namespace romi {
                         _epsilon = dtor(_epsilon, epsilon);
                 }
 
+                /* In pruned mode, a city only pulls the nodes that are
+                 * closer than cutoff times k. With the Gaussian
+                 * weights exp(-d^2/2k^2), a cutoff of 4 neglects
+                 * weights below exp(-8). */
+                void set_pruning(bool prune, double cutoff) {
+                        _prune = prune;
+                        _cutoff = cutoff;
+                }
+
                 void init_cities(double *cx, double *cy) {
                         for (int i = 0; i < _num_cities; i++) {
                                 _cx[i] = dtor(_cx[i], cx[i]);
@@ -308,6 +541,46 @@ namespace romi {
                         }
                 }
 
+                /* Initialises the path with a previous solution,
+                 * for example the path of the last frame moved by
+                 * the displacement of the rover. The closed polyline
+                 * of n points is resampled at regular intervals to
+                 * the length of the path. A path that is already
+                 * close to the cities should start with a smaller k,
+                 * see set_initial_k(). */
+                void resample_path(const double *x, const double *y, int n) {
+                        std::vector<double> s(static_cast<size_t>(n) + 1, 0.0);
+                        for (int i = 0; i < n; i++) {
+                                int j = (i + 1) % n;
+                                s[static_cast<size_t>(i) + 1] = s[static_cast<size_t>(i)]
+                                        + std::hypot(x[j] - x[i], y[j] - y[i]);
+                        }
+                        double total = s[static_cast<size_t>(n)];
+                        
+                        int segment = 0;
+                        for (int node = 0; node < _path_length; node++) {
+                                double d = total * (double) node / (double) _path_length;
+                                while (segment < n - 1
+                                       && s[static_cast<size_t>(segment) + 1] <= d)
+                                        segment++;
+                                int next = (segment + 1) % n;
+                                double length = (s[static_cast<size_t>(segment) + 1]
+                                                 - s[static_cast<size_t>(segment)]);
+                                double t = (length > 0.0)?
+                                        (d - s[static_cast<size_t>(segment)]) / length : 0.0;
+                                _px[node] = dtor(_px[node], x[segment] + t * (x[next] - x[segment]));
+                                _py[node] = dtor(_py[node], y[segment] + t * (y[next] - y[segment]));
+                        }
+                }
+
+                /* The width of the neighbourhood at the first
+                 * iteration. It shrinks by 1% every 25 iterations.
+                 * The default, 0.2, suits a path that starts as a
+                 * small circle. */
+                void set_initial_k(double k) {
+                        _initial_k = k;
+                }
+
                 void make_circle(double radius) {
                         double x0 = 0.0; 
                         double y0 = 0.0;
@@ -324,7 +597,7 @@ namespace romi {
                                 double x = x0 + radius * std::cos(theta); 
                                 double y = y0 + radius * std::sin(theta);
                                 _px[i] = dtor(_px[i], x); 
-                                _px[i] = dtor(_px[i], y);
+                                _py[i] = dtor(_py[i], y);
                         }
                 }
 
@@ -336,42 +609,67 @@ namespace romi {
                         }
                 }
                 
-                bool compute_path(ISession &session, bool print);
+                /* Returns true when all the cities are within
+                 * epsilon of the path. With a time budget, in
+                 * milliseconds, the iterations stop when the budget
+                 * is spent and the path is left as it is. A budget
+                 * of zero means no limit. */
+                bool compute_path(ISession &session, double time_budget = 0.0);
+
+                Tracer& tracer() {
+                        return _tracer;
+                }
         };
 
 
-        template <typename T>
-        bool SelfOrganizedMap<T>::compute_path(ISession &session, bool print)
+        template <typename T, typename Tracer>
+        bool SelfOrganizedMap<T, Tracer>::compute_path(ISession &session, double time_budget)
         {
-                int N = 10000;
+                auto start = std::chrono::steady_clock::now();
+                bool out_of_time = false;
 
-                _k = 0.2;
-                _dmax2 = 10000.0;
+                _k = dtor(_k, _initial_k);
+                _dmax2 = dtor(_dmax2, 10000.0);
 
-                dump_cities();
-                dump_path();
+                _tracer.begin(_num_cities, _path_length);
+                _tracer.cities(_cx, _cy);
+                if (_tracer.wants(0))
+                        _tracer.path(0, _px, _py);
 
                 T eps2 = rmul(_epsilon, _epsilon);
                 
-                for (_n = 1; _n < N; _n++) {
+                for (_n = 1; _n < kMaxIterations; _n++) {
                         update();
 
-                        dump_path();
-                        if (print) print_path(session, _n);
+                        if (_tracer.wants(_n))
+                                _tracer.path(_n, _px, _py);
                         
                         if (_dmax2 < eps2)
                                 break;
+
+                        if (time_budget > 0.0) {
+                                std::chrono::duration<double, std::milli> elapsed
+                                        = std::chrono::steady_clock::now() - start;
+                                if (elapsed.count() > time_budget) {
+                                        out_of_time = true;
+                                        break;
+                                }
+                        }
                 }
                 
                 bool success = (_dmax2 < eps2);
+                _tracer.finish(session);
 
+                if (out_of_time)
+                        r_warn("SelfOrganizedMap: stopped after %d iterations, "
+                               "the time budget of %.0f ms is spent", _n, time_budget);
                 r_info("SelfOrganizedMap: n=%d, success=%s\n", _n, success? "yes":"no");
                 
                 return success;
         }
         
-        template <typename T>
-        void SelfOrganizedMap<T>::update()
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::update()
         {
                 update_distance_forces();
                 update_tension();        
@@ -390,87 +688,373 @@ namespace romi {
                 update_positions();
         }
 
-        template <typename T>
-        void SelfOrganizedMap<T>::update_distance_forces()
+        /*
+          Computes the forces that pull the nodes towards the cities.
+          The cities are handled one at a time, using three rows of
+          _path_length values, instead of filling N_cities x
+          N_nodes matrices first:
+
+          1. the differences between the city and the nodes, the
+             smallest distance, and the exponents (a vectorisable
+             loop);
+          2. the weights and their sum. The exponential, the most
+             expensive step, is skipped for the nodes that are so
+             far away that the weight is zero;
+          3. the normalised weights, added to the node forces (a
+             vectorisable loop).
+
+          With more than one thread, steps 1 and 2 are split over
+          the cities, and only the sum of the weights of each city
+          is kept. Step 3 is then split over the nodes: each thread
+          recomputes the weights of its own nodes and adds them up
+          in the order of the cities. A node therefore receives the
+          same forces, in the same order, whatever the number of
+          threads, at the cost of a second exponential per weight.
+
+          The operations, and the order of the sums, are the same as
+          when the full matrices were used, so the results don't
+          change.
+         */
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::update_distance_forces()
         {
                 T coeff = rmul(_two, rsquare(_k));
+                T zero = 0.0;
+
+                clear_forces();
+                _use_grid = _prune && build_grid();
 
-                int index = 0;
-                for (int city = 0; city < _num_cities; city++)  {
-                        for (int node = 0; node < _path_length; node++)  {             
-                                _dx[index] = rsub(_cx[city], _px[node]);
-                                _dy[index] = rsub(_cy[city], _py[node]);
-                                index++;
+                if (_pool->size() == 1) {
+                        T d2max = zero;
+                        for (int city = 0; city < _num_cities; city++) {
+                                weigh_city(city, coeff, 0, d2max);
+                                pull_nodes(city, 0);
                         }
+                        _dmax2 = d2max;
+                        return;
                 }
+                
+                _pool->parallel_for(static_cast<size_t>(_num_cities),
+                                    [&](size_t chunk, size_t begin, size_t end) {
+                        T chunk_d2max = zero;
+                        for (size_t city = begin; city < end; city++)
+                                weigh_city(static_cast<int>(city), coeff,
+                                           chunk, chunk_d2max);
+                        _d2max[chunk] = chunk_d2max;
+                });
+                
+                _dmax2 = _d2max[0];
+                for (size_t chunk = 1; chunk < _d2max.size(); chunk++)
+                        if (_d2max[chunk] > _dmax2)
+                                _dmax2 = _d2max[chunk];
+                
+                _pool->parallel_for(static_cast<size_t>(_path_length),
+                                    [&](size_t chunk, size_t begin, size_t end) {
+                        for (int city = 0; city < _num_cities; city++)
+                                pull_node_range(city, coeff, chunk,
+                                                static_cast<int>(begin),
+                                                static_cast<int>(end));
+                });
+        }
 
-                index = 0;
-                for (int city = 0; city < _num_cities; city++)  {
-                        for (int node = 0; node < _path_length; node++)  {
-                                T dx2 = rmul(_dx[index], _dx[index]);
-                                T dy2 = rmul(_dy[index], _dy[index]);
-                                _d2[index] = radd(dx2, dy2);
-                                T tmp = rneg(_d2[index]);
-                                tmp = rdiv(tmp, coeff);
-                                //r_debug("before _w[index]=exp, index=%d, tmp=%f, coeff=%f, ne_ke=%f", index, tmp, coeff, _ne_ke);
-                                _w[index] = exponential(tmp);
-                                //r_debug("after _w[index]=exp, index=%d", index);
-                                index++;
-                        }
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::clear_forces()
+        {
+                memset(_dfx, 0, static_cast<size_t>(_path_length) * sizeof(T));
+                memset(_dfy, 0, static_cast<size_t>(_path_length) * sizeof(T));
+                T zero = 0.0;
+                std::fill(_d2max.begin(), _d2max.end(), zero);
+        }
+
+        /* Steps 1 and 2 for one city, in the rows of the given
+         * chunk. In pruned mode, the city only weighs the nodes
+         * near it, if it can. */
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::weigh_city(int city, T coeff, size_t chunk, T& d2max)
+        {
+                if (!_use_grid || !weigh_candidates(city, coeff, chunk, d2max))
+                        weigh_all_nodes(city, coeff, chunk, d2max);
+        }
+        
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::weigh_all_nodes(int city, T coeff, size_t chunk, T& d2max)
+        {
+                T zero = 0.0;
+                const T * __restrict px = _px;
+                const T * __restrict py = _py;
+                T * __restrict dx = _row_dx + chunk * _stride;
+                T * __restrict dy = _row_dy + chunk * _stride;
+                T * __restrict w = _row_w + chunk * _stride;
+                T cx = _cx[city];
+                T cy = _cy[city];
+                        
+                T d2min_path;
+                d2min_path = dtor(d2min_path, 1000000.0);
+                for (int node = 0; node < _path_length; node++)  {
+                        dx[node] = rsub(cx, px[node]);
+                        dy[node] = rsub(cy, py[node]);
+                        T dx2 = rmul(dx[node], dx[node]);
+                        T dy2 = rmul(dy[node], dy[node]);
+                        T d2 = radd(dx2, dy2);
+                        if (d2 < d2min_path)
+                                d2min_path = d2;
+                        T tmp = rneg(d2);
+                        w[node] = rdiv(tmp, coeff);
                 }
 
-                index = 0;
-                for (int city = 0; city < _num_cities; city++)  {
-                        _sum[city] = 0.0;
+                wide_t sum = 0;
+                for (int node = 0; node < _path_length; node++)  {
+                        // Skip the exponential when it's zero anyway
+                        w[node] = (w[node] < _exp_min)? zero : exponential(w[node]);
+                        sum = radd(sum, w[node]);
+                }
+                if (d2min_path > d2max)
+                        d2max = d2min_path;
+
+                size_t index = static_cast<size_t>(city);
+                _sum[index] = sum;
+                _pruned[index] = false;
+                _nearest[index] = -1;
+                
+                if (sum == 0) {
+                        // All the weights underflowed. Their limit is
+                        // one for the nearest node.
+                        int nearest = 0;
+                        T d2min;
+                        d2min = dtor(d2min, 1000000.0);
                         for (int node = 0; node < _path_length; node++)  {
-                                _sum[city] = radd(_sum[city], _w[index]);
-                                index++;
+                                T d2 = radd(rmul(dx[node], dx[node]), rmul(dy[node], dy[node]));
+                                if (d2 < d2min) {
+                                        d2min = d2;
+                                        nearest = node;
+                                }
                         }
+                        _nearest[index] = nearest;
                 }
+        }
 
-                index = 0;
-                for (int city = 0; city < _num_cities; city++)  {
-                        for (int node = 0; node < _path_length; node++)  {
-                                //r_debug("before _w[index]/=sum, index=%d", index);
-                                _w[index] = rdiv(_w[index], _sum[city]);
-                                //r_debug("after _w[index]/=sum, index=%d", index);
-                                index++;
+        /* Step 3 for one city, using the rows filled by
+         * weigh_city(). */
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::pull_nodes(int city, size_t chunk)
+        {
+                T * __restrict dfx = _dfx;
+                T * __restrict dfy = _dfy;
+                const T * __restrict dx = _row_dx + chunk * _stride;
+                const T * __restrict dy = _row_dy + chunk * _stride;
+                const T * __restrict w = _row_w + chunk * _stride;
+                size_t index = static_cast<size_t>(city);
+                wide_t sum = _sum[index];
+                int nearest = _nearest[index];
+
+                if (nearest >= 0) {
+                        dfx[nearest] = radd(dfx[nearest], dx[nearest]);
+                        dfy[nearest] = radd(dfy[nearest], dy[nearest]);
+                        
+                } else if (_pruned[index]) {
+                        const std::vector<int>& candidates = _candidates[chunk];
+                        for (size_t i = 0; i < candidates.size(); i++) {
+                                int node = candidates[i];
+                                T wn = rdiv(w[i], sum);
+                                dfx[node] = radd(dfx[node], rmul(dx[i], wn));
+                                dfy[node] = radd(dfy[node], rmul(dy[i], wn));
+                        }
+                        
+                } else {
+                        for (int node = 0; node < _path_length; node++) {
+                                T wn = rdiv(w[node], sum);
+                                dfx[node] = radd(dfx[node], rmul(dx[node], wn));
+                                dfy[node] = radd(dfy[node], rmul(dy[node], wn));
                         }
                 }
+        }
+
+        /* Step 3 for one city and the nodes in [begin, end). The
+         * weights are computed again, with the same operations as
+         * in weigh_city(), and normalised with the sum that it
+         * stored. */
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::pull_node_range(int city, T coeff, size_t chunk,
+                                                          int begin, int end)
+        {
+                size_t index = static_cast<size_t>(city);
+                wide_t sum = _sum[index];
+                int nearest = _nearest[index];
+                T cx = _cx[city];
+                T cy = _cy[city];
                 
-                index = 0;
-                memset(_dfx, 0, static_cast<size_t>(_path_length) * sizeof(T));
-                memset(_dfy, 0, static_cast<size_t>(_path_length) * sizeof(T));
-                for (int city = 0; city < _num_cities; city++) {
-                        for (int node = 0; node < _path_length; node++) {
-                                T tmp = rmul(_dx[index], _w[index]);
-                                _dfx[node] = radd(_dfx[node], tmp);
-                                
-                                tmp = rmul(_dy[index], _w[index]);
-                                _dfy[node] = radd(_dfy[node], tmp);
-                                index++;
+                if (nearest >= 0) {
+                        if (nearest >= begin && nearest < end) {
+                                _dfx[nearest] = radd(_dfx[nearest], rsub(cx, _px[nearest]));
+                                _dfy[nearest] = radd(_dfy[nearest], rsub(cy, _py[nearest]));
                         }
+                        
+                } else if (_pruned[index]) {
+                        std::vector<int>& candidates = _candidates[chunk];
+                        gather_candidates(city, candidates);
+                        for (int node : candidates)
+                                if (node >= begin && node < end)
+                                        pull_node(node, cx, cy, coeff, sum);
+                        
+                } else {
+                        for (int node = begin; node < end; node++)
+                                pull_node(node, cx, cy, coeff, sum);
                 }
+        }
 
-                /////
-                T d2max = 0.0;
-                index = 0;
-                for (int city = 0; city < _num_cities; city++)  {
-                        T d2min_path;
-                        d2min_path = dtor(d2min_path, 1000000.0);
-                        for (int node = 0; node < _path_length; node++)  {
-                                if (_d2[index] < d2min_path)
-                                        d2min_path = _d2[index];
-                                index++;
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::pull_node(int node, T cx, T cy, T coeff, wide_t sum)
+        {
+                T zero = 0.0;
+                T dx = rsub(cx, _px[node]);
+                T dy = rsub(cy, _py[node]);
+                T d2 = radd(rmul(dx, dx), rmul(dy, dy));
+                T w = rdiv(rneg(d2), coeff);
+                w = (w < _exp_min)? zero : exponential(w);
+                T wn = rdiv(w, sum);
+                _dfx[node] = radd(_dfx[node], rmul(dx, wn));
+                _dfy[node] = radd(_dfy[node], rmul(dy, wn));
+        }
+
+        /*
+          Pruned mode: the nodes are sorted into a grid with cells of
+          cutoff.k wide, so that all the nodes within the cutoff
+          distance of a city are found in the 3x3 cells around it.
+          Only these nodes are weighted and pulled by the city. When
+          none of them is within the cutoff distance, the city falls
+          back to the full row so that the nearest node, and the
+          convergence test, remain exact.
+
+          Returns false when the grid has 3x3 cells or less and the
+          cutoff covers all the nodes anyway.
+         */
+        template <typename T, typename Tracer>
+        bool SelfOrganizedMap<T, Tracer>::build_grid()
+        {
+                double cell = _cutoff * rtod(_k);
+                double x0 = rtod(_px[0]);
+                double x1 = x0;
+                double y0 = rtod(_py[0]);
+                double y1 = y0;
+                
+                for (int node = 1; node < _path_length; node++) {
+                        double x = rtod(_px[node]);
+                        double y = rtod(_py[node]);
+                        x0 = std::min(x0, x);
+                        x1 = std::max(x1, x);
+                        y0 = std::min(y0, y);
+                        y1 = std::max(y1, y);
+                }
+
+                // Keep the number of cells in the order of the
+                // number of nodes.
+                double max_cells = 4.0 * _path_length;
+                if ((x1 - x0) * (y1 - y0) > max_cells * cell * cell)
+                        cell = std::sqrt((x1 - x0) * (y1 - y0) / max_cells);
+                int grid_w = static_cast<int>((x1 - x0) / cell) + 1;
+                int grid_h = static_cast<int>((y1 - y0) / cell) + 1;
+
+                if (grid_w <= 3 && grid_h <= 3)
+                        return false;
+
+                _grid_x0 = x0;
+                _grid_y0 = y0;
+                _grid_cell = cell;
+                _grid_w = grid_w;
+                _grid_h = grid_h;
+                
+                // Counting sort of the nodes into the cells
+                size_t num_cells = static_cast<size_t>(grid_w * grid_h);
+                _cell_start.assign(num_cells + 1, 0);
+                for (int node = 0; node < _path_length; node++) {
+                        int gx = static_cast<int>((rtod(_px[node]) - x0) / cell);
+                        int gy = static_cast<int>((rtod(_py[node]) - y0) / cell);
+                        int index = std::min(gy, grid_h - 1) * grid_w + std::min(gx, grid_w - 1);
+                        _node_cell[static_cast<size_t>(node)] = index;
+                        _cell_start[static_cast<size_t>(index) + 1]++;
+                }
+                for (size_t i = 0; i < num_cells; i++)
+                        _cell_start[i + 1] += _cell_start[i];
+                _cell_fill.assign(_cell_start.begin(), _cell_start.end() - 1);
+                for (int node = 0; node < _path_length; node++) {
+                        int index = _node_cell[static_cast<size_t>(node)];
+                        _cell_nodes[static_cast<size_t>(_cell_fill[static_cast<size_t>(index)]++)] = node;
+                }
+                return true;
+        }
+
+        // The nodes in the 3x3 cells around the city
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::gather_candidates(int city, std::vector<int>& candidates)
+        {
+                int gx = static_cast<int>(std::floor((rtod(_cx[city]) - _grid_x0) / _grid_cell));
+                int gy = static_cast<int>(std::floor((rtod(_cy[city]) - _grid_y0) / _grid_cell));
+
+                candidates.clear();
+                for (int j = std::max(gy - 1, 0); j <= std::min(gy + 1, _grid_h - 1); j++) {
+                        for (int i = std::max(gx - 1, 0); i <= std::min(gx + 1, _grid_w - 1); i++) {
+                                size_t index = static_cast<size_t>(j * _grid_w + i);
+                                for (int k = _cell_start[index]; k < _cell_start[index + 1]; k++)
+                                        candidates.push_back(_cell_nodes[static_cast<size_t>(k)]);
                         }
-                        if (d2min_path > d2max)
-                                d2max = d2min_path;
                 }
-                _dmax2 = d2max;
         }
 
-        template <typename T>
-        void SelfOrganizedMap<T>::update_tension()
+        /* Steps 1 and 2 for the nodes near the city. Returns false
+         * when the city must fall back to the full row. */
+        template <typename T, typename Tracer>
+        bool SelfOrganizedMap<T, Tracer>::weigh_candidates(int city, T coeff, size_t chunk, T& d2max)
+        {
+                T zero = 0.0;
+                T *dx = _row_dx + chunk * _stride;
+                T *dy = _row_dy + chunk * _stride;
+                T *w = _row_w + chunk * _stride;
+                std::vector<int>& candidates = _candidates[chunk];
+                T cx = _cx[city];
+                T cy = _cy[city];
+
+                gather_candidates(city, candidates);
+
+                size_t n = candidates.size();
+                if (n == 0)
+                        return false;
+                
+                T d2min_path;
+                d2min_path = dtor(d2min_path, 1000000.0);
+                for (size_t i = 0; i < n; i++) {
+                        int node = candidates[i];
+                        dx[i] = rsub(cx, _px[node]);
+                        dy[i] = rsub(cy, _py[node]);
+                        T d2 = radd(rmul(dx[i], dx[i]), rmul(dy[i], dy[i]));
+                        if (d2 < d2min_path)
+                                d2min_path = d2;
+                        w[i] = rdiv(rneg(d2), coeff);
+                }
+
+                if (rtod(d2min_path) > _grid_cell * _grid_cell)
+                        return false;
+                
+                wide_t sum = 0;
+                for (size_t i = 0; i < n; i++) {
+                        w[i] = (w[i] < _exp_min)? zero : exponential(w[i]);
+                        sum = radd(sum, w[i]);
+                }
+                if (sum == 0) {
+                        // Let the full row handle the underflow
+                        return false;
+                }
+                if (d2min_path > d2max)
+                        d2max = d2min_path;
+
+                size_t index = static_cast<size_t>(city);
+                _sum[index] = sum;
+                _pruned[index] = true;
+                _nearest[index] = -1;
+                return true;
+        }
+
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::update_tension()
         {
                 T tmp;
                 T minus_two{};
@@ -510,8 +1094,8 @@ namespace romi {
                 _ty[_path_length-1] = tmp;
         }
 
-        template <typename T>
-        void SelfOrganizedMap<T>::update_positions()
+        template <typename T, typename Tracer>
+        void SelfOrganizedMap<T, Tracer>::update_positions()
         {
                 T a, b;
                 
@@ -28,7 +28,7 @@ static inline
 fixed_t itofx(int v) 
 {
         fixed_t r = v;
-	return (r << FIXED_FBITS);
+	return r * FIXED_FMAX;
 }
 
 static inline
@@ -48,22 +48,19 @@ double fxtod(fixed_t r)
         return id + fd;
 }
 
+/* Rounds to the nearest fixed-point value and saturates values that
+ * are out of range. */
 static inline
 fixed_t dtofx(double v)
 {
-        r_debug("dtofx(%f)", v);
-        int neg = (v < 0.0);
-        if (neg) v = -v;
-	fixed_t i = (fixed_t) v;
-	fixed_t int_fx = (i << FIXED_FBITS);
-	double frac_double =  v - i + fx_rounding;
-	fixed_t frac_fx =  (fixed_t) (frac_double * FIXED_FMAX);
-	fixed_t r = int_fx | frac_fx;
-        return neg? -r : r;
+        double r = floor(v * (double) FIXED_FMAX + 0.5);
+        if (r >= (double) INT32_MAX)
+                return INT32_MAX;
+        if (r <= (double) INT32_MIN)
+                return INT32_MIN;
+        return (fixed_t) r;
 }
 
-
-
 static inline
 fixed_t fxadd(fixed_t a, fixed_t b)
 {
@@ -84,18 +81,75 @@ fixed_t fxmul(fixed_t a, fixed_t b)
         return r;
 }
 
+/* Returns 1/d in Q2.30 for d in [0.5, 1), given in Q0.32. The
+ * linear estimate 48/17 - 32/17 d is off by at most 1/17; three
+ * Newton-Raphson steps, r = r (2 - d r), bring it to the precision of
+ * the format. */
 static inline
-fixed_t fxrecip(fixed_t a)
+uint32_t fx_recip_normalized(uint32_t d)
 {
-        double d = fxtod(a);
-        double r = 1.0 / d;
-        return dtofx(r);
+        uint64_t r = 3031741621u - ((2021161080ull * d) >> 32);
+        for (int i = 0; i < 3; i++) {
+                uint64_t e = (1ull << 63) - (uint64_t) d * r;
+                r = (r * (e >> 32)) >> 30;
+        }
+        return (uint32_t) r;
+}
+
+/* Divides a by a 64-bit value in the same fixed-point format (with 40
+ * integer bits), using integer operations only. The quotient is
+ * rounded to the nearest value, halves away from zero, and
+ * saturated. */
+static inline
+fixed_t fxdiv_wide(fixed_t a, double_fixed_t b)
+{
+        int neg = ((a < 0) != (b < 0));
+        uint64_t ua = (a < 0)? (uint64_t) -(int64_t) a : (uint64_t) a;
+        uint64_t ub = (b < 0)? (uint64_t) 0 - (uint64_t) b : (uint64_t) b;
+
+        if (ub == 0)
+                return (a == 0)? 0 : (neg? INT32_MIN : INT32_MAX);
+
+        // b = d.2^(40 - s) with d in [0.5, 1)
+        int s = __builtin_clzll(ub);
+        uint32_t d = (uint32_t) ((ub << s) >> 32);
+        uint64_t p = ua * fx_recip_normalized(d);
+        int shift = 70 - s;
+        uint64_t q = 0;
+        if (shift < 64) {
+                // The reciprocal is only precise to about 2^-30, so
+                // an estimate in the range of fixed_t can be a few
+                // units off. The remainder of the exact division,
+                // ua.2^FBITS = q.ub + r, tells which way to correct
+                // it. Here ub < 2^57 and 2^(FBITS+1).ua < 2^56, so
+                // none of the products below overflow. Larger
+                // estimates saturate anyway.
+                uint64_t n = ua << (FIXED_FBITS + 1);
+                q = (p + (1ull << (shift - 1))) >> shift;
+                if (q <= (uint64_t) INT32_MAX + 16) {
+                        while (q > 0 && (2 * q - 1) * ub > n)
+                                q--;
+                        while ((2 * q + 1) * ub <= n)
+                                q++;
+                }
+        }
+
+        if (neg)
+                return (q > (uint64_t) INT32_MAX + 1)? INT32_MIN : (fixed_t) -(int64_t) q;
+        else
+                return (q > (uint64_t) INT32_MAX)? INT32_MAX : (fixed_t) q;
 }
 
 static inline
 fixed_t fxdiv(fixed_t a, fixed_t b)
 {
-        return fxmul(a, fxrecip(b));
+        return fxdiv_wide(a, b);
+}
+
+static inline
+fixed_t fxrecip(fixed_t a)
+{
+        return fxdiv(itofx(1), a);
 }
 
 static inline
@@ -0,0 +1,68 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#ifndef __ROMI_TSP_H
+#define __ROMI_TSP_H
+
+#include <memory>
+#include <string>
+#include "session/ISession.h"
+#include "weeder/IPathPlanner.h"
+#include "parallel/ThreadPool.h"
+
+namespace romi {
+
+        /* A path planner that solves the travelling salesman
+         * problem through the centers with its own local search
+         * (see TourOptimizer), without external solver. Segments
+         * that cross a plant cost as much as in the OR-tools
+         * planner. */
+        class TSP : public IPathPlanner
+        {
+        public:
+                static constexpr size_t kMaxThreads = 64;
+                static constexpr const char *kGreedy = "greedy";
+                static constexpr const char *kHilbert = "hilbert";
+
+        protected:
+                double time_budget_;
+                size_t neighbours_;
+                std::string construction_;
+                size_t threads_;
+                std::shared_ptr<ThreadPool> pool_;
+                std::shared_ptr<DistanceTransform> distances_;
+
+                void assert_settings();
+                
+        public:
+                explicit TSP(nlohmann::json& params);
+                ~TSP() override = default;
+                
+                Path trace_path(ISession& session, Centers& centers, Image& mask) override;
+                bool is_thread_safe() override;
+                void set_distance_transform(
+                        std::shared_ptr<DistanceTransform> distances) override;
+        };
+}
+
+#endif // __ROMI_TSP_H
@@ -0,0 +1,114 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#ifndef __ROMI_TOUR_OPTIMIZER_H
+#define __ROMI_TOUR_OPTIMIZER_H
+
+#include <chrono>
+#include <deque>
+#include <random>
+#include <vector>
+#include <api/Path.h>
+#include "constraintsolver/DistanceMatrix.h"
+#include "parallel/ThreadPool.h"
+
+namespace romi {
+
+        /* Computes a short closed tour through the nodes of a
+         * distance matrix. A first tour is built by greedy edge
+         * matching or along a Hilbert curve, and is then improved
+         * with 2-opt and Or-opt moves. The moves are only tried
+         * between a node and its k nearest neighbours, and only for
+         * the nodes whose neighbourhood changed recently (the
+         * "don't look bits"), which keeps each pass close to linear
+         * in the number of nodes. */
+        class TourOptimizer
+        {
+        public:
+                static constexpr size_t kMaxSegment = 3;
+                static constexpr size_t kKickWindow = 50;
+                
+        protected:
+                using Clock = std::chrono::steady_clock;
+                
+                const DistanceMatrix& distances_;
+                size_t size_;
+                size_t k_;
+                std::vector<size_t> neighbours_;
+                std::vector<size_t> tour_;
+                std::vector<size_t> position_;
+                std::deque<size_t> queue_;
+                std::vector<bool> queued_;
+                std::mt19937 random_;
+
+                int64_t d(size_t a, size_t b) const {
+                        return distances_(a, b);
+                }
+                size_t next(size_t node) const {
+                        size_t i = position_[node] + 1;
+                        return tour_[(i == size_)? 0 : i];
+                }
+                size_t prev(size_t node) const {
+                        size_t i = position_[node];
+                        return tour_[(i == 0)? size_ - 1 : i - 1];
+                }
+                const size_t *neighbours(size_t node) const {
+                        return &neighbours_[node * k_];
+                }
+                
+                void compute_neighbours(ThreadPool& pool);
+                void set_tour(const std::vector<size_t>& order);
+                void push(size_t node);
+                void reverse(size_t from, size_t to);
+                bool try_2opt(size_t a);
+                bool try_or_opt(size_t a);
+                void move_segment(size_t first, size_t last, size_t after, bool reversed);
+                bool local_search(Clock::time_point deadline, bool limited);
+                void kick();
+                
+        public:
+                /* k is the number of neighbours of each node that
+                 * are considered in the moves. */
+                TourOptimizer(const DistanceMatrix& distances, size_t k, ThreadPool& pool);
+                virtual ~TourOptimizer() = default;
+
+                void construct_greedy();
+                void construct_hilbert(const Path& points);
+
+                /* Applies improving moves until none is left or the
+                 * time budget, in milliseconds, is used up. A budget
+                 * of zero means no limit. With a budget, the time
+                 * left after the first local optimum is spent on
+                 * random kicks followed by local search, and the
+                 * shortest tour is kept. Returns false if the budget
+                 * ran out before the first local optimum. */
+                bool improve(double time_budget);
+                
+                int64_t length() const;
+
+                /* The tour, starting at node 0. */
+                std::vector<size_t> tour() const;
+        };
+}
+
+#endif // __ROMI_TOUR_OPTIMIZER_H
@@ -0,0 +1,80 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#ifndef __ROMI_DISTANCE_TRANSFORM_H
+#define __ROMI_DISTANCE_TRANSFORM_H
+
+#include <memory>
+#include <vector>
+#include <api/Path.h>
+#include <cv/Image.h>
+#include "parallel/ThreadPool.h"
+
+namespace romi {
+
+        /* The Euclidean distance, in pixels, from each pixel of the
+         * mask to the nearest white pixel. It is computed once, with
+         * the exact two-pass algorithm of Felzenszwalb and
+         * Huttenlocher, and then answers the clearance queries of
+         * the path planning: is a point, or a segment, at more than
+         * a given radius from all the plants? A radius of zero tells
+         * whether the segment crosses a white area of the mask. */
+        class DistanceTransform
+        {
+        protected:
+                size_t width_;
+                size_t height_;
+                std::vector<float> distance_;
+
+                void transform_columns(const Image& mask, size_t begin, size_t end);
+                void transform_rows(size_t begin, size_t end);
+                
+        public:
+                DistanceTransform(const Image& mask,
+                                  std::shared_ptr<ThreadPool> pool = nullptr);
+                virtual ~DistanceTransform() = default;
+
+                size_t width() const;
+                size_t height() const;
+                
+                /* The distance at a pixel. Points outside the mask
+                 * use the nearest pixel on the border. */
+                double distance(size_t x, size_t y) const;
+                double distance(double x, double y) const;
+
+                bool is_clear(v3 p, double radius) const;
+
+                /* Walks along the segment by sphere tracing: each
+                 * step is as long as the clearance at the current
+                 * point allows, so that the walk is fast away from
+                 * the plants. Near them, it visits every pixel that
+                 * the segment passes through. */
+                bool segment_is_clear(v3 p0, v3 p1, double radius) const;
+
+                /* The smallest distance over all the pixels that the
+                 * segment passes through. */
+                double segment_clearance(v3 p0, v3 p1) const;
+        };
+}
+
+#endif // __ROMI_DISTANCE_TRANSFORM_H
@@ -0,0 +1,43 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __ROMI_I_ODOMETRY_H
+#define __ROMI_I_ODOMETRY_H
+
+namespace romi {
+        
+        class IOdometry
+        {
+        public:
+                virtual ~IOdometry() = default;
+
+                /* Returns how far the field moved under the CNC, in
+                 * meters along the x and y axes of the workspace,
+                 * since the previous call. Returns false when the
+                 * displacement is not known. */
+                virtual bool get_displacement(double& dx, double& dy) = 0;
+        };
+}
+
+#endif // __ROMI_I_ODOMETRY_H
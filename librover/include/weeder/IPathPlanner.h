@@ -25,12 +25,14 @@
 #ifndef __ROMI_I_PATH_PLANNER_H
 #define __ROMI_I_PATH_PLANNER_H
 
+#include <memory>
 #include <vector>
 
 #include <api/Path.h>
 #include <session/ISession.h>
 #include <cv/Image.h>
 #include <cv/cv.h>
+#include "DistanceTransform.h"
 
 namespace romi {
         
@@ -40,6 +42,53 @@ namespace romi {
                 virtual ~IPathPlanner() = default;
 
                 virtual Path trace_path(ISession& session, Centers& centers, Image& mask) = 0;
+
+                /* Returns false if the planner works on the mask
+                 * alone. The pipeline then skips the computation of
+                 * the connected components and of the centers, and
+                 * calls trace_path() once with an empty list of
+                 * centers. */
+                virtual bool needs_centers() {
+                        return true;
+                }
+
+                /* Returns true if trace_path() can be called from
+                 * several threads at once, one per component. The
+                 * pipeline then plans the components in parallel. A
+                 * thread-safe planner doesn't modify its state or
+                 * write to the session in trace_path(). */
+                virtual bool is_thread_safe() {
+                        return false;
+                }
+
+                /* Called by the pipeline before trace_path() with the
+                 * scale of the mask, in pixels per meter, and the
+                 * diameter of the tool, in meters. */
+                virtual void set_scale(double meters_to_pixels, double tool_diameter) {
+                        (void) meters_to_pixels;
+                        (void) tool_diameter;
+                }
+
+                /* Tells the planner how far the field has moved in
+                 * the image, in meters, since the previous call to
+                 * trace_path(). Planners that track the plants from
+                 * one frame to the next use it to predict their new
+                 * position. The default implementation ignores it. */
+                virtual void set_displacement(double dx, double dy) {
+                        (void) dx;
+                        (void) dy;
+                }
+
+                /* Called by the pipeline before trace_path() with the
+                 * distance transform of the mask that will be passed
+                 * to trace_path(). Planners that check segments
+                 * against the mask can use it instead of computing
+                 * their own. The pipeline resets it to nullptr after
+                 * the last component. */
+                virtual void set_distance_transform(
+                        std::shared_ptr<DistanceTransform> distances) {
+                        (void) distances;
+                }
         };
 }
 
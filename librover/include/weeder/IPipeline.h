@@ -38,6 +38,11 @@ namespace romi {
                 
                 virtual std::vector<Path> run(ISession &session, Image &camera,
                                               double tool_diameter) = 0;
+
+                /* Tells the pipeline how far the field moved in the
+                 * image, in meters, since the previous call to
+                 * run(). */
+                virtual void set_displacement(double dx, double dy) = 0;
         };
 }
 
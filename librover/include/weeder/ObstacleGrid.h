@@ -0,0 +1,71 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#ifndef __ROMI_OBSTACLE_GRID_H
+#define __ROMI_OBSTACLE_GRID_H
+
+#include <string>
+#include <vector>
+#include <cv/Image.h>
+#include <session/ISession.h>
+#include "astar/AStar.hpp"
+
+namespace romi {
+
+        /* The grid of the A* detours around the plants. The mask is
+         * divided into square cells of resolution x resolution
+         * pixels, and a cell is occupied when any pixel in it is
+         * white. The cells are computed in a single pass over the
+         * mask, the first time a detour is needed, and the A*
+         * generator is then shared by all the detours in the
+         * mask. With jump_points, the generator uses Jump Point
+         * Search. */
+        class ObstacleGrid
+        {
+        protected:
+                Image& mask_;
+                size_t resolution_;
+                size_t width_;
+                size_t height_;
+                bool jump_points_;
+                bool initialized_;
+                std::vector<uint8_t> occupied_;
+                AStar::Generator generator_;
+
+                void init();
+                
+        public:
+                ObstacleGrid(Image& mask, size_t resolution, bool jump_points = false);
+                virtual ~ObstacleGrid() = default;
+
+                AStar::Generator& generator();
+                bool is_occupied(size_t x, size_t y);
+                bool is_initialized();
+
+                /* Stores the occupied cells as an image with the
+                 * size of the mask. */
+                void store(ISession& session, const std::string& name);
+        };
+}
+
+#endif // __ROMI_OBSTACLE_GRID_H
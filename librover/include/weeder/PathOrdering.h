@@ -0,0 +1,81 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __ROMI_PATH_ORDERING_H
+#define __ROMI_PATH_ORDERING_H
+
+#include <vector>
+#include <api/Path.h>
+
+namespace romi {
+
+        /* Chooses the order in which the paths of the components are
+         * hoed, and the end from which each path is entered, so that
+         * the lifted travel between them is as short as possible.
+         * The arm leaves from, and returns to, the given point. With
+         * up to kMaxExact paths, the order is the optimal one, found
+         * by dynamic programming over the subsets of paths. With
+         * more paths, a nearest-neighbour order is improved with
+         * 2-opt and Or-opt moves. */
+        class PathOrdering
+        {
+        public:
+                static constexpr size_t kMaxExact = 12;
+
+        protected:
+                // A path in the tour, and the direction it is
+                // travelled in
+                struct Leg {
+                        size_t path;
+                        bool reversed;
+                };
+                
+                v3 home_;
+                
+                static double distance(v3 a, v3 b);
+                static v3 entry(const Path& path, bool reversed);
+                static v3 exit(const Path& path, bool reversed);
+                
+                std::vector<Leg> solve_exact(const std::vector<Path>& paths) const;
+                std::vector<Leg> solve_greedy(const std::vector<Path>& paths) const;
+                void improve(const std::vector<Path>& paths, std::vector<Leg>& legs) const;
+                bool two_opt(const std::vector<Path>& paths, std::vector<Leg>& legs) const;
+                bool or_opt(const std::vector<Path>& paths, std::vector<Leg>& legs) const;
+                
+        public:
+                explicit PathOrdering(v3 home);
+                virtual ~PathOrdering() = default;
+
+                /* Reorders and reverses the paths in place. Empty
+                 * paths are removed. */
+                void order(std::vector<Path>& paths) const;
+
+                /* The length of the lifted travel from the home
+                 * position through the paths, in their current
+                 * order, and back. */
+                double transfer_length(const std::vector<Path>& paths) const;
+        };
+}
+
+#endif // __ROMI_PATH_ORDERING_H
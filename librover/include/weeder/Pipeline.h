@@ -34,6 +34,9 @@
 #include "IImageSegmentation.h"
 #include "IConnectedComponents.h"
 #include "IPipeline.h"
+#include "ObstacleGrid.h"
+#include "DistanceTransform.h"
+#include "parallel/ThreadPool.h"
 
 namespace romi {
         
@@ -44,10 +47,17 @@ namespace romi {
                 std::unique_ptr<IImageSegmentation> segmentation_;
                 std::unique_ptr<IConnectedComponents> connected_components_;
                 std::unique_ptr<IPathPlanner> planner_;
+                std::shared_ptr<ThreadPool> pool_;
+                double clearance_;
+                double simplification_;
+                bool jump_points_;
                 
                 void create_mask(ISession& session, Image &crop, Image &mask);
 
                 Path trace_path(ISession& session, Centers& centers, Image& mask);
+                std::vector<Path> trace_paths(ISession& session,
+                                              std::vector<Centers>& component_centers,
+                                              Image& mask);
                 
                 void crop_image(ISession& session, Image& camera,
                                 double tool_diameter, Image& crop);
@@ -55,28 +65,51 @@ namespace romi {
                 std::vector<Path> try_run(ISession& session, Image& camera,
                                           double tool_diameter);
 
-                void check_path(ISession& session, Image& mask, Path& path,
-                                std::vector<Path>& paths, size_t index);
-                void check_segment(ISession& session,
-                                   rcom::MemBuffer& buffer,
-                                   Image& image, v3 start, v3 end,
-                                   std::vector<Path>& paths);
-                void go_around(ISession& session,
-                               rcom::MemBuffer& buffer,
-                               Image& mask,
-                               v3 start, v3 end,
-                               std::vector<Path>& paths);
+                void compute_centers(ISession& session, Image& mask,
+                                     DistanceTransform& distances, double clearance,
+                                     double tool_diameter,
+                                     std::vector<Centers>& component_centers);
+
+                void check_path(ISession& session, Image& mask,
+                                DistanceTransform& distances, double clearance,
+                                double tool_radius, ObstacleGrid& obstacles,
+                                Path& path, std::vector<Path>& paths, size_t index);
+                void find_crossings(DistanceTransform& distances, double clearance,
+                                    Path& path, std::vector<size_t>& crossings);
+                void find_detours(DistanceTransform& distances, double clearance,
+                                  double tool_radius, ObstacleGrid& obstacles, Path& path,
+                                  std::vector<size_t>& crossings,
+                                  std::vector<Path>& detours);
+                AStar::CoordinateList go_around(AStar::Generator& generator,
+                                                v3 start, v3 end);
+                Path smooth_detour(DistanceTransform& distances, double clearance,
+                                   double tool_radius, v3 start, v3 end,
+                                   AStar::CoordinateList& cells);
+                void splice_detours(Path& path, std::vector<size_t>& crossings,
+                                    std::vector<Path>& detours,
+                                    std::vector<Path>& paths);
+                void store_crossings(ISession& session, Image& mask, Path& path,
+                                     std::vector<size_t>& crossings,
+                                     std::vector<Path>& detours,
+                                     size_t index);
+                void simplify_path(DistanceTransform& distances, double clearance,
+                                   double tool_radius, double tolerance, Path& path);
 
         public:
                 Pipeline(std::unique_ptr<IImageCropper>& cropper,
                          std::unique_ptr<IImageSegmentation>& segmentation,
                          std::unique_ptr<IConnectedComponents>& connected_components,
-                         std::unique_ptr<IPathPlanner>& planner);
+                         std::unique_ptr<IPathPlanner>& planner,
+                         std::shared_ptr<ThreadPool> pool = nullptr,
+                         double clearance = 0.0,
+                         double simplification = 0.0,
+                         bool jump_points = false);
 
                 ~Pipeline() override = default;
                 
                 std::vector<Path> run(ISession& session, Image& camera,
                                       double tool_diameter) override;
+                void set_displacement(double dx, double dy) override;
         };
 }
 
@@ -34,6 +34,7 @@
 #include "IConnectedComponents.h"
 #include "IPathPlanner.h"
 #include "IPipeline.h"
+#include "parallel/ThreadPool.h"
 
 namespace romi {
 
@@ -54,6 +55,11 @@ namespace romi {
                 static constexpr const char *kQuincunx = "quincunx"; 
                 static constexpr const char *kSOM = "som";
                 static constexpr const char *kORTools = "ortools";
+                static constexpr const char *kTSP = "tsp";
+
+                static constexpr size_t kMaxThreads = 64;
+                static constexpr double kMaxClearance = 0.1;
+                static constexpr double kMaxSimplification = 1.0;
                
         protected:
                 std::unique_ptr<IPipeline> _pipeline;
@@ -67,6 +73,14 @@ namespace romi {
 
             std::unique_ptr<IPathPlanner> build_planner(nlohmann::json& weeder);
 
+            std::shared_ptr<ThreadPool> build_thread_pool(nlohmann::json& weeder);
+
+            double get_clearance(nlohmann::json& weeder);
+
+            double get_simplification(nlohmann::json& weeder);
+
+            bool get_jump_points(nlohmann::json& weeder);
+
         private:
                 std::unique_ptr<IImageSegmentation>
                 build_segmentation(const std::string& name, nlohmann::json& weeder_props);
@@ -0,0 +1,55 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __ROMI_ROVER_ODOMETRY_H
+#define __ROMI_ROVER_ODOMETRY_H
+
+#include <api/Path.h>
+#include <rover/WheelOdometry.h>
+#include "IOdometry.h"
+
+namespace romi {
+
+        /* The displacement of the field computed from the wheel
+         * odometry of the rover. Only the travel along the rover's
+         * heading is used. The field moves backwards under the CNC,
+         * along the given forward direction of the rover expressed
+         * in the axes of the workspace. */
+        class RoverOdometry : public IOdometry
+        {
+        protected:
+                WheelOdometry& odometry_;
+                v3 forward_;
+                bool initialized_;
+                v3 location_;
+
+        public:
+                RoverOdometry(WheelOdometry& odometry, v3 forward);
+                ~RoverOdometry() override = default;
+
+                bool get_displacement(double& dx, double& dy) override;
+        };
+}
+
+#endif // __ROMI_ROVER_ODOMETRY_H
@@ -25,6 +25,7 @@
 #ifndef __ROMI_WEEDER_H
 #define __ROMI_WEEDER_H
 
+#include <memory>
 #include <string>
 
 #include "api/ICamera.h"
@@ -32,6 +33,7 @@
 #include "api/IWeeder.h"
 #include "IFileCabinet.h"
 #include "weeder/IPipeline.h"
+#include "weeder/IOdometry.h"
 #include "session/ISession.h"
 
 namespace romi {
@@ -47,10 +49,12 @@ namespace romi {
                 double _speed;
                 double _diameter_tool;
                 ISession &session_;
+                std::shared_ptr<IOdometry> odometry_;
 
                 void scale_to_range(Path &path);
                 void rotate_path_to_starting_point(Path &path);
                 void adjust_path(Path &path);
+                void order_paths(std::vector<Path>& paths);
                 void append_path(Path& combined, Path& extension);
                 void move_arm_to_camera_position();
                 void move_arm_to_start_position(v3 p);
@@ -62,6 +66,7 @@ namespace romi {
                 void stop_spindle();
                 void travel(Path& path, double v);
                 void grab_image(Image& image);
+                void update_displacement();
                 void camera_grab(Image& image);
                 std::vector<Path> analyse_image(Image& image);
                 void store_svg(Path& path, size_t index);
@@ -71,7 +76,8 @@ namespace romi {
         public:
 
                 Weeder(ICamera& camera, IPipeline& pipeline, ICNC& cnc, double z0,
-                       double speed, double diameter_tool, ISession &session);
+                       double speed, double diameter_tool, ISession &session,
+                       std::shared_ptr<IOdometry> odometry = nullptr);
                 
                 ~Weeder() override = default;
 
@@ -1,5 +1,6 @@
 #include "astar/AStar.hpp"
 #include <math.h>
+#include <limits.h>
 #include <algorithm>
 
 using namespace std::placeholders;
@@ -14,17 +15,11 @@ AStar::Vec2i operator + (const AStar::Vec2i& left_, const AStar::Vec2i& right_)
         return{ left_.x + right_.x, left_.y + right_.y };
 }
 
-AStar::Node::Node(Vec2i coordinates_, Node *parent_)
-        : G(0),
-          H(0),
-          coordinates(coordinates_),
-          parent(parent_)
+namespace
 {
-}
-
-AStar::uint AStar::Node::getScore()
-{
-        return G + H;
+        // The parent of the cells next to a source that lies
+        // outside of the world
+        const int kOutsideSource = -2;
 }
 
 AStar::Generator::Generator()
@@ -32,7 +27,19 @@ AStar::Generator::Generator()
           direction(),
           walls(),
           worldSize(),
-          directions(0)
+          directions(0),
+          wallMap(),
+          wallMapChanged(true),
+          stamp(),
+          costG(),
+          costH(),
+          openOrder(),
+          parent(),
+          closed(),
+          openSet(),
+          searchStamp(0),
+          openCount(0),
+          jumpPoints(false)
 {
         setDiagonalMovement(false);
         setHeuristic(&Heuristic::manhattan);
@@ -45,6 +52,7 @@ AStar::Generator::Generator()
 void AStar::Generator::setWorldSize(Vec2i worldSize_)
 {
         worldSize = worldSize_;
+        wallMapChanged = true;
 }
 
 void AStar::Generator::setDiagonalMovement(bool enable_)
@@ -52,6 +60,11 @@ void AStar::Generator::setDiagonalMovement(bool enable_)
         directions = (enable_ ? 8 : 4);
 }
 
+void AStar::Generator::setJumpPointSearch(bool enable_)
+{
+        jumpPoints = enable_;
+}
+
 void AStar::Generator::setHeuristic(HeuristicFunction heuristic_)
 {
         heuristic = std::bind(heuristic_, _1, _2);
@@ -60,6 +73,7 @@ void AStar::Generator::setHeuristic(HeuristicFunction heuristic_)
 void AStar::Generator::addCollision(Vec2i coordinates_)
 {
         walls.push_back(coordinates_);
+        wallMapChanged = true;
 }
 
 void AStar::Generator::removeCollision(Vec2i coordinates_)
@@ -67,106 +81,351 @@ void AStar::Generator::removeCollision(Vec2i coordinates_)
         auto it = std::find(walls.begin(), walls.end(), coordinates_);
         if (it != walls.end()) {
                 walls.erase(it);
+                wallMapChanged = true;
         }
 }
 
 void AStar::Generator::clearCollisions()
 {
         walls.clear();
+        wallMapChanged = true;
 }
 
 AStar::CoordinateList AStar::Generator::findPath(Vec2i source_, Vec2i target_)
 {
-        Node *current = nullptr;
-        NodeSet openSet, closedSet;
-        openSet.reserve(100);
-        closedSet.reserve(100);
-        openSet.push_back(new Node(source_));
-        bool reached_target = false;
+        CoordinateList path;
+
+        if (source_ == target_) {
+                path.push_back(source_);
+                return path;
+        }
         
-        while (!openSet.empty()) {
-                auto current_it = openSet.begin();
-                current = *current_it;
-
-                for (auto it = openSet.begin(); it != openSet.end(); it++) {
-                        auto node = *it;
-                        if (node->getScore() <= current->getScore()) {
-                                current = node;
-                                current_it = it;
+        // A target outside of the world can't be reached
+        if (!isInWorld(target_))
+                return path;
+
+        updateWallMap();
+        resetSearch();
+
+        if (jumpPoints && directions == 8 && isInWorld(source_))
+                return findJumpPointPath(source_, target_);
+        
+        int width = worldSize.x;
+        int targetCell = target_.y * width + target_.x;
+        
+        if (isInWorld(source_)) {
+                openCell(source_.y * width + source_.x, 0, 0, -1);
+        } else {
+                // The source is expanded directly, because it has
+                // no cell
+                for (uint i = 0; i < directions; ++i) {
+                        Vec2i newCoordinates(source_ + direction[i]);
+                        if (!detectCollision(newCoordinates)) {
+                                openCell(newCoordinates.y * width + newCoordinates.x,
+                                         (i < 4) ? 10 : 14,
+                                         heuristic(newCoordinates, target_),
+                                         kOutsideSource);
                         }
                 }
-
-                if (current->coordinates == target_) {
+        }
+        
+        bool reached_target = false;
+        
+        while (!openSet.empty()) {
+                std::pop_heap(openSet.begin(), openSet.end(), isWorse);
+                OpenEntry entry = openSet.back();
+                openSet.pop_back();
+                
+                int current = entry.cell;
+                size_t index = (size_t) current;
+                if (closed[index] || entry.score != costG[index] + costH[index])
+                        continue;
+                
+                if (current == targetCell) {
                         reached_target = true;
                         break;
                 }
 
-                closedSet.push_back(current);
-                openSet.erase(current_it);
+                closed[index] = 1;
 
+                Vec2i coordinates(current % width, current / width);
                 for (uint i = 0; i < directions; ++i) {
-                        Vec2i newCoordinates(current->coordinates + direction[i]);
-                        if (detectCollision(newCoordinates) ||
-                            findNodeOnList(closedSet, newCoordinates)) {
+                        Vec2i newCoordinates(coordinates + direction[i]);
+                        if (detectCollision(newCoordinates))
                                 continue;
+                        
+                        int successor = newCoordinates.y * width + newCoordinates.x;
+                        size_t successorIndex = (size_t) successor;
+                        uint totalCost = costG[index] + ((i < 4) ? 10 : 14);
+                        
+                        if (stamp[successorIndex] != searchStamp) {
+                                openCell(successor, totalCost,
+                                         heuristic(newCoordinates, target_), current);
+                        } else if (!closed[successorIndex]
+                                   && totalCost < costG[successorIndex]) {
+                                parent[successorIndex] = current;
+                                costG[successorIndex] = totalCost;
+                                pushCell(successor);
                         }
+                }
+        }
 
-                        uint totalCost = current->G + ((i < 4) ? 10 : 14);
+        if (reached_target) {
+                int cell = targetCell;
+                while (cell >= 0) {
+                        path.emplace_back(cell % width, cell / width);
+                        cell = parent[(size_t) cell];
+                }
+                if (cell == kOutsideSource)
+                        path.push_back(source_);
+        }
+        
+        return path;
+}
 
-                        Node *successor = findNodeOnList(openSet, newCoordinates);
-                        if (successor == nullptr) {
-                                successor = new Node(newCoordinates, current);
-                                successor->G = totalCost;
-                                successor->H = heuristic(successor->coordinates, target_);
-                                openSet.push_back(successor);
-                        }
-                        else if (totalCost < successor->G) {
-                                successor->parent = current;
-                                successor->G = totalCost;
+/*
+  Jump Point Search (Harabor and Grastien, 2011). On a grid where
+  all the moves cost the same, most of the paths between two cells
+  are equivalent. The search only stops at the cells where a choice
+  must be made: the jump points. These are the cells with a forced
+  neighbour, a free cell behind a wall that can't be reached as
+  cheaply without passing through the cell. From a jump point, only
+  the natural directions, those that continue the move from the
+  parent, and the forced ones are followed. The costs are those of
+  the cell-by-cell search, and the path is returned cell by cell.
+ */
+AStar::CoordinateList AStar::Generator::findJumpPointPath(Vec2i source_, Vec2i target_)
+{
+        int width = worldSize.x;
+        int targetCell = target_.y * width + target_.x;
+        bool reached_target = false;
+        Vec2i successors[8];
+        
+        openCell(source_.y * width + source_.x, 0, 0, -1);
+        
+        while (!openSet.empty()) {
+                std::pop_heap(openSet.begin(), openSet.end(), isWorse);
+                OpenEntry entry = openSet.back();
+                openSet.pop_back();
+                
+                int current = entry.cell;
+                size_t index = (size_t) current;
+                if (closed[index] || entry.score != costG[index] + costH[index])
+                        continue;
+                
+                if (current == targetCell) {
+                        reached_target = true;
+                        break;
+                }
+
+                closed[index] = 1;
+
+                Vec2i coordinates(current % width, current / width);
+                int count = jumpDirections(current, successors);
+                for (int i = 0; i < count; i++) {
+                        Vec2i d = successors[i];
+                        Vec2i jumpPoint;
+                        if (!jump(coordinates, d, target_, jumpPoint))
+                                continue;
+                        
+                        int successor = jumpPoint.y * width + jumpPoint.x;
+                        size_t successorIndex = (size_t) successor;
+                        int steps = std::max(abs(jumpPoint.x - coordinates.x),
+                                             abs(jumpPoint.y - coordinates.y));
+                        uint cost = (uint) steps * ((d.x != 0 && d.y != 0) ? 14 : 10);
+                        uint totalCost = costG[index] + cost;
+                        
+                        if (stamp[successorIndex] != searchStamp) {
+                                openCell(successor, totalCost,
+                                         heuristic(jumpPoint, target_), current);
+                        } else if (!closed[successorIndex]
+                                   && totalCost < costG[successorIndex]) {
+                                parent[successorIndex] = current;
+                                costG[successorIndex] = totalCost;
+                                pushCell(successor);
                         }
                 }
         }
 
+        // Fill in the cells between the jump points
         CoordinateList path;
         if (reached_target) {
-                while (current != nullptr) {
-                        path.push_back(current->coordinates);
-                        current = current->parent;
+                int cell = targetCell;
+                while (parent[(size_t) cell] >= 0) {
+                        int next = parent[(size_t) cell];
+                        Vec2i a(cell % width, cell / width);
+                        Vec2i b(next % width, next / width);
+                        Vec2i d((b.x > a.x) - (b.x < a.x), (b.y > a.y) - (b.y < a.y));
+                        for (; !(a == b); a = a + d)
+                                path.push_back(a);
+                        cell = next;
                 }
+                path.emplace_back(cell % width, cell / width);
         }
         
-        releaseNodes(openSet);
-        releaseNodes(closedSet);
-
         return path;
 }
 
-AStar::Node* AStar::Generator::findNodeOnList(NodeSet& nodes_, Vec2i coordinates_)
+/* Lists the directions to follow from a cell, given the direction
+ * in which it was reached. */
+int AStar::Generator::jumpDirections(int cell_, Vec2i *directions_)
 {
-        for (auto node : nodes_) {
-                if (node->coordinates == coordinates_) {
-                        return node;
+        int width = worldSize.x;
+        int x = cell_ % width;
+        int y = cell_ / width;
+        int count = 0;
+        int from = parent[(size_t) cell_];
+        
+        if (from < 0) {
+                for (uint i = 0; i < 8; i++)
+                        directions_[count++] = direction[i];
+                return count;
+        }
+
+        int px = from % width;
+        int py = from / width;
+        int dx = (x > px) - (x < px);
+        int dy = (y > py) - (y < py);
+
+        if (dx != 0 && dy != 0) {
+                directions_[count++] = Vec2i(dx, 0);
+                directions_[count++] = Vec2i(0, dy);
+                directions_[count++] = Vec2i(dx, dy);
+                if (!isFree(x - dx, y))
+                        directions_[count++] = Vec2i(-dx, dy);
+                if (!isFree(x, y - dy))
+                        directions_[count++] = Vec2i(dx, -dy);
+        } else if (dx != 0) {
+                directions_[count++] = Vec2i(dx, 0);
+                if (!isFree(x, y + 1))
+                        directions_[count++] = Vec2i(dx, 1);
+                if (!isFree(x, y - 1))
+                        directions_[count++] = Vec2i(dx, -1);
+        } else {
+                directions_[count++] = Vec2i(0, dy);
+                if (!isFree(x + 1, y))
+                        directions_[count++] = Vec2i(1, dy);
+                if (!isFree(x - 1, y))
+                        directions_[count++] = Vec2i(-1, dy);
+        }
+        return count;
+}
+
+/* Moves from a cell in the given direction until it finds a jump
+ * point, the target, or a wall. Returns false in the last case. */
+bool AStar::Generator::jump(Vec2i start_, Vec2i d_, Vec2i target_, Vec2i& jumpPoint_)
+{
+        int x = start_.x;
+        int y = start_.y;
+        int dx = d_.x;
+        int dy = d_.y;
+        Vec2i found;
+        
+        while (true) {
+                x += dx;
+                y += dy;
+                if (!isFree(x, y))
+                        return false;
+                if (x == target_.x && y == target_.y)
+                        break;
+                
+                if (dx != 0 && dy != 0) {
+                        if ((!isFree(x - dx, y) && isFree(x - dx, y + dy))
+                            || (!isFree(x, y - dy) && isFree(x + dx, y - dy)))
+                                break;
+                        // A diagonal move stops where one of the
+                        // straight moves finds a jump point
+                        if (jump(Vec2i(x, y), Vec2i(dx, 0), target_, found)
+                            || jump(Vec2i(x, y), Vec2i(0, dy), target_, found))
+                                break;
+                } else if (dx != 0) {
+                        if ((!isFree(x, y + 1) && isFree(x + dx, y + 1))
+                            || (!isFree(x, y - 1) && isFree(x + dx, y - 1)))
+                                break;
+                } else {
+                        if ((!isFree(x + 1, y) && isFree(x + 1, y + dy))
+                            || (!isFree(x - 1, y) && isFree(x - 1, y + dy)))
+                                break;
                 }
         }
-        return nullptr;
+        
+        jumpPoint_ = Vec2i(x, y);
+        return true;
+}
+
+bool AStar::Generator::isFree(int x_, int y_)
+{
+        return (x_ >= 0 && x_ < worldSize.x && y_ >= 0 && y_ < worldSize.y
+                && !wallMap[(size_t) (y_ * worldSize.x + x_)]);
 }
 
-void AStar::Generator::releaseNodes(NodeSet& nodes_)
+void AStar::Generator::openCell(int cell_, uint G_, uint H_, int parent_)
 {
-        for (auto it = nodes_.begin(); it != nodes_.end();) {
-                delete *it;
-                it = nodes_.erase(it);
+        size_t index = (size_t) cell_;
+        stamp[index] = searchStamp;
+        costG[index] = G_;
+        costH[index] = H_;
+        parent[index] = parent_;
+        closed[index] = 0;
+        openOrder[index] = openCount++;
+        pushCell(cell_);
+}
+
+void AStar::Generator::pushCell(int cell_)
+{
+        size_t index = (size_t) cell_;
+        openSet.push_back({ costG[index] + costH[index], openOrder[index], cell_ });
+        std::push_heap(openSet.begin(), openSet.end(), isWorse);
+}
+
+void AStar::Generator::resetSearch()
+{
+        size_t cells = wallMap.size();
+        if (stamp.size() != cells || searchStamp == UINT_MAX) {
+                stamp.assign(cells, 0);
+                costG.resize(cells);
+                costH.resize(cells);
+                openOrder.resize(cells);
+                parent.resize(cells);
+                closed.resize(cells);
+                searchStamp = 0;
         }
+        searchStamp++;
+        openCount = 0;
+        openSet.clear();
 }
 
-bool AStar::Generator::detectCollision(Vec2i coordinates_)
+void AStar::Generator::updateWallMap()
 {
-        if (coordinates_.x < 0 || coordinates_.x >= worldSize.x ||
-            coordinates_.y < 0 || coordinates_.y >= worldSize.y ||
-            std::find(walls.begin(), walls.end(), coordinates_) != walls.end()) {
-                return true;
+        if (wallMapChanged) {
+                size_t cells = 0;
+                if (worldSize.x > 0 && worldSize.y > 0)
+                        cells = (size_t) worldSize.x * (size_t) worldSize.y;
+                wallMap.assign(cells, 0);
+                for (auto& wall : walls) {
+                        if (isInWorld(wall))
+                                wallMap[(size_t) (wall.y * worldSize.x + wall.x)] = 1;
+                }
+                wallMapChanged = false;
         }
-        return false;
+}
+
+bool AStar::Generator::isInWorld(Vec2i coordinates_)
+{
+        return (coordinates_.x >= 0 && coordinates_.x < worldSize.x &&
+                coordinates_.y >= 0 && coordinates_.y < worldSize.y);
+}
+
+bool AStar::Generator::detectCollision(Vec2i coordinates_)
+{
+        return (!isInWorld(coordinates_)
+                || wallMap[(size_t) (coordinates_.y * worldSize.x + coordinates_.x)]);
+}
+
+bool AStar::Generator::isWorse(const OpenEntry& a_, const OpenEntry& b_)
+{
+        return (a_.score > b_.score
+                || (a_.score == b_.score && a_.order < b_.order));
 }
 
 AStar::Vec2i AStar::Heuristic::getDelta(Vec2i source_, Vec2i target_)
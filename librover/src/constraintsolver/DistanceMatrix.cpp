@@ -0,0 +1,71 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#include <cmath>
+#include "constraintsolver/DistanceMatrix.h"
+
+namespace romi {
+
+        DistanceMatrix::DistanceMatrix(size_t n)
+                : size_(n),
+                  data_(n * (n - (n > 0)) / 2, 0)
+        {
+        }
+
+        int64_t DistanceMatrix::segment_cost(v3 a, v3 b,
+                                             const DistanceTransform& distances)
+        {
+                if (!distances.segment_is_clear(a, b, 0.0))
+                        return kCrossingCost;
+                return (int64_t) std::hypot(b.x() - a.x(), b.y() - a.y());
+        }
+        
+        size_t DistanceMatrix::size() const
+        {
+                return size_;
+        }
+        
+        void DistanceMatrix::fill(ThreadPool& pool, const DistanceFunction& distance)
+        {
+                pool.parallel_for(data_.size(), [&](size_t chunk, size_t begin, size_t end) {
+                                (void) chunk;
+                                
+                                // Find the pair of the first entry of the chunk
+                                size_t i = 0;
+                                size_t row_end = size_ - 1;
+                                while (row_end <= begin) {
+                                        i++;
+                                        row_end += size_ - 1 - i;
+                                }
+                                size_t j = size_ - (row_end - begin);
+
+                                for (size_t k = begin; k < end; k++) {
+                                        data_[k] = distance(i, j);
+                                        if (++j == size_) {
+                                                i++;
+                                                j = i + 1;
+                                        }
+                                }
+                        });
+        }
+}
@@ -22,6 +22,7 @@
 
  */
 
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <util/Logger.h>
@@ -30,13 +31,43 @@
 
 namespace romi {
 
-        GConstraintSolver::GConstraintSolver(nlohmann::json &params) : print_(false)
+        GConstraintSolver::GConstraintSolver(nlohmann::json &params)
+                : print_(false), threads_(1), pool_(), distances_(),
+                  time_limit_(0.0), guided_local_search_(true),
+                  warm_start_(false), warm_start_distance_(0.02),
+                  meters_to_pixels_(0.0), previous_routes_(), displaced_(false),
+                  stats_mutex_(), stats_()
         {
                 if (params.contains("print"))
                         print_ = params["print"];
+                threads_ = params.value("threads", (size_t) 1);
+                time_limit_ = params.value("time-limit", 0.0);
+                guided_local_search_ = params.value("guided-local-search", true);
+                warm_start_ = params.value("warm-start", false);
+                warm_start_distance_ = params.value("warm-start-distance", 0.02);
+                
+                if (threads_ > kMaxThreads
+                    || time_limit_ < 0.0 || time_limit_ > 60000.0
+                    || warm_start_distance_ < 0.0 || warm_start_distance_ > 0.5) {
+                        r_err("GConstraintSolver: invalid settings: threads %zu, "
+                              "time-limit %f, warm-start-distance %f",
+                              threads_, time_limit_, warm_start_distance_);
+                        throw std::runtime_error("GConstraintSolver: invalid settings");
+                }
+                if (threads_ == 0)
+                        threads_ = ThreadPool::default_size();
+                pool_ = std::make_shared<ThreadPool>(threads_);
         }
 
 
+        /* The solver builds a new routing model for every call.
+         * The previous routes of the warm start and the centers
+         * stored with print are shared between the calls. */
+        bool GConstraintSolver::is_thread_safe()
+        {
+                return !warm_start_ && !print_;
+        }
+
         Path GConstraintSolver::trace_path(ISession &session, Centers& centers, Image& mask)
         {
                 std::vector<std::vector<int>> locations;
@@ -48,68 +79,182 @@ namespace romi {
                         locations.push_back(location);
                 }
 
-                {
+                if (print_) {
                         rcom::MemBuffer buffer;
                         for (auto & center : centers)
                                 buffer.printf("%zu\t%zu\n", center.first, center.second);
                         session.store_txt("centers.txt", buffer.tostring());
                 }
                 
-                return compute_path(locations, mask);
+                // Without the pipeline's distance transform, or if it
+                // was computed for another mask, compute it once here
+                std::shared_ptr<DistanceTransform> distances = distances_;
+                if (!distances
+                    || distances->width() != mask.width()
+                    || distances->height() != mask.height()) {
+                        distances = std::make_shared<DistanceTransform>(mask);
+                }
+                
+                Path path = compute_path(locations, *distances);
+                return path;
         }
 
-        static const int64_t kLargeDistance = 10000;
-        
-        static int64_t compute_distance(double x0, double y0,
-                                        double x1, double y1,
-                                        const Image& mask)
+        GConstraintSolver::SolveStats GConstraintSolver::stats() const
         {
-                int64_t distance;
-                bool line_crosses = false;
-                
-                //(void) mask;
-                line_crosses = romi::segment_crosses_white_area(mask,
-                                                                v3(x0, y0, 0),
-                                                                v3(x1, y1, 0));
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                return stats_;
+        }
+
+        /* The pipeline sets the scale once per image. The previous
+         * routes are only kept if the displacement of the field
+         * since the previous image is known. */
+        void GConstraintSolver::set_scale(double meters_to_pixels, double tool_diameter)
+        {
+                (void) tool_diameter;
+                meters_to_pixels_ = meters_to_pixels;
+                if (!displaced_)
+                        previous_routes_.clear();
+                displaced_ = false;
+        }
+
+        /* Moves the previous routes along with the field. */
+        void GConstraintSolver::set_displacement(double dx, double dy)
+        {
+                if (meters_to_pixels_ <= 0.0) {
+                        previous_routes_.clear();
+                        return;
+                }
                 
-                if (line_crosses) {
-                        distance = kLargeDistance;
-                } else {
-                        distance = (int64_t) std::hypot(x1 - x0, y1 - y0);
+                displaced_ = true;
+                double dx_pixels = dx * meters_to_pixels_;
+                double dy_pixels = dy * meters_to_pixels_;
+                for (auto& route : previous_routes_) {
+                        for (auto& p : route)
+                                p = v3(p.x() + dx_pixels, p.y() + dy_pixels, p.z());
                 }
-                return distance;
         }
-        
-        static std::vector<std::vector<int64_t>>
+
+        void GConstraintSolver::set_distance_transform(
+                std::shared_ptr<DistanceTransform> distances)
+        {
+                distances_ = distances;
+        }
+
+        /* The distance is symmetric: only the pairs fromNode <
+         * toNode are computed, in parallel. */
+        static void
         compute_distance_matrix(const std::vector<std::vector<int>> &locations,
-                                const Image& mask)
+                                const DistanceTransform& transform,
+                                ThreadPool& pool, DistanceMatrix& distances)
+        {
+                distances.fill(pool, [&](size_t fromNode, size_t toNode) {
+                                double x0 = locations[fromNode][0];
+                                double y0 = locations[fromNode][1];
+                                double x1 = locations[toNode][0];
+                                double y1 = locations[toNode][1];
+                                return DistanceMatrix::segment_cost(v3(x0, y0, 0),
+                                                                    v3(x1, y1, 0),
+                                                                    transform);
+                        });
+        }
+
+        /* Maps the previous routes onto the new locations. Each point
+         * of a previous route takes the nearest location that is not
+         * yet used, if it is closer than warm-start-distance. The
+         * route that keeps the most locations is chosen, and the
+         * locations it misses are inserted where they cost the
+         * least. The depot, node 0, is left out: it is the start and
+         * the end of the route. Returns false if no route matches. */
+        bool GConstraintSolver::remap_previous_route(
+                const std::vector<std::vector<int>>& locations,
+                const DistanceMatrix& distances,
+                std::vector<size_t>& route,
+                std::vector<Path>::iterator& previous)
         {
-                std::vector<std::vector<int64_t>> distances =
-                        std::vector<std::vector<int64_t>>(
-                                locations.size(),
-                                std::vector<int64_t>(locations.size(), int64_t{0}));
+                double max_distance = warm_start_distance_ * meters_to_pixels_;
+                size_t n = locations.size();
                 
-                for (size_t fromNode = 0; fromNode < locations.size(); fromNode++) {
-                        for (size_t toNode = 0; toNode < locations.size(); toNode++) {
-                                if (fromNode != toNode) {
-                                        double x0 = locations[fromNode][0];
-                                        double y0 = locations[fromNode][1];
-                                        double x1 = locations[toNode][0];
-                                        double y1 = locations[toNode][1];
-                                        int64_t d = compute_distance(x0, y0, x1, y1, mask);
-                                        distances[fromNode][toNode] = d;
+                previous = previous_routes_.end();
+                route.clear();
+                
+                for (auto it = previous_routes_.begin(); it != previous_routes_.end(); it++) {
+                        std::vector<bool> used(n, false);
+                        std::vector<size_t> candidate;
+                        used[0] = true;
+                        
+                        for (auto& p : *it) {
+                                size_t best = n;
+                                double best_distance = max_distance;
+                                for (size_t node = 1; node < n; node++) {
+                                        if (used[node])
+                                                continue;
+                                        double d = std::hypot(locations[node][0] - p.x(),
+                                                              locations[node][1] - p.y());
+                                        if (d <= best_distance) {
+                                                best = node;
+                                                best_distance = d;
+                                        }
+                                }
+                                if (best < n) {
+                                        used[best] = true;
+                                        candidate.push_back(best);
                                 }
                         }
+                        
+                        if (candidate.size() > route.size()) {
+                                route = candidate;
+                                previous = it;
+                        }
                 }
-                return distances;
-        }
 
+                if (route.empty())
+                        return false;
+
+                std::vector<bool> in_route(n, false);
+                for (size_t node : route)
+                        in_route[node] = true;
+                
+                for (size_t node = 1; node < n; node++) {
+                        if (in_route[node])
+                                continue;
+                        // Position 0 is between the depot and route[0],
+                        // position route.size() between the last node
+                        // and the depot.
+                        size_t best_position = 0;
+                        int64_t best_cost = 0;
+                        for (size_t k = 0; k <= route.size(); k++) {
+                                size_t before = (k == 0)? 0 : route[k - 1];
+                                size_t after = (k == route.size())? 0 : route[k];
+                                int64_t cost = (distances(before, node)
+                                                + distances(node, after)
+                                                - distances(before, after));
+                                if (k == 0 || cost < best_cost) {
+                                        best_position = k;
+                                        best_cost = cost;
+                                }
+                        }
+                        route.insert(route.begin() + (long) best_position, node);
+                }
+                return true;
+        }
+        
+        /* The new route replaces the one it started from. The
+         * oldest routes are dropped. */
+        void GConstraintSolver::store_route(Path& path, std::vector<Path>::iterator previous)
+        {
+                if (previous != previous_routes_.end())
+                        previous_routes_.erase(previous);
+                if (previous_routes_.size() >= kMaxPreviousRoutes)
+                        previous_routes_.erase(previous_routes_.begin());
+                if (!path.empty())
+                        previous_routes_.push_back(path);
+        }
+        
         Path GConstraintSolver::build_path(const operations_research::RoutingIndexManager &manager,
                                            const operations_research::RoutingModel &routing,
                                            const operations_research::Assignment &solution,
                                            const std::vector<std::vector<int>> &locations)
         {
-                r_info("TSP route calculated in %lld ms\r\n", routing.solver()->wall_time());
                 int64_t print_index = routing.Start(0);
                 std::stringstream output_route;
                 Path path;
@@ -122,13 +267,12 @@ namespace romi {
                         print_index = solution.Value(routing.NextVar(print_index));
 
                 }
-                r_info("Distance %lld\r\n", solution.ObjectiveValue());
                 return path;
         }
 
         Path GConstraintSolver::compute_path(std::vector<std::
                                              vector<int>>& locations,
-                                             const Image& mask)
+                                             const DistanceTransform& distances)
         {
                 const int num_vehicles = 1;
                 const operations_research::RoutingIndexManager::NodeIndex depot{0};
@@ -136,14 +280,15 @@ namespace romi {
                                                                  num_vehicles, depot);
                 operations_research::RoutingModel routing(manager);
 
-                const auto distance_matrix = compute_distance_matrix(locations, mask);
+                DistanceMatrix distance_matrix(locations.size());
+                compute_distance_matrix(locations, distances, *pool_, distance_matrix);
                 const int transit_callback_index = routing.RegisterTransitCallback(
                         [&distance_matrix, &manager](int64_t from_index, int64_t to_index) -> int64_t {
                                 // Convert from routing variable Index
                                 // to distance matrix NodeIndex.
                                 auto from_node = (size_t)manager.IndexToNode(from_index).value();
                                 auto to_node = (size_t)manager.IndexToNode(to_index).value();
-                                return distance_matrix[from_node][to_node];
+                                return distance_matrix(from_node, to_node);
                         });
 
                 routing.SetArcCostEvaluatorOfAllVehicles(transit_callback_index);
@@ -151,12 +296,67 @@ namespace romi {
                         = operations_research::DefaultRoutingSearchParameters();
                 searchParameters.set_first_solution_strategy(
                         operations_research::FirstSolutionStrategy::SAVINGS);
-                const operations_research::Assignment *solution
-                        = routing.SolveWithParameters(searchParameters);
+
+                // Guided local search improves the first solution until
+                // the time limit, so it is only used with a limit.
+                if (time_limit_ > 0.0) {
+                        auto milliseconds = (int64_t) time_limit_;
+                        auto limit = searchParameters.mutable_time_limit();
+                        limit->set_seconds(milliseconds / 1000);
+                        limit->set_nanos((int32_t) ((milliseconds % 1000) * 1000000));
+                        if (guided_local_search_) {
+                                searchParameters.set_local_search_metaheuristic(
+                                        operations_research::LocalSearchMetaheuristic
+                                        ::GUIDED_LOCAL_SEARCH);
+                        }
+                }
+
+                std::vector<size_t> route;
+                auto previous = previous_routes_.end();
+                const operations_research::Assignment *initial = nullptr;
+                
+                if (warm_start_ && meters_to_pixels_ > 0.0
+                    && remap_previous_route(locations, distance_matrix, route, previous)) {
+                        std::vector<std::vector<int64_t>> routes(1);
+                        for (size_t node : route) {
+                                operations_research::RoutingIndexManager::NodeIndex index{(int) node};
+                                routes[0].push_back(manager.NodeToIndex(index));
+                        }
+                        routing.CloseModelWithParameters(searchParameters);
+                        initial = routing.ReadAssignmentFromRoutes(routes, true);
+                        if (initial == nullptr)
+                                r_warn("GConstraintSolver: failed to read the previous route");
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                const operations_research::Assignment *solution;
+                if (initial != nullptr)
+                        solution = routing.SolveFromAssignmentWithParameters(initial,
+                                                                             searchParameters);
+                else 
+                        solution = routing.SolveWithParameters(searchParameters);
+                auto end = std::chrono::steady_clock::now();
+                
                 if (solution == nullptr)
                         throw std::runtime_error("Contraint Solver failed to find path.");
 
-                return build_path(manager, routing, *solution, locations);
+                SolveStats stats;
+                stats.nodes = locations.size();
+                stats.warm_started = (initial != nullptr);
+                stats.wall_time = std::chrono::duration<double, std::milli>(end - start).count();
+                stats.objective = solution->ObjectiveValue();
+                r_info("GConstraintSolver: %zu nodes, %s start, %.1f ms, objective %ld",
+                       stats.nodes, stats.warm_started? "warm" : "cold",
+                       stats.wall_time, (long) stats.objective);
+                {
+                        std::lock_guard<std::mutex> lock(stats_mutex_);
+                        stats_ = stats;
+                }
+
+                Path path = build_path(manager, routing, *solution, locations);
+                if (warm_start_)
+                        store_route(path, previous);
+                return path;
         }
 }
 
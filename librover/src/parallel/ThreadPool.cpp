@@ -0,0 +1,137 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <exception>
+#include "parallel/ThreadPool.h"
+
+namespace romi {
+
+        // The pool that owns the current thread, if any.
+        static thread_local const ThreadPool *current_pool = nullptr;
+        
+        ThreadPool::ThreadPool(size_t num_threads)
+                : _workers(),
+                  _tasks(),
+                  _mutex(),
+                  _condition(),
+                  _quit(false)
+        {
+                for (size_t i = 1; i < num_threads; i++)
+                        _workers.emplace_back([this]() { run_worker(); });
+        }
+
+        ThreadPool::~ThreadPool()
+        {
+                {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _quit = true;
+                }
+                _condition.notify_all();
+                for (auto& worker : _workers)
+                        worker.join();
+        }
+
+        size_t ThreadPool::size() const
+        {
+                return _workers.size() + 1;
+        }
+
+        size_t ThreadPool::default_size()
+        {
+                size_t n = std::thread::hardware_concurrency();
+                return (n > 0)? n : 1;
+        }
+        
+        bool ThreadPool::is_worker() const
+        {
+                return current_pool == this;
+        }
+        
+        void ThreadPool::push(std::function<void()> task)
+        {
+                {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _tasks.emplace_back(std::move(task));
+                }
+                _condition.notify_one();
+        }
+
+        void ThreadPool::run_worker()
+        {
+                current_pool = this;
+                
+                while (true) {
+                        std::function<void()> task;
+                        {
+                                std::unique_lock<std::mutex> lock(_mutex);
+                                _condition.wait(lock, [this]() {
+                                                return _quit || !_tasks.empty();
+                                        });
+                                if (_tasks.empty())
+                                        break; // _quit is set and there's no more work
+                                task = std::move(_tasks.front());
+                                _tasks.pop_front();
+                        }
+                        task();
+                }
+        }
+        
+        void ThreadPool::parallel_for(size_t count, const ChunkFunction& fn)
+        {
+                size_t chunks = size();
+                std::vector<std::future<void>> results;
+                std::exception_ptr error = nullptr;
+
+                for (size_t chunk = 1; chunk < chunks; chunk++) {
+                        size_t begin = count * chunk / chunks;
+                        size_t end = count * (chunk + 1) / chunks;
+                        if (begin < end) {
+                                results.emplace_back(submit([&fn, chunk, begin, end]() {
+                                                        fn(chunk, begin, end);
+                                                }));
+                        }
+                }
+
+                // The calling thread handles the first chunk.
+                size_t end = count / chunks;
+                try {
+                        if (end > 0)
+                                fn(0, 0, end);
+                } catch (...) {
+                        error = std::current_exception();
+                }
+                
+                for (auto& result : results) {
+                        try {
+                                result.get();
+                        } catch (...) {
+                                if (!error)
+                                        error = std::current_exception();
+                        }
+                }
+                
+                if (error)
+                        std::rethrow_exception(error);
+        }
+}
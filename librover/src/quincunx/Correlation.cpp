@@ -0,0 +1,573 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <math.h>
+#include <complex>
+#include <stdexcept>
+#include <vector>
+#include <util/Logger.h>
+#include "quincunx/Correlation.h"
+
+namespace romi {
+
+        using complex_t = std::complex<float>;
+        
+        static void fill_bell(Image& image, float xc, float yc, float stddev)
+        {
+                float r = 3.0f * stddev;
+                int ymin = (int) ceilf(yc - r);
+                int ymax = (int) floorf(yc + r);
+                float var = stddev * stddev;
+                float r2 = r * r;
+                int width = (int) image.width();
+                int height = (int) image.height();
+                
+                if (ymin >= height || ymax < 0)
+                        return;
+                if (xc - r >= (float) width || xc + r < 0.0f)
+                        return;
+                
+                if (ymin < 0)
+                        ymin = 0;
+                if (ymax >= height)
+                        ymax = height - 1;
+        
+                for (int y = ymin; y <= ymax; y++) {
+                        float _y = (float) y - yc;
+                        float _x = sqrtf(r2 - (_y * _y));
+                        int xmin = (int) roundf(xc - _x);
+                        int xmax = (int) roundf(xc + _x);
+                
+                        if (xmin >= width || xmax < 0)
+                                continue;
+                        if (xmin < 0)
+                                xmin = 0;
+                        if (xmax >= width)
+                                xmax = width - 1;
+                
+                        for (int x = xmin; x <= xmax; x++) {
+                                // For normalised values, the color
+                                // value should be divided by
+                                // 2.pi.variance. I leave it as is so
+                                // that the maximum color is white.
+                                _x = (float) x - xc;
+                                float color = expf(-(_x * _x + _y * _y) / (2.0f * var));
+                                image.set(0, (size_t) x, (size_t) y, color);
+                        }
+                }
+        }
+
+        static void make_bell(Image& bell, size_t w)
+        {
+                bell.init(Image::BW, w, w);
+                bell.fill(0, 0.0f);
+                fill_bell(bell, (float) (w / 2), (float) (w / 2), (float) (w / 6));
+        }
+
+        // The number of pixels of the interval [x0, x0 + w) that
+        // fall inside [0, n).
+        static float overlap(ssize_t x0, size_t w, size_t n)
+        {
+                ssize_t x1 = x0 + (ssize_t) w;
+                if (x0 < 0)
+                        x0 = 0;
+                if (x1 > (ssize_t) n)
+                        x1 = (ssize_t) n;
+                return (x1 > x0)? (float) (x1 - x0) : 0.0f;
+        }
+        
+        static void compute_overlaps(size_t n, size_t w, std::vector<float>& out)
+        {
+                ssize_t c = (ssize_t) (w / 2);
+                out.resize(n);
+                for (size_t i = 0; i < n; i++)
+                        out[i] = overlap((ssize_t) i - c, w, n);
+        }
+        
+        static void correlate_direct(ThreadPool& pool, Image& image,
+                                     Image& kernel, Image& out)
+        {
+                size_t width = image.width();
+                size_t height = image.height();
+                size_t w = kernel.width();
+                ssize_t c = (ssize_t) (w / 2);
+                const float *src = image.data().data();
+                const float *k = kernel.data().data();
+                float *dst = out.data().data();
+
+                pool.parallel_for(height, [=](size_t, size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) {
+                                ssize_t y0 = (ssize_t) y - c;
+                                size_t ym_min = (y0 < 0)? (size_t) -y0 : 0;
+                                size_t ym_max = std::min(w, (size_t) ((ssize_t) height - y0));
+                        
+                                for (size_t x = 0; x < width; x++) {
+                                        ssize_t x0 = (ssize_t) x - c;
+                                        size_t xm_min = (x0 < 0)? (size_t) -x0 : 0;
+                                        size_t xm_max = std::min(w, (size_t) ((ssize_t) width - x0));
+                                        float r = 0.0f;
+                                
+                                        for (size_t ym = ym_min; ym < ym_max; ym++) {
+                                                const float *row = &src[(size_t) (y0 + (ssize_t) ym) * width];
+                                                const float *krow = &k[ym * w];
+                                                for (size_t xm = xm_min; xm < xm_max; xm++)
+                                                        r += row[(size_t) (x0 + (ssize_t) xm)] * krow[xm];
+                                        }
+
+                                        float area = (float) ((xm_max - xm_min) * (ym_max - ym_min));
+                                        dst[y * width + x] = r / area;
+                                }
+                        }
+                });
+        }
+
+        static void make_gaussian(size_t w, std::vector<float>& g)
+        {
+                float c = (float) (w / 2);
+                float stddev = (float) (w / 6);
+                float var = stddev * stddev;
+                g.resize(w);
+                for (size_t i = 0; i < w; i++) {
+                        float d = (float) i - c;
+                        g[i] = expf(-(d * d) / (2.0f * var));
+                }
+        }
+        
+        static void correlate_separable(ThreadPool& pool, Image& image,
+                                        const std::vector<float>& g, Image& out)
+        {
+                size_t width = image.width();
+                size_t height = image.height();
+                size_t w = g.size();
+                size_t c = w / 2;
+                const float *src = image.data().data();
+                float *dst = out.data().data();
+                std::vector<float> tmp(width * height);
+                std::vector<float> ax;
+                std::vector<float> ay;
+                
+                compute_overlaps(width, w, ax);
+                compute_overlaps(height, w, ay);
+
+                // Horizontal pass
+                pool.parallel_for(height, [&](size_t, size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) {
+                                const float *row = &src[y * width];
+                                float *t = &tmp[y * width];
+                                for (size_t x = 0; x < width; x++) {
+                                        size_t i_min = (x < c)? c - x : 0;
+                                        size_t i_max = std::min(w, width + c - x);
+                                        float r = 0.0f;
+                                        for (size_t i = i_min; i < i_max; i++)
+                                                r += g[i] * row[x + i - c];
+                                        t[x] = r;
+                                }
+                        }
+                });
+
+                // Vertical pass, one row of the output at a time so
+                // that the inner loop runs over contiguous memory.
+                pool.parallel_for(height, [&](size_t, size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) {
+                                float *d = &dst[y * width];
+                                size_t j_min = (y < c)? c - y : 0;
+                                size_t j_max = std::min(w, height + c - y);
+                                std::fill(d, d + width, 0.0f);
+                                for (size_t j = j_min; j < j_max; j++) {
+                                        const float *t = &tmp[(y + j - c) * width];
+                                        float gj = g[j];
+                                        for (size_t x = 0; x < width; x++)
+                                                d[x] += gj * t[x];
+                                }
+                                for (size_t x = 0; x < width; x++)
+                                        d[x] /= ax[x] * ay[y];
+                        }
+                });
+        }
+
+        static size_t next_power_of_two(size_t n)
+        {
+                size_t r = 1;
+                while (r < n)
+                        r <<= 1;
+                return r;
+        }
+        
+        /* An in-place, iterative radix-2 FFT. */
+        class FFT
+        {
+        protected:
+                size_t _n;
+                std::vector<complex_t> _twiddles;
+                std::vector<size_t> _reversed;
+                
+        public:
+                explicit FFT(size_t n) : _n(n), _twiddles(n / 2), _reversed(n) {
+                        for (size_t k = 0; k < n / 2; k++) {
+                                double alpha = -2.0 * M_PI * (double) k / (double) n;
+                                _twiddles[k] = complex_t((float) cos(alpha), (float) sin(alpha));
+                        }
+                        size_t bits = 0;
+                        while (((size_t) 1 << bits) < n)
+                                bits++;
+                        for (size_t i = 0; i < n; i++) {
+                                size_t r = 0;
+                                for (size_t b = 0; b < bits; b++)
+                                        if (i & ((size_t) 1 << b))
+                                                r |= (size_t) 1 << (bits - 1 - b);
+                                _reversed[i] = r;
+                        }
+                }
+
+                size_t size() const {
+                        return _n;
+                }
+
+                void transform(complex_t *a, bool inverse) const {
+                        for (size_t i = 0; i < _n; i++) {
+                                size_t j = _reversed[i];
+                                if (i < j)
+                                        std::swap(a[i], a[j]);
+                        }
+                        for (size_t len = 2; len <= _n; len <<= 1) {
+                                size_t half = len / 2;
+                                size_t step = _n / len;
+                                for (size_t i = 0; i < _n; i += len) {
+                                        for (size_t k = 0; k < half; k++) {
+                                                complex_t w = _twiddles[k * step];
+                                                if (inverse)
+                                                        w = std::conj(w);
+                                                complex_t u = a[i + k];
+                                                complex_t v = a[i + k + half] * w;
+                                                a[i + k] = u + v;
+                                                a[i + k + half] = u - v;
+                                        }
+                                }
+                        }
+                }
+        };
+
+        // The number of columns that are copied out and transformed
+        // together. 8 complex floats fill a 64-byte cache line.
+        static const size_t kColumnTile = 8;
+        
+        static void transform_columns(ThreadPool& pool, std::vector<complex_t>& a,
+                                      FFT& fx, FFT& fy, bool inverse)
+        {
+                size_t nx = fx.size();
+                size_t ny = fy.size();
+                size_t tiles = (nx + kColumnTile - 1) / kColumnTile;
+                
+                pool.parallel_for(tiles, [&](size_t, size_t begin, size_t end) {
+                        std::vector<complex_t> columns(kColumnTile * ny);
+                        for (size_t tile = begin; tile < end; tile++) {
+                                size_t x0 = tile * kColumnTile;
+                                size_t n = std::min(kColumnTile, nx - x0);
+                                for (size_t y = 0; y < ny; y++)
+                                        for (size_t i = 0; i < n; i++)
+                                                columns[i * ny + y] = a[y * nx + x0 + i];
+                                for (size_t i = 0; i < n; i++)
+                                        fy.transform(&columns[i * ny], inverse);
+                                for (size_t y = 0; y < ny; y++)
+                                        for (size_t i = 0; i < n; i++)
+                                                a[y * nx + x0 + i] = columns[i * ny + y];
+                        }
+                });
+        }
+
+        static void transform_rows(ThreadPool& pool, std::vector<complex_t>& a,
+                                   FFT& fx, const std::vector<size_t>& rows,
+                                   bool inverse)
+        {
+                size_t nx = fx.size();
+                pool.parallel_for(rows.size(), [&](size_t, size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; i++)
+                                fx.transform(&a[rows[i] * nx], inverse);
+                });
+        }
+        
+        /* Transforms the rows [0, n) of a nx-by-ny array, then all
+         * its columns. The other rows must be zero. */
+        static void fft2_forward(ThreadPool& pool, std::vector<complex_t>& a,
+                                 FFT& fx, FFT& fy, size_t n)
+        {
+                std::vector<size_t> rows(n);
+                for (size_t y = 0; y < n; y++)
+                        rows[y] = y;
+                transform_rows(pool, a, fx, rows, false);
+                transform_columns(pool, a, fx, fy, false);
+        }
+
+        /* Inverse-transforms all the columns of a nx-by-ny array,
+         * then the rows listed in 'rows'. The result is not scaled
+         * by 1/(nx.ny). */
+        static void fft2_inverse(ThreadPool& pool, std::vector<complex_t>& a,
+                                 FFT& fx, FFT& fy, const std::vector<size_t>& rows)
+        {
+                transform_columns(pool, a, fx, fy, true);
+                transform_rows(pool, a, fx, rows, true);
+        }
+        
+        /* Copies the n-by-m array 'src' into the top-left corner
+         * of the zero-padded nx-by-ny array 'a' and transforms it. */
+        static void compute_spectrum(ThreadPool& pool, const float *src,
+                                     size_t n, size_t m, FFT& fx, FFT& fy,
+                                     std::vector<complex_t>& a)
+        {
+                size_t nx = fx.size();
+                a.assign(nx * fy.size(), complex_t(0.0f, 0.0f));
+                for (size_t y = 0; y < m; y++)
+                        for (size_t x = 0; x < n; x++)
+                                a[y * nx + x] = complex_t(src[y * n + x], 0.0f);
+                fft2_forward(pool, a, fx, fy, m);
+        }
+        
+        /* Correlates the image with a kernel of width w, given the
+         * spectra of both, padded to the same size. 'work' is
+         * scratch space. */
+        static void correlate_spectra(ThreadPool& pool,
+                                      const std::vector<complex_t>& image_spectrum,
+                                      const std::vector<complex_t>& kernel_spectrum,
+                                      FFT& fx, FFT& fy, size_t w,
+                                      std::vector<complex_t>& work, Image& out)
+        {
+                size_t width = out.width();
+                size_t height = out.height();
+                size_t nx = fx.size();
+                size_t ny = fy.size();
+                size_t c = w / 2;
+                float *dst = out.data().data();
+                std::vector<float> ax;
+                std::vector<float> ay;
+
+                compute_overlaps(width, w, ax);
+                compute_overlaps(height, w, ay);
+                
+                // Correlation: multiply by the complex conjugate of
+                // the kernel's spectrum.
+                work.resize(nx * ny);
+                pool.parallel_for(ny, [&](size_t, size_t begin, size_t end) {
+                        for (size_t i = begin * nx; i < end * nx; i++)
+                                work[i] = image_spectrum[i] * std::conj(kernel_spectrum[i]);
+                });
+
+                // The output at (x,y) is found at (x-c, y-c), modulo
+                // the size of the padded array.
+                std::vector<size_t> rows(height);
+                for (size_t y = 0; y < height; y++)
+                        rows[y] = (y + ny - c) % ny;
+                
+                fft2_inverse(pool, work, fx, fy, rows);
+
+                float scale = 1.0f / (float) (nx * ny);
+                pool.parallel_for(height, [&](size_t, size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) {
+                                const complex_t *row = &work[rows[y] * nx];
+                                for (size_t x = 0; x < width; x++) {
+                                        float v = row[(x + nx - c) % nx].real() * scale;
+                                        // Remove the rounding noise around zero
+                                        if (v < 0.0f)
+                                                v = 0.0f;
+                                        dst[y * width + x] = v / (ax[x] * ay[y]);
+                                }
+                        }
+                });
+        }
+
+        /* Keeps, for each pixel, the largest of the values found
+         * for the different kernels. */
+        static void keep_maximum(ThreadPool& pool, Image& image, Image& out)
+        {
+                const float *src = image.data().data();
+                float *dst = out.data().data();
+                size_t width = out.width();
+                pool.parallel_for(out.height(), [&](size_t, size_t begin, size_t end) {
+                        for (size_t i = begin * width; i < end * width; i++)
+                                dst[i] = std::max(dst[i], src[i]);
+                });
+        }
+
+        Correlation::Method Correlation::parse_method(const std::string& name)
+        {
+                Method method = kAuto;
+                if (name == "auto") {
+                        method = kAuto;
+                } else if (name == "direct") {
+                        method = kDirect;
+                } else if (name == "separable") {
+                        method = kSeparable;
+                } else if (name == "fft") {
+                        method = kFFT;
+                } else {
+                        r_warn("Correlation: unknown method '%s'", name.c_str());
+                        throw std::runtime_error("Correlation: unknown method");
+                }
+                return method;
+        }
+        
+        Correlation::Kernel::Kernel(size_t w)
+                : width(w),
+                  bell(),
+                  gaussian(),
+                  nx(0),
+                  ny(0),
+                  spectrum()
+        {
+                make_bell(bell, w);
+                make_gaussian(w, gaussian);
+        }
+
+        /* The average is accumulated in a single float, column by
+         * column, in the same order as the original
+         * implementation. With kDirect, the values and their
+         * average are identical to those of the original code, and
+         * the average never depends on the number of threads. */
+        static float average(Image& image)
+        {
+                size_t width = image.width();
+                size_t height = image.height();
+                const float *data = image.data().data();
+                float sum = 0.0f;
+                
+                for (size_t x = 0; x < width; x++) {
+                        for (size_t y = 0; y < height; y++)
+                                sum += data[y * width + x];
+                }
+                return sum / (float) (width * height);
+        }
+
+        Correlation::Correlation(Method method, std::shared_ptr<ThreadPool> pool)
+                : _method(method),
+                  _pool(pool),
+                  _kernels()
+        {
+                if (!_pool)
+                        _pool = std::make_shared<ThreadPool>(1);
+        }
+
+        Correlation::Kernel& Correlation::get_kernel(size_t w)
+        {
+                for (auto& kernel : _kernels) {
+                        if (kernel.width == w)
+                                return kernel;
+                }
+                if (_kernels.size() >= kMaxKernels)
+                        _kernels.erase(_kernels.begin());
+                _kernels.emplace_back(w);
+                return _kernels.back();
+        }
+
+        const std::vector<complex_t>&
+        Correlation::get_kernel_spectrum(Kernel& kernel, size_t nx, size_t ny)
+        {
+                if (kernel.nx != nx || kernel.ny != ny) {
+                        FFT fx(nx);
+                        FFT fy(ny);
+                        compute_spectrum(*_pool, kernel.bell.data().data(),
+                                         kernel.width, kernel.width, fx, fy,
+                                         kernel.spectrum);
+                        kernel.nx = nx;
+                        kernel.ny = ny;
+                }
+                return kernel.spectrum;
+        }
+        Correlation::Method Correlation::select_method(size_t w)
+        {
+                Method method = _method;
+                if (method == kAuto)
+                        method = (w < kMinFFTWidth)? kSeparable : kFFT;
+                return method;
+        }
+        
+        float Correlation::compute(Image& image, size_t w, Image& out)
+        {
+                return compute(image, std::vector<size_t>(1, w), out);
+        }
+        
+        float Correlation::compute(Image& image, const std::vector<size_t>& widths,
+                                   Image& out)
+        {
+                size_t width = image.width();
+                size_t height = image.height();
+                
+                if (image.type() != Image::BW) {
+                        r_err("Correlation: Can only handle BW images");
+                        throw std::runtime_error("Correlation: Can only handle BW images");
+                }
+                
+                out.init(Image::BW, width, height);
+                if (width == 0 || height == 0 || widths.empty())
+                        return 0.0f;
+
+                // All the kernels that use the FFT share the
+                // spectrum of the image, padded for the widest one.
+                size_t w_fft = 0;
+                for (size_t w : widths) {
+                        if (w == 0) {
+                                r_err("Correlation: Kernel width is zero");
+                                throw std::runtime_error("Correlation: Kernel width is zero");
+                        }
+                        if (select_method(w) == kFFT)
+                                w_fft = std::max(w_fft, w);
+                }
+                
+                size_t nx = next_power_of_two(width + w_fft - 1);
+                size_t ny = next_power_of_two(height + w_fft - 1);
+                FFT fx((w_fft > 0)? nx : 1);
+                FFT fy((w_fft > 0)? ny : 1);
+                std::vector<complex_t> image_spectrum;
+                std::vector<complex_t> work;
+                if (w_fft > 0)
+                        compute_spectrum(*_pool, image.data().data(), width, height,
+                                         fx, fy, image_spectrum);
+                
+                Image scaled;
+                for (size_t i = 0; i < widths.size(); i++) {
+                        Kernel& kernel = get_kernel(widths[i]);
+                        Image& dst = (i == 0)? out : scaled;
+                        dst.init(Image::BW, width, height);
+                        
+                        switch (select_method(kernel.width)) {
+                        case kSeparable:
+                                correlate_separable(*_pool, image, kernel.gaussian, dst);
+                                break;
+                        case kFFT:
+                                correlate_spectra(*_pool, image_spectrum,
+                                                  get_kernel_spectrum(kernel, nx, ny),
+                                                  fx, fy, kernel.width, work, dst);
+                                break;
+                        case kDirect:
+                        case kAuto:
+                        default:
+                                correlate_direct(*_pool, image, kernel.bell, dst);
+                                break;
+                        }
+                        
+                        if (i > 0)
+                                keep_maximum(*_pool, scaled, out);
+                }
+
+                return average(out);
+        }
+}
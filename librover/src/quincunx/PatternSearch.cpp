@@ -0,0 +1,378 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <util/Logger.h>
+#include "quincunx/PatternSearch.h"
+
+namespace romi {
+
+        // GCC vector extension: four floats that are added lane by
+        // lane, in SSE or NEON registers.
+        typedef float float4_t __attribute__ ((vector_size (16)));
+        static constexpr int kLanes = 4;
+        static constexpr size_t kPatternSize = 10;
+
+        static inline float4_t load4(const float *p)
+        {
+                float4_t v;
+                memcpy(&v, p, sizeof(v));
+                return v;
+        }
+
+        static inline void store4(float *p, float4_t v)
+        {
+                memcpy(p, &v, sizeof(v));
+        }
+
+        static inline size_t plane_index(int x, int y, int width)
+        {
+                return (size_t) y * (size_t) width + (size_t) x;
+        }
+        
+        static inline int floor_div(int a, int b)
+        {
+                int q = a / b;
+                return (a % b != 0 && a < 0)? q - 1 : q;
+        }
+        
+        PatternSearch::Method PatternSearch::parse_method(const std::string& name)
+        {
+                if (name == "pyramid")
+                        return kPyramid;
+                else if (name == "exhaustive")
+                        return kExhaustive;
+                r_err("PatternSearch: unknown method '%s'", name.c_str());
+                throw std::runtime_error("PatternSearch: unknown method");
+        }
+        
+        PatternSearch::PatternSearch(Method method, std::shared_ptr<ThreadPool> pool)
+                : _method(method),
+                  _pool(pool),
+                  _plane()
+        {
+                if (!_pool)
+                        _pool = std::make_shared<ThreadPool>(1);
+        }
+
+        void PatternSearch::make_pattern(int dp, int dr, Pattern& pattern)
+        {
+                // Three plants in the first row, four in the second,
+                // shifted by half the plant distance, and three in
+                // the third row.
+                const int dx[kPatternSize] = { 0, 0, 0,
+                                               dr, dr, dr, dr,
+                                               2 * dr, 2 * dr, 2 * dr };
+                const int dy[kPatternSize] = { 0, dp, 2 * dp,
+                                               -dp / 2, -dp / 2 + dp,
+                                               -dp / 2 + 2 * dp, -dp / 2 + 3 * dp,
+                                               0, dp, 2 * dp };
+                for (size_t k = 0; k < kPatternSize; k++) {
+                        pattern.dx[k] = dx[k];
+                        pattern.dy[k] = dy[k];
+                }
+        }
+
+        void PatternSearch::make_plane(Image& map, int dp, int dr)
+        {
+                Pattern pattern;
+                make_pattern(dp, dr, pattern);
+                
+                int dx_min = *std::min_element(pattern.dx, pattern.dx + kPatternSize);
+                int dx_max = *std::max_element(pattern.dx, pattern.dx + kPatternSize);
+                int dy_min = *std::min_element(pattern.dy, pattern.dy + kPatternSize);
+                int dy_max = *std::max_element(pattern.dy, pattern.dy + kPatternSize);
+
+                _plane.x0 = dx_min;
+                _plane.y0 = dy_min;
+                _plane.width = dr + dx_max - dx_min + 1;
+                _plane.height = dp + dy_max - dy_min + 1;
+                _plane.rows.resize((size_t) _plane.height);
+
+                int map_width = (int) map.width();
+                int map_height = (int) map.height();
+                const float *map_data = map.data().data();
+                bool inside_x = (_plane.x0 >= 0 && _plane.x0 + _plane.width <= map_width);
+
+                // Image::get() returns zero outside the image. All
+                // the rows above and below the image share the first
+                // padding row. The rows that are only partly inside
+                // the image get a padded copy.
+                std::vector<int> partial_rows;
+                for (int py = 0; py < _plane.height; py++) {
+                        int y = py + _plane.y0;
+                        if (y >= 0 && y < map_height && !inside_x)
+                                partial_rows.push_back(py);
+                }
+                
+                _plane.padding.assign((partial_rows.size() + 1) * (size_t) _plane.width, 0.0f);
+                const float *zeros = _plane.padding.data();
+                
+                for (int py = 0; py < _plane.height; py++) {
+                        int y = py + _plane.y0;
+                        if (y < 0 || y >= map_height)
+                                _plane.rows[(size_t) py] = zeros;
+                        else if (inside_x)
+                                _plane.rows[(size_t) py] = map_data
+                                        + plane_index(_plane.x0, y, map_width);
+                }
+
+                int begin = std::clamp(-_plane.x0, 0, _plane.width);
+                int end = std::clamp(map_width - _plane.x0, begin, _plane.width);
+                for (size_t i = 0; i < partial_rows.size(); i++) {
+                        int y = partial_rows[i] + _plane.y0;
+                        float *row = &_plane.padding[(i + 1) * (size_t) _plane.width];
+                        memcpy(row + begin,
+                               map_data + plane_index(_plane.x0 + begin, y, map_width),
+                               (size_t) (end - begin) * sizeof(float));
+                        _plane.rows[(size_t) partial_rows[i]] = row;
+                }
+        }
+
+        void PatternSearch::score_row(const Pattern& pattern, int y,
+                                      int x_begin, int x_end, float *out)
+        {
+                const float *rows[kPatternSize];
+                for (size_t k = 0; k < kPatternSize; k++)
+                        rows[k] = _plane.rows[(size_t) (y + pattern.dy[k] - _plane.y0)]
+                                + (pattern.dx[k] - _plane.x0);
+
+                // The ten values are added in the order of the
+                // pattern, lane by lane, so the sums are identical to
+                // the scalar ones.
+                int x = x_begin;
+                for (; x + kLanes <= x_end; x += kLanes) {
+                        float4_t sum = load4(rows[0] + x);
+                        for (size_t k = 1; k < kPatternSize; k++)
+                                sum += load4(rows[k] + x);
+                        store4(out + (x - x_begin), sum);
+                }
+                for (; x < x_end; x++) {
+                        float sum = rows[0][x];
+                        for (size_t k = 1; k < kPatternSize; k++)
+                                sum += rows[k][x];
+                        out[x - x_begin] = sum;
+                }
+        }
+
+        float PatternSearch::score(const Pattern& pattern, int x, int y)
+        {
+                float sum = 0.0f;
+                score_row(pattern, y, x, x + 1, &sum);
+                return sum;
+        }
+
+        float PatternSearch::search_window(const Pattern& pattern,
+                                           int x_begin, int x_end, int y_begin, int y_end,
+                                           int& x_max, int& y_max)
+        {
+                ThreadPool& pool = *_pool;
+                
+                // Each chunk of rows keeps the first maximum that it
+                // finds. Combining the chunks in order, with the same
+                // strict comparison, returns the same position as a
+                // single scan over all the rows.
+                std::vector<float> p_max(pool.size(), -1.0f);
+                std::vector<int> chunk_x(pool.size(), x_begin);
+                std::vector<int> chunk_y(pool.size(), y_begin);
+                
+                pool.parallel_for((size_t) (y_end - y_begin),
+                                  [&](size_t chunk, size_t begin, size_t end) {
+                        std::vector<float> scores((size_t) (x_end - x_begin));
+                        for (int y = y_begin + (int) begin; y < y_begin + (int) end; y++) {
+                                score_row(pattern, y, x_begin, x_end, scores.data());
+                                for (int x = x_begin; x < x_end; x++) {
+                                        float v = scores[(size_t) (x - x_begin)];
+                                        if (v > p_max[chunk]) {
+                                                p_max[chunk] = v;
+                                                chunk_x[chunk] = x;
+                                                chunk_y[chunk] = y;
+                                        }
+                                }
+                        }
+                });
+
+                size_t best = 0;
+                for (size_t chunk = 1; chunk < pool.size(); chunk++) {
+                        if (p_max[chunk] > p_max[best])
+                                best = chunk;
+                }
+                
+                x_max = chunk_x[best];
+                y_max = chunk_y[best];
+                return p_max[best];
+        }
+
+        float PatternSearch::search_pyramid(int dp, int dr, int& x_max, int& y_max)
+        {
+                Pattern pattern;
+                make_pattern(dp, dr, pattern);
+
+                // Score the grid points (kPyramidFactor.X,
+                // kPyramidFactor.Y). This is the same as scoring the
+                // decimated map, without building it.
+                int grid_w = dr / kPyramidFactor + 1;
+                int grid_h = dp / kPyramidFactor + 1;
+                std::vector<float> scores((size_t) (grid_w * grid_h));
+                
+                _pool->parallel_for((size_t) grid_h,
+                                    [&](size_t chunk, size_t begin, size_t end) {
+                        (void) chunk;
+                        for (size_t Y = begin; Y < end; Y++)
+                                for (size_t X = 0; X < (size_t) grid_w; X++)
+                                        scores[Y * (size_t) grid_w + X]
+                                                = score(pattern,
+                                                        (int) X * kPyramidFactor,
+                                                        (int) Y * kPyramidFactor);
+                });
+
+                std::vector<size_t> candidates(scores.size());
+                for (size_t i = 0; i < candidates.size(); i++)
+                        candidates[i] = i;
+                size_t count = std::min(kCandidates, candidates.size());
+                std::partial_sort(candidates.begin(), candidates.begin() + (long) count,
+                                  candidates.end(),
+                                  [&scores](size_t a, size_t b) {
+                                          return (scores[a] > scores[b]
+                                                  || (scores[a] == scores[b] && a < b));
+                                  });
+
+                // Search the neighbourhood of the best grid points at
+                // full resolution. Among equal maxima, keep the first
+                // one in row order, like the exhaustive search.
+                float p_max = -1.0f;
+                x_max = 0;
+                y_max = 0;
+                for (size_t i = 0; i < count; i++) {
+                        int gx = (int) (candidates[i] % (size_t) grid_w) * kPyramidFactor;
+                        int gy = (int) (candidates[i] / (size_t) grid_w) * kPyramidFactor;
+                        int x_begin = std::max(0, gx - kRefineMargin);
+                        int x_end = std::min(dr + 1, gx + kPyramidFactor + kRefineMargin);
+                        int y_begin = std::max(0, gy - kRefineMargin);
+                        int y_end = std::min(dp + 1, gy + kPyramidFactor + kRefineMargin);
+                        int x, y;
+                        float v = search_window(pattern, x_begin, x_end, y_begin, y_end, x, y);
+                        if (v > p_max
+                            || (v == p_max && (y < y_max || (y == y_max && x < x_max)))) {
+                                p_max = v;
+                                x_max = x;
+                                y_max = y;
+                        }
+                }
+                return p_max;
+        }
+
+        float PatternSearch::search_around(int dp, int dr, int cx, int cy, int radius,
+                                           int& x_max, int& y_max)
+        {
+                Pattern pattern;
+                make_pattern(dp, dr, pattern);
+                
+                float p_max = -1.0f;
+                x_max = 0;
+                y_max = 0;
+
+                // Split the window into the parts that fall in
+                // different periods of the pattern and move them
+                // back into [0,dr[ x [0,dp[. Moving one row distance
+                // along x swaps the rows with three and four plants,
+                // which is the same as moving half a plant distance
+                // along y.
+                int x0 = cx - radius;
+                int x1 = cx + radius + 1;
+                for (int s = floor_div(x0, dr); s <= floor_div(x1 - 1, dr); s++) {
+                        int x_begin = std::max(x0, s * dr) - s * dr;
+                        int x_end = std::min(x1, (s + 1) * dr) - s * dr;
+                        int shift = (s % 2 != 0)? dp / 2 : 0;
+                        int y0 = cy - radius + shift;
+                        int y1 = cy + radius + 1 + shift;
+                        
+                        for (int t = floor_div(y0, dp); t <= floor_div(y1 - 1, dp); t++) {
+                                int y_begin = std::max(y0, t * dp) - t * dp;
+                                int y_end = std::min(y1, (t + 1) * dp) - t * dp;
+                                int x, y;
+                                float v = search_window(pattern, x_begin, x_end,
+                                                        y_begin, y_end, x, y);
+                                if (v > p_max
+                                    || (v == p_max
+                                        && (y < y_max || (y == y_max && x < x_max)))) {
+                                        p_max = v;
+                                        x_max = x;
+                                        y_max = y;
+                                }
+                        }
+                }
+                return p_max;
+        }
+        
+        float PatternSearch::estimate(Image& map, float d_plants, float d_rows, point_t& pos)
+        {
+                int dr = (int) d_rows;
+                int dp = (int) d_plants;
+                int x_max = 0;
+                int y_max = 0;
+                float p_max;
+
+                make_plane(map, dp, dr);
+                
+                if (_method == kPyramid && (dr + 1) * (dp + 1) >= kMinPyramidOffsets) {
+                        p_max = search_pyramid(dp, dr, x_max, y_max);
+                } else {
+                        Pattern pattern;
+                        make_pattern(dp, dr, pattern);
+                        p_max = search_window(pattern, 0, dr + 1, 0, dp + 1, x_max, y_max);
+                }
+                
+                pos.x = (float) x_max;
+                pos.y = (float) y_max;
+                return p_max;
+        }
+
+        float PatternSearch::estimate_around(Image& map, float d_plants, float d_rows,
+                                             const point_t& predicted, int radius,
+                                             point_t& pos)
+        {
+                int dr = (int) d_rows;
+                int dp = (int) d_plants;
+
+                // A window that covers a whole period is no better
+                // than the full search.
+                if (2 * radius + 1 >= dr || 2 * radius + 1 >= dp)
+                        return estimate(map, d_plants, d_rows, pos);
+                
+                int x_max = 0;
+                int y_max = 0;
+                make_plane(map, dp, dr);
+                float p_max = search_around(dp, dr,
+                                            (int) lroundf(predicted.x),
+                                            (int) lroundf(predicted.y),
+                                            radius, x_max, y_max);
+                pos.x = (float) x_max;
+                pos.y = (float) y_max;
+                return p_max;
+        }
+}
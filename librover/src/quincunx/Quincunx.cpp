@@ -48,20 +48,57 @@ namespace romi {
                                      float y0, float y1,
                                      float dx, 
                                      float radius,
+                                     float tolerance,
                                      std::vector<point_t>& positions);
+        static void remove_redundant_points(std::vector<point_t>& path, float epsilon);
+        static void simplify_path(std::vector<point_t>& path,
+                                  const std::vector<point_t>& positions,
+                                  float radius, float tolerance);
 
         Quincunx::Quincunx(nlohmann::json& params) :
                 _distance_plants(0.0),
                 _distance_rows(0.0),
                 _radius_zones(0.0),
-                _threshold(0.0)
+                _threshold(0.0),
+                _plant_sizes(),
+                _arc_tolerance(0.01),
+                _threads(1),
+                _pool(),
+                _correlation(),
+                _pattern_search(),
+                _tracking(false),
+                _tracking_window(0.02),
+                _tracking_ratio(0.8),
+                _tracked(false),
+                _tracked_position(0.0f, 0.0f, 0.0f),
+                _tracked_p_max(0.0f),
+                _tracked_scale(0.0),
+                _displacement_x(0.0),
+                _displacement_y(0.0),
+                _meters_to_pixels(0.0),
+                _tool_diameter(0.0)
         {
                 try {
                         _distance_plants = (double) params["distance-plants"];
                         _distance_rows = (double) params["distance-rows"];
                             _radius_zones = params.value("radius-zones", 0.1);
                             _threshold = params.value("threshold", 0.5);
+                        _plant_sizes = params.value("plant-sizes", std::vector<double>{0.1});
+                        _arc_tolerance = params.value("arc-tolerance", 0.01);
+                        _threads = params.value("threads", (size_t) 1);
+                        std::string method = params.value("correlation", "auto");
+                        std::string search = params.value("pattern-search", "exhaustive");
+                        _tracking = params.value("tracking", false);
+                        _tracking_window = params.value("tracking-window", 0.02);
+                        _tracking_ratio = params.value("tracking-ratio", 0.8);
                         assert_settings();
+
+                        if (_threads == 0)
+                                _threads = ThreadPool::default_size();
+                        _pool = std::make_shared<ThreadPool>(_threads);
+                        _correlation = Correlation(Correlation::parse_method(method), _pool);
+                        _pattern_search = PatternSearch(PatternSearch::parse_method(search),
+                                                        _pool);
                         
                 } catch (nlohmann::json::exception& je) {
                         r_warn("Quincunx: invalid JSON");
@@ -74,183 +111,34 @@ namespace romi {
                 if (_distance_plants < 0.001 || _distance_plants > 10.0
                     || _distance_rows < 0.001 || _distance_rows > 10.0
                     || _radius_zones < 0.001 || _radius_zones > 1.0
-                    || _threshold <= 0.0 || _threshold > 1.0) {
+                    || _threshold <= 0.0 || _threshold > 1.0
+                    || _threads > kMaxThreads
+                    || _tracking_window < 0.0 || _tracking_window > 1.0
+                    || _tracking_ratio <= 0.0 || _tracking_ratio > 1.0
+                    || _arc_tolerance < 0.0001 || _arc_tolerance > 0.1
+                    || !valid_plant_sizes()) {
                         r_warn("Quincunx: invalid settings: distance_plants %f, "
-                               "distance_rows %f, radius_zones %f, threshold %f",
-                               _distance_plants, _distance_rows, _radius_zones, _threshold);
+                               "distance_rows %f, radius_zones %f, threshold %f, "
+                               "threads %zu, tracking_window %f, tracking_ratio %f, "
+                               "arc_tolerance %f",
+                               _distance_plants, _distance_rows, _radius_zones, _threshold,
+                               _threads, _tracking_window, _tracking_ratio, _arc_tolerance);
                         throw std::runtime_error("Quincunx: invalid settings");
                 }
         }
-        
-        
-        static float convolution(Image& image, Image& mask, ssize_t x0, ssize_t y0)
-        {
-                float r = 0.0;
-                ssize_t xi_min = x0;
-                ssize_t xi_max = x0 + mask.width();
-                ssize_t yi_min = y0;
-                ssize_t yi_max = y0 + mask.height();
-                size_t xm_min = 0;
-                size_t ym_min = 0;
-                auto& data1 = image.data();
-                auto& data2 = mask.data();
-
-                if (image.type() != Image::BW || mask.type() != Image::BW) {
-                        r_err("Quincunx: convolution: Can only handle BW images");
-                        return 0.0f;
-                }
-        
-                if (xi_max < 0
-                    || yi_max < 0
-                    || xi_min >= (ssize_t) image.width()
-                    || yi_min >= (ssize_t) image.height())
-                        return 0.0f;
-
-                if (x0 < 0) {
-                        xi_min = 0;
-                        xm_min = -x0;
-                }
-                if (y0 < 0) {
-                        yi_min = 0;
-                        ym_min = -y0;
-                }
-                
-                if (xi_max > (ssize_t) image.width())
-                        xi_max = image.width();
-                
-                if (yi_max > (ssize_t) image.height())
-                        yi_max = image.height();
 
-                float area = (xi_max - xi_min) * (yi_max - yi_min);
-
-                for (size_t yi = yi_min, ym = ym_min; yi < (size_t) yi_max; yi++, ym++) {
-                        
-                        size_t yi_off = yi * image.width();
-                        size_t ym_off = ym * mask.width();
-                        
-                        for (size_t xi = xi_min, xm = xm_min; xi < (size_t) xi_max; xi++, xm++) {
-                                float c1 = data1[yi_off + xi];
-                                float c2 = data2[ym_off + xm];
-                                r += c1 * c2;
-                        }
-                }
-                return r / area;
-        }
-
-        static void fill_bell(Image& image, float xc, float yc, float stddev)
+        bool Quincunx::valid_plant_sizes()
         {
-                float r = 3 * stddev;
-                int ymin = ceilf(yc - r);
-                int ymax = floorf(yc + r);
-                float var = stddev * stddev;
-                float r2 = r * r;
-                int width = image.width();
-                int height = image.height();
-                
-                if (ymin >= height || ymax < 0)
-                        return;
-                if (xc - r >= width || xc + r < 0)
-                        return;
-                
-                if (ymin < 0)
-                        ymin = 0;
-                if (ymax >= height)
-                        ymax = height - 1;
-        
-                for (int y = ymin; y <= ymax; y++) {
-                        float _y = (float) y - yc;
-                        float _x = sqrtf(r2 - (_y * _y));
-                        int xmin = (int) roundf(xc - _x);
-                        int xmax = (int) roundf(xc + _x);
-                
-                        if (xmin >= width || xmax < 0)
-                                continue;
-                        if (xmin < 0)
-                                xmin = 0;
-                        if (xmax >= width)
-                                xmax = width - 1;
-                
-                        for (int x = xmin; x <= xmax; x++) {
-                                // For normalised values, the color
-                                // value should be divided by
-                                // 2.pi.variance. I leave it as is so
-                                // that the maximum color is white.
-                                _x = (float) x - xc;
-                                float color = expf(-(_x * _x + _y * _y) / (2.0f * var));
-                                image.set(0, x, y, color);
+                bool valid = !_plant_sizes.empty();
+                for (double size : _plant_sizes) {
+                        if (size < 0.001 || size > 1.0) {
+                                r_warn("Quincunx: invalid plant size %f", size);
+                                valid = false;
                         }
                 }
+                return valid;
         }
         
-        static void compute_convolution(Image& image, size_t w, float *avg, Image& out)
-        {
-                Image bell(Image::BW, w, w);
-                bell.fill(0, 0.0f);
-                fill_bell(bell, w/2, w/2, w/6);
-
-                size_t width = image.width();
-                size_t height = image.height();
-                
-                out.init(Image::BW, width, height);
-                
-                float corr_avg = 0.0f;
-                float corr_max = 0.0f;
-                
-                for (size_t x = 0; x < width; x++) {
-                        for (size_t y = 0; y < height; y++) {
-                                float v = convolution(image, bell,
-                                                      x - bell.width()/2,
-                                                      y - bell.height()/2);
-                                corr_avg += v;
-                                if (v > corr_max)
-                                        corr_max = v;
-                                out.set(0, x, y, v);
-                        }
-                }
-                corr_avg /= (width * height);
-                *avg = corr_avg;
-        }
-
-        static float estimate_pattern_position(Image& map, float d_plants,
-                                               float d_rows, point_t& pos)
-        {
-                int x_max = 0;
-                int y_max = 0;
-                float p_max = -1.0f;
-
-                int dr = (int) d_rows;
-                int dp = (int) d_plants;
-                int w = dr + 1;
-                int h = dp + 1;
-
-                for (int y = 0; y < h; y++) {
-                        for (int x = 0; x < w; x++) {
-                                float v = (map.get(0, x, y)
-                                           + map.get(0, x, y + dp)
-                                           + map.get(0, x, y + 2 * dp)
-                                   
-                                           + map.get(0, x + dr, y - dp / 2)
-                                           + map.get(0, x + dr, y - dp / 2 + dp)
-                                           + map.get(0, x + dr, y - dp / 2 + 2 * dp)
-                                           + map.get(0, x + dr, y - dp / 2 + 3 * dp)
-                                   
-                                           + map.get(0, x + 2 * dr, y)
-                                           + map.get(0, x + 2 * dr, y + dp)
-                                           + map.get(0, x + 2 * dr, y + 2 * dp));
-                        
-                                if (v > p_max) {
-                                        p_max = v;
-                                        x_max = x;
-                                        y_max = y;
-                                }
-                        }
-                }
-
-                pos.x = (float) x_max;
-                pos.y = (float) y_max;
-                return p_max;
-        }
-
         static std::vector<point_t> adjust_positions(Image& map,
                                         float distance_plants_px,
                                         float distance_rows_px,
@@ -317,33 +205,84 @@ namespace romi {
                 return positions;
         }
         
-        static std::vector<point_t>
-        compute_positions(Image &mask, double distance_plants, double distance_rows, double meters_to_pixels,
-                          float *confidence)
+        /* When tracking, only the offsets around the predicted
+         * position of the pattern are searched. If the best score
+         * there drops below tracking-ratio times the score of the
+         * previous frame, or if it lies on the border of the window,
+         * the window has lost the pattern and the whole map is
+         * searched. */
+        float Quincunx::find_pattern(Image& p_map, double meters_to_pixels,
+                                     point_t& ptn_pos)
+        {
+                float dpx_plants = (float) (_distance_plants * meters_to_pixels);
+                float dpx_rows = (float) (_distance_rows * meters_to_pixels);
+                
+                if (_tracking && _tracked && _tracked_scale == meters_to_pixels) {
+                        point_t predicted(_tracked_position.x
+                                          + (float) (_displacement_x * meters_to_pixels),
+                                          _tracked_position.y
+                                          + (float) (_displacement_y * meters_to_pixels),
+                                          0.0f);
+                        int radius = std::max(1, (int) (_tracking_window * meters_to_pixels));
+                        float p_max = _pattern_search.estimate_around(p_map,
+                                                                      dpx_plants, dpx_rows,
+                                                                      predicted, radius,
+                                                                      ptn_pos);
+                        // A maximum on the border of the window is
+                        // the flank of a peak that lies outside of it.
+                        point_t inner_pos;
+                        float p_inner = _pattern_search.estimate_around(p_map,
+                                                                        dpx_plants, dpx_rows,
+                                                                        predicted, radius - 1,
+                                                                        inner_pos);
+                        bool on_border = (p_inner < p_max);
+                        if (!on_border && p_max >= (float) _tracking_ratio * _tracked_p_max) {
+                                r_info("quincunx: tracked p_max %f", (double) p_max);
+                                return p_max;
+                        }
+                        r_info("quincunx: lost track, p_max %f, previous %f%s",
+                               (double) p_max, (double) _tracked_p_max,
+                               on_border? ", maximum on the border" : "");
+                }
+                
+                float p_max = _pattern_search.estimate(p_map, dpx_plants, dpx_rows, ptn_pos);
+                r_info("quincunx: p_max %f", (double) p_max);
+                return p_max;
+        }
+        
+        std::vector<point_t> Quincunx::compute_positions(Image &mask,
+                                                         double meters_to_pixels,
+                                                         float& confidence)
         {
                 std::vector<point_t> positions;
-                float dpx_plants = (float) (distance_plants * meters_to_pixels);
-                float dpx_rows = (float) (distance_rows * meters_to_pixels);
+                float dpx_plants = (float) (_distance_plants * meters_to_pixels);
+                float dpx_rows = (float) (_distance_rows * meters_to_pixels);
                 point_t ptn_pos;
-                float p_max = -1.0f;
                 float average_prob = 0.0f;
                 
-                // 
-                size_t w = (size_t) (0.1 * meters_to_pixels);
+                // The width of the bells for the different plant sizes
+                std::vector<size_t> widths;
+                for (double size : _plant_sizes)
+                        widths.push_back(std::max((size_t) 1,
+                                                  (size_t) (size * meters_to_pixels)));
                 
                 Image p_map;
-                compute_convolution(mask, w, &average_prob, p_map);
+                average_prob = _correlation.compute(mask, widths, p_map);
 
                 // find best match for quincunx pattern                
-                p_max = estimate_pattern_position(p_map, dpx_plants, dpx_rows, ptn_pos);
-                
-                // 
-                *confidence = (p_max / 10.0f) / average_prob;
+                float p_max = find_pattern(p_map, meters_to_pixels, ptn_pos);
+                confidence = (p_max / 10.0f) / average_prob;
         
-                r_info("quincunx: p_max %f", (double) p_max);
                 r_info("quincunx: average_prob %f", (double) average_prob);
-                r_info("quincunx: confidence: %f", (double) *confidence);
-
+                r_info("quincunx: confidence: %f", (double) confidence);
+
+                _tracked = (p_max > 0.0f);
+                _tracked_position = ptn_pos;
+                _tracked_p_max = p_max;
+                _tracked_scale = meters_to_pixels;
+                _displacement_x = 0.0;
+                _displacement_y = 0.0;
+                
                 // adjust the positions of the points.
                 float delta = (float) (0.04 * meters_to_pixels);
                 positions = adjust_positions(p_map, dpx_plants, dpx_rows, &ptn_pos, delta);
@@ -351,12 +290,41 @@ namespace romi {
                 return positions;
         }
 
+        void Quincunx::set_displacement(double dx, double dy)
+        {
+                _displacement_x = dx;
+                _displacement_y = dy;
+        }
+
+        bool Quincunx::needs_centers()
+        {
+                return false;
+        }
+
+        void Quincunx::set_scale(double meters_to_pixels, double tool_diameter)
+        {
+                _meters_to_pixels = meters_to_pixels;
+                _tool_diameter = tool_diameter;
+        }
+        
         Path Quincunx::trace_path(ISession& session, Centers& centers, Image& mask)
         {
-                (void) session;
+                // The pattern is found in the mask, the centers
+                // aren't used.
                 (void) centers;
-                (void) mask;
-                throw std::runtime_error("Quincunx::trace_path: NOT IMPLEMENTED");
+                
+                if (_meters_to_pixels <= 0.0 || _tool_diameter <= 0.0) {
+                        r_err("Quincunx::trace_path: The scale and tool diameter "
+                              "must be set first");
+                        throw std::runtime_error("Quincunx::trace_path: scale not set");
+                }
+                
+                Path path;
+                if (!trace_path(session, mask, _tool_diameter, _meters_to_pixels, path)) {
+                        r_err("Quincunx::trace_path: Failed to compute the path");
+                        throw std::runtime_error("Quincunx::trace_path failed");
+                }
+                return path;
         }
         
         bool Quincunx::trace_path(ISession &session,
@@ -378,17 +346,18 @@ namespace romi {
                 diameter_tool_px = (float) (meters_to_pixels * tool_diameter);
                 border_px = diameter_tool_px / 2.0f;
 
-                positions = compute_positions(mask,
-                                              _distance_plants,
-                                              _distance_rows,
-                                              meters_to_pixels, &confidence);
+                positions = compute_positions(mask, meters_to_pixels, confidence);
 
                 if (!positions.empty()) {
                 
                         path = boustrophedon(border_px, mask.width() - border_px,
                                              border_px, mask.height() - border_px, 
                                              diameter_tool_px, radius_zones_px,
+                                             (float) (meters_to_pixels * _arc_tolerance),
                                              positions);
+                        remove_redundant_points(path, kRedundancyEpsilon);
+                        simplify_path(path, positions, radius_zones_px,
+                                      (float) (meters_to_pixels * _arc_tolerance));
                         if (!path.empty()) {
 
                                 // store_svg(session, mask.width(), mask.height(), 
@@ -599,11 +568,162 @@ namespace romi {
 
         // We're in pixel coordinates: X from left to right, Y from top to
         // bottom.
+        /*
+          Appends the path around the circle (center, radius) from
+          angle alpha0 to angle alpha1, in either direction. The
+          first point (only added when include_start is true) and
+          the last point lie on the circle. The points in between are
+          the corners of a polygon whose sides are tangent to the
+          circle, so the tool never enters the circle, and that stays
+          within 'tolerance' of it. The step is therefore chosen so
+          that radius / cos(step/2) <= radius + tolerance.
+         */
+        static void append_arc(std::vector<point_t>& path, const point_t& center,
+                               float radius, float alpha0, float alpha1,
+                               float tolerance, bool include_start)
+        {
+                float max_step = 2.0f * acosf(radius / (radius + tolerance));
+                int segments = (int) ceilf(fabsf(alpha1 - alpha0) / max_step);
+                
+                if (include_start)
+                        path.emplace_back(center.x + radius * cosf(alpha0),
+                                          center.y + radius * sinf(alpha0), 0.0f);
+                
+                if (segments > 0) {
+                        float step = (alpha1 - alpha0) / segments;
+                        float r = radius / cosf(step / 2.0f);
+                        for (int i = 0; i < segments; i++) {
+                                float alpha = alpha0 + (i + 0.5f) * step;
+                                path.emplace_back(center.x + r * cosf(alpha),
+                                                  center.y + r * sinf(alpha), 0.0f);
+                        }
+                }
+                
+                path.emplace_back(center.x + radius * cosf(alpha1),
+                                  center.y + radius * sinf(alpha1), 0.0f);
+        }
+
+        /*
+          Removes the points that coincide with the previous point
+          and the points that lie on the straight line between their
+          neighbours (within epsilon, and without turning back). Each
+          point of the path becomes a waypoint for the CNC so there's
+          no use in keeping them.
+         */
+        static void remove_redundant_points(std::vector<point_t>& path, float epsilon)
+        {
+                std::vector<point_t> result;
+                
+                for (auto& p : path) {
+                        if (!result.empty()) {
+                                const point_t& b = result.back();
+                                if (fabsf(p.x - b.x) <= epsilon && fabsf(p.y - b.y) <= epsilon)
+                                        continue;
+                        }
+                        if (result.size() >= 2) {
+                                const point_t& a = result[result.size() - 2];
+                                const point_t& b = result.back();
+                                float ux = b.x - a.x;
+                                float uy = b.y - a.y;
+                                float vx = p.x - b.x;
+                                float vy = p.y - b.y;
+                                float length = sqrtf(ux * ux + uy * uy + vx * vx + vy * vy);
+                                float cross = ux * vy - uy * vx;
+                                float dot = ux * vx + uy * vy;
+                                // The distance of b to the line (a,p) is
+                                // about cross / |a p|.
+                                if (dot > 0.0f && fabsf(cross) <= epsilon * length)
+                                        result.pop_back();
+                        }
+                        result.push_back(p);
+                }
+                
+                path.swap(result);
+        }
+
+        static float distance_to_segment(const point_t& p, const point_t& a,
+                                         const point_t& b)
+        {
+                float ux = b.x - a.x;
+                float uy = b.y - a.y;
+                float length2 = ux * ux + uy * uy;
+                float t = 0.0f;
+                if (length2 > 0.0f)
+                        t = ((p.x - a.x) * ux + (p.y - a.y) * uy) / length2;
+                t = std::max(0.0f, std::min(1.0f, t));
+                float dx = a.x + t * ux - p.x;
+                float dy = a.y + t * uy - p.y;
+                return sqrtf(dx * dx + dy * dy);
+        }
+
+        /*
+          Ramer-Douglas-Peucker: the points of a span that are
+          closer to its chord than 'tolerance' are dropped, as long
+          as the chord doesn't enter any of the zones. Otherwise the
+          span is split at its farthest point. The sides of the arcs
+          are tangent to the zones, so the chords are allowed to
+          touch them, up to kZoneEpsilon.
+         */
+        static void simplify_path(std::vector<point_t>& path,
+                                  const std::vector<point_t>& positions,
+                                  float radius, float tolerance)
+        {
+                if (path.size() < 3)
+                        return;
+                
+                std::vector<bool> keep(path.size(), false);
+                keep.front() = true;
+                keep.back() = true;
+                
+                std::vector<std::pair<size_t, size_t>> spans;
+                spans.emplace_back(0, path.size() - 1);
+                
+                while (!spans.empty()) {
+                        size_t first = spans.back().first;
+                        size_t last = spans.back().second;
+                        spans.pop_back();
+                        if (last - first < 2)
+                                continue;
+
+                        size_t farthest = first + 1;
+                        float max_deviation = 0.0f;
+                        for (size_t k = first + 1; k < last; k++) {
+                                float d = distance_to_segment(path[k], path[first],
+                                                              path[last]);
+                                if (d > max_deviation) {
+                                        max_deviation = d;
+                                        farthest = k;
+                                }
+                        }
+
+                        bool clear = (max_deviation <= tolerance);
+                        for (size_t i = 0; clear && i < positions.size(); i++) {
+                                float d = distance_to_segment(positions[i], path[first],
+                                                              path[last]);
+                                clear = (d >= radius - Quincunx::kZoneEpsilon);
+                        }
+                        
+                        if (!clear) {
+                                keep[farthest] = true;
+                                spans.emplace_back(first, farthest);
+                                spans.emplace_back(farthest, last);
+                        }
+                }
+
+                std::vector<point_t> result;
+                for (size_t k = 0; k < path.size(); k++) {
+                        if (keep[k])
+                                result.push_back(path[k]);
+                }
+                path.swap(result);
+        }
+
         static std::vector<point_t> boustrophedon(float x0, float x1,
                                      float y0, float y1,
                                      float dx, 
                                      float radius,
-                                      std::vector<point_t>& positions)
+                                     float tolerance,
+                                     std::vector<point_t>& positions)
         {
                 std::vector<point_t> path;
                 float x, y, z;
@@ -640,7 +760,7 @@ namespace romi {
 
                 std::sort( pos.begin( ), pos.end( ), [ ]( const point_t & lhs, const point_t & rhs )
                 {
-                    return largest_y_first(lhs, rhs);
+                    return largest_y_first(lhs, rhs) < 0;
                 });
 
 
@@ -688,13 +808,12 @@ namespace romi {
 //                        pos = list_sort(pos, (compare_func_t) largest_y_first);
                         std::sort( pos.begin( ), pos.end( ), [ ]( const point_t & lhs, const point_t & rhs )
                         {
-                            return largest_y_first(lhs, rhs);
+                            return largest_y_first(lhs, rhs) < 0;
                         });
 
 //                        for (list_t *l = pos; l != nullptr; l = list_next(l)) {
                         for (auto& position : pos) {
-                                float ys0, ys1, dy, alpha0, alpha1, d_alpha;
-                                int segments;
+                                float ys0, ys1, dy, alpha0, alpha1;
 //                                point_t *p = list_get(l, point_t);
                                 int deviation = intersects_y(x, y0, y, position, radius, &ys0, &ys1);
                                 switch (deviation) {
@@ -721,18 +840,9 @@ namespace romi {
                                                         alpha1 += 2 * M_PI; 
                                                 }
                                         }
-                                        if (alpha1 > alpha0)
-                                                segments = (int) (1.0f + 6.0f * (alpha1 - alpha0) / M_PI);
-                                        else segments = (int) (1.0f + 6.0f * (alpha0 - alpha1) / M_PI);
-                                        d_alpha = (alpha1 - alpha0) / segments;
-                                        for (int i = 0; i <= segments; i++) {
-                                                float alpha = alpha0 + i * d_alpha;
-                                                float y_ = position.y + radius * sinf(alpha);
-                                                float x_ = position.x + radius * cosf(alpha);
-//                                                path = path_append(path, x_, y_, z);
-                                                path.emplace_back(x_, y_, z);
-                                                y = y_;
-                                        }
+                                        append_arc(path, position, radius,
+                                                   alpha0, alpha1, tolerance, true);
+                                        y = path.back().y;
                                         break;
                                 case INTERSECTS_FIRST_POINT_INSIDE:
                                         if (x < position.x) {
@@ -758,15 +868,10 @@ namespace romi {
                                                         if (alpha2 > alpha1)
                                                                 alpha1 = alpha2;
                                                 }
-                                                segments = (int) (1.0f + 6.0f * (alpha0 - alpha1) / M_PI);
-                                                d_alpha = (alpha0 - alpha1) / segments;
-                                                for (int i = 0; i <= segments; i++) {
-                                                        float alpha = alpha0 - i * d_alpha;
-                                                        y = position.y + radius * sinf(alpha);
-                                                        x = position.x + radius * cosf(alpha);
-//                                                        path = path_append(path, x, y, z);
-                                                        path.emplace_back(x, y, z);
-                                                }
+                                                append_arc(path, position, radius,
+                                                           alpha0, alpha1, tolerance, false);
+                                                x = path.back().x;
+                                                y = path.back().y;
                                                 yt = y;
                                         
                                         }
@@ -797,13 +902,12 @@ namespace romi {
 //                        pos = list_sort(pos, (compare_func_t) smallest_x_first);
                         std::sort( pos.begin( ), pos.end( ), [ ]( const point_t& lhs, const point_t& rhs )
                         {
-                            return smallest_x_first(lhs, rhs);
+                            return smallest_x_first(lhs, rhs) < 0;
                         });
 
 //                        for (list_t *l = pos; l != nullptr; l = list_next(l)) {
                         for (auto& position : pos) {
-                                float xs0, xs1, dxp, dxt, alpha0, alpha1, d_alpha;
-                                int segments;
+                                float xs0, xs1, dxp, dxt, alpha0, alpha1;
 //                                point_t *p = list_get(l, point_t);
                                 int deviation = intersects_x(y, x, xt, position, radius, &xs0, &xs1);
                                 switch (deviation) {
@@ -832,15 +936,10 @@ namespace romi {
                                         if (y < position.y) alpha0 = 2.0 * M_PI - alpha0;
                                         dxt = xt - position.x;
                                         alpha1 = acosf(dxt / radius);
-                                        segments = 1 + (int)(6.0 * (alpha0 - alpha1) / M_PI);
-                                        d_alpha = (alpha0 - alpha1) / segments;
-                                        for (int i = 1; i <= segments; i++) {
-                                                float alpha = alpha0 - i * d_alpha;
-                                                y = position.y + radius * sinf(alpha);
-                                                x = position.x + radius * cosf(alpha);;
-//                                                path = path_append(path, x, y, z);
-                                                path.emplace_back(x, y, z);
-                                        }
+                                        append_arc(path, position, radius,
+                                                   alpha0, alpha1, tolerance, false);
+                                        x = path.back().x;
+                                        y = path.back().y;
                                         break;
                                 case INTERSECTS_BOTH_POINTS_INSIDE:
                                         r_warn("TODO: unhandled case: both points inside (at y0, moving right)!");
@@ -861,13 +960,12 @@ namespace romi {
 //                        pos = list_sort(pos, (compare_func_t) smallest_y_first);
                         std::sort( pos.begin( ), pos.end( ), [ ]( const point_t & lhs, const point_t & rhs )
                         {
-                            return smallest_y_first(lhs, rhs);
+                            return smallest_y_first(lhs, rhs) < 0;
                         });
 
 //                        for (list_t *l = pos; l != nullptr; l = list_next(l)) {
                         for (auto& position : pos) {
-                                float ys0, ys1, dy, alpha0, alpha1, d_alpha;
-                                int segments;
+                                float ys0, ys1, dy, alpha0, alpha1;
 //                                point_t *p = list_get(l, point_t);
                                 int deviation = intersects_y(x, y, y1, position, radius, &ys0, &ys1);
                                 switch (deviation) {
@@ -890,18 +988,9 @@ namespace romi {
                                                 if (position.x - radius < 0)
                                                         alpha1 += 2 * M_PI; 
                                         }
-                                        if (alpha1 > alpha0)
-                                                segments = (int) (1.0f + 6.0f * (alpha1 - alpha0) / M_PI);
-                                        else segments = (int) (1.0f + 6.0f * (alpha0 - alpha1) / M_PI);
-                                        d_alpha = (alpha1 - alpha0) / segments;
-                                        for (int i = 0; i <= segments; i++) {
-                                                float alpha = alpha0 + i * d_alpha;
-                                                float y_ = position.y + radius * sinf(alpha);
-                                                float x_ = position.x + radius * cosf(alpha);
-//                                                path = path_append(path, x_, y_, z);
-                                                path.emplace_back(x_, y_, z);
-                                                y = y_;
-                                        }
+                                        append_arc(path, position, radius,
+                                                   alpha0, alpha1, tolerance, true);
+                                        y = path.back().y;
                                 
                                         break;
                                 case INTERSECTS_FIRST_POINT_INSIDE:
@@ -928,17 +1017,10 @@ namespace romi {
                                                         if (alpha2 < alpha1)
                                                                 alpha1 = alpha2;
                                                 }
-                                                segments = (int) (1.0f + 6.0f * (alpha1 - alpha0) / M_PI);
-                                                r_warn("segments=%d", segments);
-
-                                                d_alpha = (alpha1 - alpha0) / segments;
-                                                for (int i = 0; i <= segments; i++) {
-                                                        float alpha = alpha0 + i * d_alpha;
-                                                        y = position.y + radius * sinf(alpha);
-                                                        x = position.x + radius * cosf(alpha);
-//                                                        path = path_append(path, x, y, z);
-                                                        path.emplace_back(x, y, z);
-                                                }
+                                                append_arc(path, position, radius,
+                                                           alpha0, alpha1, tolerance, true);
+                                                x = path.back().x;
+                                                y = path.back().y;
                                                 yt = y;
                                         
                                         }
@@ -964,13 +1046,12 @@ namespace romi {
 //                        pos = list_sort(pos, (compare_func_t) smallest_x_first);
                         std::sort( pos.begin( ), pos.end( ), [ ]( const point_t & lhs, const point_t & rhs )
                         {
-                            return smallest_x_first(lhs, rhs);
+                            return smallest_x_first(lhs, rhs) < 0;
                         });
 
 //                        for (list_t *l = pos; l != nullptr; l = list_next(l)) {
                         for (auto& position : pos) {
-                                float xs0, xs1, dxp, dxt, alpha0, alpha1, d_alpha;
-                                int segments;
+                                float xs0, xs1, dxp, dxt, alpha0, alpha1;
 //                                point_t *p = list_get(l, point_t);
                                 int deviation = intersects_x(y, x, xt, position, radius, &xs0, &xs1);
                                 switch (deviation) {
@@ -1004,15 +1085,10 @@ namespace romi {
                                         dxt = xt - position.x;
                                         alpha1 = acosf(dxt / radius);
                                         alpha1 = 2.0 * M_PI - alpha1; 
-                                        segments = 1 + (int)(6.0 * (alpha1 - alpha0) / M_PI);
-                                        d_alpha = (alpha1 - alpha0) / segments;
-                                        for (int i = 1; i <= segments; i++) {
-                                                float alpha = alpha0 + i * d_alpha;
-                                                y = position.y + radius * sinf(alpha);
-                                                x = position.x + radius * cosf(alpha);;
-//                                                path = path_append(path, x, y, z);
-                                                path.emplace_back(x, y, z);
-                                        }
+                                        append_arc(path, position, radius,
+                                                   alpha0, alpha1, tolerance, false);
+                                        x = path.back().x;
+                                        y = path.back().y;
 
                                         
                                         break;
@@ -22,22 +22,39 @@
 
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include "som/SOM.h"
 
 namespace romi {
 
-        SOM::SOM(nlohmann::json& params) : _alpha(0), _beta(0), _epsilon(0), _print(false)
+        SOM::SOM(nlohmann::json& params)
+                : _alpha(0), _beta(0), _epsilon(0), _print(false), _print_interval(25),
+                  _prune(false), _prune_cutoff(4.0), _threads(1), _pool(),
+                  _time_budget(0.0), _warm_start(false), _warm_start_k(0.02),
+                  _meters_to_pixels(0.0), _previous_paths(), _displaced(false)
         {
                 try {
                         _alpha = params.value("alpha", 0.2);
                         _beta = params.value("beta", 1.2);
                         _epsilon = params.value("epsilon", 0.01);
+                        _prune = params.value("prune", false);
+                        _prune_cutoff = params.value("prune-cutoff", 4.0);
+                        _threads = params.value("threads", (size_t) 1);
+                        _time_budget = params.value("time-budget", 0.0);
+                        _warm_start = params.value("warm-start", false);
+                        _warm_start_k = params.value("warm-start-k", 0.02);
 
                         if (params.contains("print"))
                                 _print = params["print"];
+                        _print_interval = params.value("print-interval", 25);
 
                         assert_settings();
+
+                        if (_threads == 0)
+                                _threads = ThreadPool::default_size();
+                        _pool = std::make_shared<ThreadPool>(_threads);
                         
                 } catch (nlohmann::json::exception& je) {
                         r_warn("SOM: invalid JSON");
@@ -49,14 +66,65 @@ namespace romi {
         {
                 if (_alpha < 0.01 || _alpha > 10.0
                     || _beta < 0.01 || _beta > 10.0
-                    || _epsilon < 0.0001 || _epsilon > 1.0) {
-                        r_warn("SOM: invalid settings: alpha %f, beta %f, epsilon %f",
-                               _alpha, _beta, _epsilon);
+                    || _epsilon < 0.0001 || _epsilon > 1.0
+                    || _prune_cutoff < 1.0 || _prune_cutoff > 10.0
+                    || _threads > kMaxThreads
+                    || _time_budget < 0.0 || _time_budget > 60000.0
+                    || _warm_start_k < 0.001 || _warm_start_k > 0.2
+                    || _print_interval < 1 || _print_interval > 1000) {
+                        r_warn("SOM: invalid settings: alpha %f, beta %f, epsilon %f, "
+                               "prune-cutoff %f, threads %zu, time-budget %f, "
+                               "warm-start-k %f, print-interval %d",
+                               _alpha, _beta, _epsilon, _prune_cutoff, _threads,
+                               _time_budget, _warm_start_k, _print_interval);
                         throw std::runtime_error("SOM: invalid settings");
                 }
         }
                 
+        /* Each call creates its own map. Only the previous paths
+         * of the warm start and the snapshots stored with print are
+         * shared between the calls. */
+        bool SOM::is_thread_safe()
+        {
+                return !_warm_start && !_print;
+        }
+        
+        /* With print set, the map samples its path every
+         * print-interval iterations and stores the snapshots in the
+         * session once it is done. Otherwise, the map runs without
+         * any tracing. */
         Path SOM::trace_path(ISession &session, Centers& centers, Image &mask)
+        {
+                int num_cities = static_cast<int>(centers.size());
+                int path_length = (int) (2.5 * num_cities);
+                
+                if (_print) {
+                        store_centers(session, centers, mask);
+                        SelfOrganizedMap<double, SampledTracer> som(num_cities, path_length,
+                                                                    _alpha, _beta, _epsilon,
+                                                                    _pool);
+                        int capacity = SelfOrganizedMap<double>::kMaxIterations / _print_interval + 1;
+                        som.tracer().set_sampling(_print_interval, (size_t) capacity);
+                        return run_map(session, som, centers, mask);
+                } else {
+                        SelfOrganizedMap<double> som(num_cities, path_length,
+                                                     _alpha, _beta, _epsilon, _pool);
+                        return run_map(session, som, centers, mask);
+                }
+        }
+
+        void SOM::store_centers(ISession &session, Centers& centers, Image &mask)
+        {
+                rcom::MemBuffer buffer;
+                for (auto& center : centers)
+                        buffer.printf("%f\t%f\n",
+                                      (double) center.first / (double) mask.width(),
+                                      (double) center.second / (double) mask.height());
+                session.store_txt("centres.txt", buffer.tostring());
+        }
+        
+        template <typename Map>
+        Path SOM::run_map(ISession &session, Map& som, Centers& centers, Image &mask)
         {
                 std::vector<double> cx;
                 std::vector<double> cy;
@@ -64,26 +132,121 @@ namespace romi {
                         cx.push_back((double) centers[i].first / (double) mask.width());
                         cy.push_back((double) centers[i].second / (double) mask.height());
                 }
-                        
-                {
-                        std::ofstream file;
-                        file.open("centres.txt");
-                        for (size_t i = 0; i < centers.size(); i++)
-                                file << cx[i] << "\t" << cy[i] << std::endl;
-                        file.close();
-                }
                 
-                SelfOrganizedMap<double> som(static_cast<int>(centers.size()),
-                                             (int) (2.5 * static_cast<int>(centers.size())),
-                                             _alpha, _beta, _epsilon);
-                        
                 som.init_cities(&cx[0], &cy[0]);
-                som.make_circle(0.1);
-                som.compute_path(session, _print);
+                som.set_pruning(_prune, _prune_cutoff);
+
+                auto previous = _previous_paths.end();
+                if (_warm_start)
+                        previous = find_previous_path(centers);
+                
+                if (previous != _previous_paths.end()) {
+                        std::vector<double> px;
+                        std::vector<double> py;
+                        for (auto& p : *previous) {
+                                px.push_back(p.x() / (double) mask.width());
+                                py.push_back(p.y() / (double) mask.height());
+                        }
+                        som.resample_path(&px[0], &py[0], static_cast<int>(px.size()));
+                        som.set_initial_k(_warm_start_k);
+                } else {
+                        som.make_circle(0.1);
+                }
+                
+                som.compute_path(session, _time_budget);
 
                 Path path;
                 som.get_path(path, (double) mask.width(), (double) mask.height());
+
+                if (_warm_start)
+                        store_path(path, previous);
                 
                 return path;
         }
+
+        /* Returns the previous path whose bounding box contains the
+         * centroid of the centers and whose own centroid is the
+         * closest. */
+        std::vector<Path>::iterator SOM::find_previous_path(Centers& centers)
+        {
+                double x = 0.0;
+                double y = 0.0;
+                for (auto& center : centers) {
+                        x += center.first;
+                        y += center.second;
+                }
+                x /= (double) centers.size();
+                y /= (double) centers.size();
+                
+                auto best = _previous_paths.end();
+                double best_distance = 0.0;
+                for (auto it = _previous_paths.begin(); it != _previous_paths.end(); it++) {
+                        double xmin = it->front().x();
+                        double xmax = xmin;
+                        double ymin = it->front().y();
+                        double ymax = ymin;
+                        double px = 0.0;
+                        double py = 0.0;
+                        for (auto& p : *it) {
+                                xmin = std::min(xmin, p.x());
+                                xmax = std::max(xmax, p.x());
+                                ymin = std::min(ymin, p.y());
+                                ymax = std::max(ymax, p.y());
+                                px += p.x();
+                                py += p.y();
+                        }
+                        if (x < xmin || x > xmax || y < ymin || y > ymax)
+                                continue;
+                        
+                        px /= (double) it->size();
+                        py /= (double) it->size();
+                        double distance = std::hypot(px - x, py - y);
+                        if (best == _previous_paths.end() || distance < best_distance) {
+                                best = it;
+                                best_distance = distance;
+                        }
+                }
+                return best;
+        }
+
+        /* The new path replaces the one it started from. The oldest
+         * paths are dropped. */
+        void SOM::store_path(Path& path, std::vector<Path>::iterator previous)
+        {
+                if (previous != _previous_paths.end())
+                        _previous_paths.erase(previous);
+                if (_previous_paths.size() >= kMaxPreviousPaths)
+                        _previous_paths.erase(_previous_paths.begin());
+                if (!path.empty())
+                        _previous_paths.push_back(path);
+        }
+
+        /* The pipeline sets the scale once per image. Without the
+         * displacement of the field since the previous image, the
+         * previous paths are no longer where the plants are. */
+        void SOM::set_scale(double meters_to_pixels, double tool_diameter)
+        {
+                (void) tool_diameter;
+                _meters_to_pixels = meters_to_pixels;
+                if (!_displaced)
+                        _previous_paths.clear();
+                _displaced = false;
+        }
+
+        /* Moves the previous paths along with the field. */
+        void SOM::set_displacement(double dx, double dy)
+        {
+                if (_meters_to_pixels <= 0.0) {
+                        _previous_paths.clear();
+                        return;
+                }
+                
+                _displaced = true;
+                double dx_pixels = dx * _meters_to_pixels;
+                double dy_pixels = dy * _meters_to_pixels;
+                for (auto& path : _previous_paths) {
+                        for (auto& p : path)
+                                p = v3(p.x() + dx_pixels, p.y() + dy_pixels, p.z());
+                }
+        }
 }
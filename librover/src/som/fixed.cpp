@@ -12,7 +12,6 @@ static void fx_init_reciptab()
                 fixed_t a = (i << (FIXED_FBITS - 8));
                 double x = fxtod(a);
                 double recip = 1.0 / x;
-                r_debug("fx_init_reciptab: x=%f, 1/x=%f", x, recip);
                 fixed_t b = dtofx(recip); 
                 fx_reciptab[i] = b;
         }
@@ -0,0 +1,130 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#include <chrono>
+#include <util/Logger.h>
+#include "tsp/TSP.h"
+#include "tsp/TourOptimizer.h"
+
+namespace romi {
+
+        TSP::TSP(nlohmann::json& params)
+                : time_budget_(50.0),
+                  neighbours_(10),
+                  construction_(kGreedy),
+                  threads_(1),
+                  pool_(),
+                  distances_()
+        {
+                try {
+                        time_budget_ = params.value("time-budget", 50.0);
+                        neighbours_ = params.value("neighbours", (size_t) 10);
+                        construction_ = params.value("construction", std::string(kGreedy));
+                        threads_ = params.value("threads", (size_t) 1);
+
+                        assert_settings();
+
+                        if (threads_ == 0)
+                                threads_ = ThreadPool::default_size();
+                        pool_ = std::make_shared<ThreadPool>(threads_);
+                        
+                } catch (nlohmann::json::exception& je) {
+                        r_warn("TSP: invalid JSON");
+                        throw std::runtime_error("TSP: invalid JSON");
+                }
+        }
+
+        void TSP::assert_settings()
+        {
+                if (time_budget_ < 0.0 || time_budget_ > 60000.0
+                    || neighbours_ < 2 || neighbours_ > 50
+                    || (construction_ != kGreedy && construction_ != kHilbert)
+                    || threads_ > kMaxThreads) {
+                        r_warn("TSP: invalid settings: time-budget %f, neighbours %zu, "
+                               "construction %s, threads %zu",
+                               time_budget_, neighbours_, construction_.c_str(), threads_);
+                        throw std::runtime_error("TSP: invalid settings");
+                }
+        }
+
+        void TSP::set_distance_transform(std::shared_ptr<DistanceTransform> distances)
+        {
+                distances_ = distances;
+        }
+        
+        bool TSP::is_thread_safe()
+        {
+                return true;
+        }
+        
+        Path TSP::trace_path(ISession &session, Centers& centers, Image &mask)
+        {
+                (void) session;
+                
+                auto start = std::chrono::steady_clock::now();
+                
+                Path points;
+                for (auto& center : centers)
+                        points.push_back(v3((double) center.first,
+                                            (double) center.second, 0.0));
+                if (points.size() < 2)
+                        return points;
+                
+                std::shared_ptr<DistanceTransform> distances = distances_;
+                if (!distances
+                    || distances->width() != mask.width()
+                    || distances->height() != mask.height()) {
+                        distances = std::make_shared<DistanceTransform>(mask, pool_);
+                }
+                
+                DistanceMatrix matrix(points.size());
+                matrix.fill(*pool_, [&](size_t i, size_t j) {
+                                return DistanceMatrix::segment_cost(points[i], points[j],
+                                                                    *distances);
+                        });
+                
+                TourOptimizer optimizer(matrix, neighbours_, *pool_);
+                if (construction_ == kHilbert)
+                        optimizer.construct_hilbert(points);
+                else
+                        optimizer.construct_greedy();
+
+                // The budget covers the whole computation
+                std::chrono::duration<double, std::milli> elapsed
+                        = std::chrono::steady_clock::now() - start;
+                double budget = 0.0;
+                if (time_budget_ > 0.0)
+                        budget = std::max(time_budget_ - elapsed.count(), 1.0);
+                if (!optimizer.improve(budget))
+                        r_warn("TSP: the time budget ran out before a local optimum");
+                
+                Path path;
+                for (size_t node : optimizer.tour())
+                        path.push_back(points[node]);
+
+                elapsed = std::chrono::steady_clock::now() - start;
+                r_info("TSP: %zu nodes, %.1f ms, length %ld",
+                       points.size(), elapsed.count(), (long) optimizer.length());
+                return path;
+        }
+}
@@ -0,0 +1,497 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#include <algorithm>
+#include <limits>
+#include <random>
+#include "tsp/TourOptimizer.h"
+
+namespace romi {
+
+        static const size_t kNone = std::numeric_limits<size_t>::max();
+        
+        TourOptimizer::TourOptimizer(const DistanceMatrix& distances, size_t k,
+                                     ThreadPool& pool)
+                : distances_(distances),
+                  size_(distances.size()),
+                  k_(std::min(k, (distances.size() > 0)? distances.size() - 1 : 0)),
+                  neighbours_(),
+                  tour_(),
+                  position_(distances.size(), 0),
+                  queue_(),
+                  queued_(distances.size(), false),
+                  random_(1)
+        {
+                compute_neighbours(pool);
+                
+                std::vector<size_t> order(size_);
+                for (size_t i = 0; i < size_; i++)
+                        order[i] = i;
+                set_tour(order);
+        }
+
+        void TourOptimizer::compute_neighbours(ThreadPool& pool)
+        {
+                neighbours_.resize(size_ * k_);
+                if (k_ == 0)
+                        return;
+                
+                pool.parallel_for(size_, [&](size_t chunk, size_t begin, size_t end) {
+                                (void) chunk;
+                                std::vector<size_t> candidates;
+                                for (size_t i = begin; i < end; i++) {
+                                        candidates.clear();
+                                        for (size_t j = 0; j < size_; j++) {
+                                                if (j != i)
+                                                        candidates.push_back(j);
+                                        }
+                                        auto closer = [&](size_t a, size_t b) {
+                                                int64_t da = d(i, a);
+                                                int64_t db = d(i, b);
+                                                return da < db || (da == db && a < b);
+                                        };
+                                        std::partial_sort(candidates.begin(),
+                                                          candidates.begin() + (long) k_,
+                                                          candidates.end(), closer);
+                                        std::copy(candidates.begin(),
+                                                  candidates.begin() + (long) k_,
+                                                  neighbours_.begin() + (long) (i * k_));
+                                }
+                        });
+        }
+
+        void TourOptimizer::set_tour(const std::vector<size_t>& order)
+        {
+                tour_ = order;
+                queue_.clear();
+                std::fill(queued_.begin(), queued_.end(), false);
+                for (size_t i = 0; i < size_; i++) {
+                        position_[tour_[i]] = i;
+                        push(tour_[i]);
+                }
+        }
+        
+        void TourOptimizer::push(size_t node)
+        {
+                if (!queued_[node]) {
+                        queued_[node] = true;
+                        queue_.push_back(node);
+                }
+        }
+
+        /* Greedy edge matching: the shortest candidate edges are
+         * taken first, as long as no node gets more than two edges
+         * and no cycle is closed. The fragments that are left are
+         * then chained, each one to the nearest free end. */
+        void TourOptimizer::construct_greedy()
+        {
+                if (size_ < 4)
+                        return;
+                
+                std::vector<std::pair<int64_t, std::pair<size_t, size_t>>> edges;
+                for (size_t i = 0; i < size_; i++) {
+                        for (size_t k = 0; k < k_; k++) {
+                                size_t j = neighbours(i)[k];
+                                if (i < j)
+                                        edges.push_back({ d(i, j), { i, j } });
+                        }
+                }
+                std::sort(edges.begin(), edges.end());
+
+                std::vector<size_t> links(2 * size_, kNone);
+                std::vector<size_t> degree(size_, 0);
+                std::vector<size_t> root(size_);
+                for (size_t i = 0; i < size_; i++)
+                        root[i] = i;
+                auto find = [&](size_t i) {
+                        while (root[i] != i) {
+                                root[i] = root[root[i]];
+                                i = root[i];
+                        }
+                        return i;
+                };
+                
+                for (auto& edge : edges) {
+                        size_t i = edge.second.first;
+                        size_t j = edge.second.second;
+                        if (degree[i] < 2 && degree[j] < 2 && find(i) != find(j)) {
+                                links[2 * i + degree[i]++] = j;
+                                links[2 * j + degree[j]++] = i;
+                                root[find(i)] = find(j);
+                        }
+                }
+
+                std::vector<size_t> ends;
+                for (size_t i = 0; i < size_; i++) {
+                        if (degree[i] < 2)
+                                ends.push_back(i);
+                }
+
+                std::vector<bool> visited(size_, false);
+                std::vector<size_t> order;
+                size_t current = ends.empty()? 0 : ends[0];
+                
+                while (current != kNone) {
+                        size_t previous = kNone;
+                        while (current != kNone) {
+                                order.push_back(current);
+                                visited[current] = true;
+                                size_t following = kNone;
+                                for (size_t k = 0; k < 2; k++) {
+                                        size_t j = links[2 * current + k];
+                                        if (j != kNone && j != previous && !visited[j])
+                                                following = j;
+                                }
+                                previous = current;
+                                current = following;
+                        }
+
+                        int64_t best = 0;
+                        for (size_t end : ends) {
+                                if (!visited[end]
+                                    && (current == kNone || d(previous, end) < best)) {
+                                        current = end;
+                                        best = d(previous, end);
+                                }
+                        }
+                }
+                
+                set_tour(order);
+        }
+
+        static uint64_t hilbert_index(uint32_t x, uint32_t y)
+        {
+                uint64_t index = 0;
+                for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+                        uint32_t rx = (x & s) > 0;
+                        uint32_t ry = (y & s) > 0;
+                        index += (uint64_t) s * s * ((3 * rx) ^ ry);
+                        if (ry == 0) {
+                                if (rx == 1) {
+                                        x = s - 1 - (x & (s - 1));
+                                        y = s - 1 - (y & (s - 1));
+                                }
+                                std::swap(x, y);
+                        }
+                        x &= s - 1;
+                        y &= s - 1;
+                }
+                return index;
+        }
+        
+        /* Visits the nodes in the order of a Hilbert curve through
+         * their bounding box. Fast, and within about 25% of the
+         * optimum, which the local search then recovers. */
+        void TourOptimizer::construct_hilbert(const Path& points)
+        {
+                if (size_ < 4 || points.size() != size_)
+                        return;
+                
+                double xmin = points[0].x();
+                double xmax = xmin;
+                double ymin = points[0].y();
+                double ymax = ymin;
+                for (auto& p : points) {
+                        xmin = std::min(xmin, p.x());
+                        xmax = std::max(xmax, p.x());
+                        ymin = std::min(ymin, p.y());
+                        ymax = std::max(ymax, p.y());
+                }
+                double scale = 65535.0 / std::max(std::max(xmax - xmin, ymax - ymin), 1.0);
+
+                std::vector<std::pair<uint64_t, size_t>> keys(size_);
+                for (size_t i = 0; i < size_; i++) {
+                        auto x = (uint32_t) ((points[i].x() - xmin) * scale);
+                        auto y = (uint32_t) ((points[i].y() - ymin) * scale);
+                        keys[i] = { hilbert_index(x, y), i };
+                }
+                std::sort(keys.begin(), keys.end());
+
+                std::vector<size_t> order(size_);
+                for (size_t i = 0; i < size_; i++)
+                        order[i] = keys[i].second;
+                set_tour(order);
+        }
+
+        /* Reverses the part of the tour that goes from node 'from'
+         * to node 'to'. For a closed tour, reversing the rest of the
+         * tour gives the same edges, so the shorter part is
+         * reversed. */
+        void TourOptimizer::reverse(size_t from, size_t to)
+        {
+                size_t i = position_[from];
+                size_t j = position_[to];
+                size_t length = (j + size_ - i) % size_ + 1;
+                
+                if (2 * length > size_) {
+                        size_t first = (j + 1) % size_;
+                        j = (i + size_ - 1) % size_;
+                        i = first;
+                        length = size_ - length;
+                }
+                
+                for (size_t s = 0; s < length / 2; s++) {
+                        std::swap(tour_[i], tour_[j]);
+                        position_[tour_[i]] = i;
+                        position_[tour_[j]] = j;
+                        i = (i + 1 == size_)? 0 : i + 1;
+                        j = (j == 0)? size_ - 1 : j - 1;
+                }
+        }
+
+        /* Replaces the edges (a, b) and (c, e) by (a, c) and (b, e),
+         * where b and e are on the same side of a and c. */
+        bool TourOptimizer::try_2opt(size_t a)
+        {
+                for (int forward = 1; forward >= 0; forward--) {
+                        size_t b = forward? next(a) : prev(a);
+                        int64_t dab = d(a, b);
+                        const size_t *nearest = neighbours(a);
+                        
+                        for (size_t k = 0; k < k_; k++) {
+                                size_t c = nearest[k];
+                                int64_t dac = d(a, c);
+                                if (dac >= dab)
+                                        break;
+                                size_t e = forward? next(c) : prev(c);
+                                if (c == b || e == a)
+                                        continue;
+                                
+                                int64_t delta = dac + d(b, e) - dab - d(c, e);
+                                if (delta < 0) {
+                                        if (forward)
+                                                reverse(b, c);
+                                        else
+                                                reverse(a, e);
+                                        push(a);
+                                        push(b);
+                                        push(c);
+                                        push(e);
+                                        return true;
+                                }
+                        }
+                }
+                return false;
+        }
+
+        /* Moves a segment of up to kMaxSegment nodes, that starts or
+         * ends at a, next to one of the neighbours of its ends,
+         * possibly reversed. */
+        bool TourOptimizer::try_or_opt(size_t a)
+        {
+                for (size_t length = 1; length <= kMaxSegment; length++) {
+                        if (size_ < length + 3)
+                                break;
+                        for (int side = 0; side < 2; side++) {
+                                if (side == 1 && length == 1)
+                                        break;
+                                
+                                size_t first = a;
+                                size_t last = a;
+                                for (size_t i = 1; i < length; i++) {
+                                        if (side == 0)
+                                                last = next(last);
+                                        else
+                                                first = prev(first);
+                                }
+                                
+                                size_t p = prev(first);
+                                size_t n = next(last);
+                                int64_t gain = d(p, first) + d(last, n) - d(p, n);
+                                if (gain <= 0)
+                                        continue;
+
+                                auto in_segment = [&](size_t node) {
+                                        for (size_t i = first; ; i = next(i)) {
+                                                if (i == node)
+                                                        return true;
+                                                if (i == last)
+                                                        return false;
+                                        }
+                                };
+                                
+                                for (size_t end : { first, last }) {
+                                        size_t other = (end == first)? last : first;
+                                        const size_t *nearest = neighbours(end);
+                                        for (size_t k = 0; k < k_; k++) {
+                                                size_t c = nearest[k];
+                                                if (d(end, c) >= gain)
+                                                        break;
+                                                if (in_segment(c))
+                                                        continue;
+                                                for (size_t e : { next(c), prev(c) }) {
+                                                        if (in_segment(e))
+                                                                continue;
+                                                        int64_t cost = d(c, end) + d(other, e) - d(c, e);
+                                                        if (cost >= gain)
+                                                                continue;
+                                                        
+                                                        if (e == next(c))
+                                                                move_segment(first, last, c, end != first);
+                                                        else
+                                                                move_segment(first, last, e, end != last);
+                                                        push(p);
+                                                        push(n);
+                                                        push(first);
+                                                        push(last);
+                                                        push(c);
+                                                        push(e);
+                                                        return true;
+                                                }
+                                        }
+                                }
+                        }
+                }
+                return false;
+        }
+
+        /* Moves the segment first..last right after the node
+         * 'after', reversed or not. */
+        void TourOptimizer::move_segment(size_t first, size_t last, size_t after,
+                                         bool reversed)
+        {
+                std::vector<size_t> segment;
+                for (size_t i = first; ; i = next(i)) {
+                        segment.push_back(i);
+                        if (i == last)
+                                break;
+                }
+                if (reversed)
+                        std::reverse(segment.begin(), segment.end());
+
+                std::vector<size_t> order;
+                order.reserve(size_);
+                for (size_t i = next(last); i != first; i = next(i)) {
+                        order.push_back(i);
+                        if (i == after)
+                                order.insert(order.end(), segment.begin(), segment.end());
+                }
+                
+                tour_ = order;
+                for (size_t i = 0; i < size_; i++)
+                        position_[tour_[i]] = i;
+        }
+        
+        bool TourOptimizer::local_search(Clock::time_point deadline, bool limited)
+        {
+                while (!queue_.empty()) {
+                        if (limited && Clock::now() > deadline)
+                                return false;
+                        
+                        size_t a = queue_.front();
+                        queue_.pop_front();
+                        queued_[a] = false;
+
+                        // A successful move puts a back in the queue
+                        if (!try_2opt(a))
+                                try_or_opt(a);
+                }
+                return true;
+        }
+
+        /* A double bridge between nearby positions: the two
+         * consecutive segments that follow a random position are
+         * swapped. The 2-opt and Or-opt moves can't undo it in one
+         * step. */
+        void TourOptimizer::kick()
+        {
+                size_t window = std::min(kKickWindow, (size_ - 1) / 3);
+                std::uniform_int_distribution<size_t> start(0, size_ - 1);
+                std::uniform_int_distribution<size_t> length(1, window);
+
+                // Rotate the tour so that the kick doesn't wrap around
+                size_t first = start(random_);
+                std::rotate(tour_.begin(), tour_.begin() + (long) first, tour_.end());
+                
+                size_t middle = 1 + length(random_);
+                size_t last = middle + length(random_);
+                std::rotate(tour_.begin() + 1, tour_.begin() + (long) middle,
+                            tour_.begin() + (long) last);
+                
+                for (size_t i = 0; i < size_; i++)
+                        position_[tour_[i]] = i;
+                
+                // The ends of the three new edges
+                push(tour_[0]);
+                push(tour_[1]);
+                push(tour_[last - middle]);
+                push(tour_[last - middle + 1]);
+                push(tour_[last - 1]);
+                push(tour_[last]);
+        }
+        
+        bool TourOptimizer::improve(double time_budget)
+        {
+                if (size_ < 4)
+                        return true;
+
+                bool limited = (time_budget > 0.0);
+                auto deadline = Clock::now() + std::chrono::microseconds(
+                        (int64_t) (time_budget * 1000.0));
+                
+                if (!local_search(deadline, limited))
+                        return false;
+                if (!limited || size_ < 8)
+                        return true;
+
+                // Iterated local search: the rest of the budget is
+                // spent on kicks, keeping the shorter tours only
+                std::vector<size_t> best = tour_;
+                int64_t best_length = length();
+                
+                while (Clock::now() < deadline) {
+                        kick();
+                        local_search(deadline, limited);
+                        int64_t new_length = length();
+                        if (new_length < best_length) {
+                                best = tour_;
+                                best_length = new_length;
+                        } else {
+                                tour_ = best;
+                        }
+                }
+                
+                for (size_t i = 0; i < size_; i++)
+                        position_[tour_[i]] = i;
+                queue_.clear();
+                std::fill(queued_.begin(), queued_.end(), false);
+                return true;
+        }
+
+        int64_t TourOptimizer::length() const
+        {
+                int64_t sum = 0;
+                for (size_t i = 0; i < size_; i++)
+                        sum += d(tour_[i], tour_[(i + 1) % size_]);
+                return sum;
+        }
+
+        std::vector<size_t> TourOptimizer::tour() const
+        {
+                std::vector<size_t> result(size_);
+                size_t offset = (size_ > 0)? position_[0] : 0;
+                for (size_t i = 0; i < size_; i++)
+                        result[i] = tour_[(offset + i) % size_];
+                return result;
+        }
+}
@@ -0,0 +1,223 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "weeder/DistanceTransform.h"
+
+namespace romi {
+
+        static const double kInfinity = 1e20;
+
+        static inline double intersection(const std::vector<double>& f,
+                                          size_t p, size_t q)
+        {
+                double dp = (double) p;
+                double dq = (double) q;
+                return ((f[q] + dq * dq) - (f[p] + dp * dp)) / (2.0 * (dq - dp));
+        }
+
+        /* The lower envelope of the parabolas rooted at (q, f[q]),
+         * see Felzenszwalb and Huttenlocher, Distance Transforms of
+         * Sampled Functions, 2012. f and d are squared distances. */
+        static void transform_1d(const std::vector<double>& f, std::vector<double>& d,
+                                 std::vector<size_t>& v, std::vector<double>& z)
+        {
+                size_t n = f.size();
+                size_t k = 0;
+                
+                v[0] = 0;
+                z[0] = -std::numeric_limits<double>::infinity();
+                z[1] = std::numeric_limits<double>::infinity();
+                
+                for (size_t q = 1; q < n; q++) {
+                        double s = intersection(f, v[k], q);
+                        while (s <= z[k]) {
+                                k--;
+                                s = intersection(f, v[k], q);
+                        }
+                        k++;
+                        v[k] = q;
+                        z[k] = s;
+                        z[k + 1] = std::numeric_limits<double>::infinity();
+                }
+
+                k = 0;
+                for (size_t q = 0; q < n; q++) {
+                        while (z[k + 1] < (double) q)
+                                k++;
+                        double dq = (double) q - (double) v[k];
+                        d[q] = dq * dq + f[v[k]];
+                }
+        }
+        
+        DistanceTransform::DistanceTransform(const Image& mask,
+                                             std::shared_ptr<ThreadPool> pool)
+                : width_(mask.width()),
+                  height_(mask.height()),
+                  distance_(mask.width() * mask.height(), 0.0f)
+        {
+                if (!pool)
+                        pool = std::make_shared<ThreadPool>(1);
+
+                pool->parallel_for(width_, [&](size_t chunk, size_t begin, size_t end) {
+                                (void) chunk;
+                                transform_columns(mask, begin, end);
+                        });
+                pool->parallel_for(height_, [&](size_t chunk, size_t begin, size_t end) {
+                                (void) chunk;
+                                transform_rows(begin, end);
+                        });
+        }
+
+        void DistanceTransform::transform_columns(const Image& mask,
+                                                  size_t begin, size_t end)
+        {
+                const std::vector<float>& data = mask.data();
+                std::vector<double> f(height_);
+                std::vector<double> d(height_);
+                std::vector<size_t> v(height_);
+                std::vector<double> z(height_ + 1);
+                
+                for (size_t x = begin; x < end; x++) {
+                        for (size_t y = 0; y < height_; y++)
+                                f[y] = (data[y * width_ + x] > 0.0f)? 0.0 : kInfinity;
+                        transform_1d(f, d, v, z);
+                        for (size_t y = 0; y < height_; y++)
+                                distance_[y * width_ + x] = (float) d[y];
+                }
+        }
+
+        void DistanceTransform::transform_rows(size_t begin, size_t end)
+        {
+                std::vector<double> f(width_);
+                std::vector<double> d(width_);
+                std::vector<size_t> v(width_);
+                std::vector<double> z(width_ + 1);
+                
+                for (size_t y = begin; y < end; y++) {
+                        float *row = &distance_[y * width_];
+                        for (size_t x = 0; x < width_; x++)
+                                f[x] = row[x];
+                        transform_1d(f, d, v, z);
+                        for (size_t x = 0; x < width_; x++)
+                                row[x] = (float) std::sqrt(d[x]);
+                }
+        }
+
+        size_t DistanceTransform::width() const
+        {
+                return width_;
+        }
+        
+        size_t DistanceTransform::height() const
+        {
+                return height_;
+        }
+
+        double DistanceTransform::distance(size_t x, size_t y) const
+        {
+                if (distance_.empty())
+                        return kInfinity;
+                x = std::min(x, width_ - 1);
+                y = std::min(y, height_ - 1);
+                return (double) distance_[y * width_ + x];
+        }
+
+        double DistanceTransform::distance(double x, double y) const
+        {
+                return distance((size_t) std::max(x, 0.0), (size_t) std::max(y, 0.0));
+        }
+        
+        bool DistanceTransform::is_clear(v3 p, double radius) const
+        {
+                return distance(p.x(), p.y()) > radius;
+        }
+
+        /* The distance along a ray from (x, y) to the border of
+         * the pixel that contains the point. */
+        static double distance_to_next_pixel(double x, double y, double ux, double uy)
+        {
+                static const double kEpsilon = 1e-6;
+                double tx = std::numeric_limits<double>::infinity();
+                double ty = std::numeric_limits<double>::infinity();
+                if (ux > 0.0)
+                        tx = (std::floor(x) + 1.0 - x) / ux;
+                else if (ux < 0.0)
+                        tx = (x - std::floor(x)) / -ux;
+                if (uy > 0.0)
+                        ty = (std::floor(y) + 1.0 - y) / uy;
+                else if (uy < 0.0)
+                        ty = (y - std::floor(y)) / -uy;
+                return std::min(tx, ty) + kEpsilon;
+        }
+
+        bool DistanceTransform::segment_is_clear(v3 p0, v3 p1, double radius) const
+        {
+                // A point is tested at the pixel that contains it,
+                // and the distance is known at the corner (x, y) of
+                // that pixel. Two points in pixels whose corners are
+                // D apart are at least D - sqrt(2) apart, so a step
+                // of the clearance minus sqrt(2) can't jump over a
+                // pixel that is within the radius of a plant. The
+                // margin is rounded up to 1.5 pixels. Closer to the
+                // plants, the walk moves on to the next pixel along
+                // the segment, so that none is skipped.
+                static const double kMargin = 1.5;
+                
+                double dx = p1.x() - p0.x();
+                double dy = p1.y() - p0.y();
+                double length = std::hypot(dx, dy);
+                double t = 0.0;
+
+                while (t < length) {
+                        double x = p0.x() + t * dx / length;
+                        double y = p0.y() + t * dy / length;
+                        double clearance = distance(x, y) - radius;
+                        if (clearance <= 0.0)
+                                return false;
+                        t += std::max(clearance - kMargin,
+                                      distance_to_next_pixel(x, y, dx / length,
+                                                             dy / length));
+                }
+                return is_clear(p1, radius);
+        }
+
+        double DistanceTransform::segment_clearance(v3 p0, v3 p1) const
+        {
+                double dx = p1.x() - p0.x();
+                double dy = p1.y() - p0.y();
+                double length = std::hypot(dx, dy);
+                double t = 0.0;
+                double clearance = distance(p1.x(), p1.y());
+
+                while (t < length) {
+                        double x = p0.x() + t * dx / length;
+                        double y = p0.y() + t * dy / length;
+                        clearance = std::min(clearance, distance(x, y));
+                        t += distance_to_next_pixel(x, y, dx / length, dy / length);
+                }
+                return clearance;
+        }
+}
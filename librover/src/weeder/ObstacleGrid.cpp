@@ -0,0 +1,115 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+#include <algorithm>
+#include "weeder/ObstacleGrid.h"
+
+namespace romi {
+
+        ObstacleGrid::ObstacleGrid(Image& mask, size_t resolution, bool jump_points)
+                : mask_(mask),
+                  resolution_(resolution),
+                  width_(mask.width() / resolution),
+                  height_(mask.height() / resolution),
+                  jump_points_(jump_points),
+                  initialized_(false),
+                  occupied_(),
+                  generator_()
+        {
+        }
+
+        void ObstacleGrid::init()
+        {
+                size_t w = mask_.width();
+                const float *data = mask_.data().data();
+                std::vector<double> sums(width_);
+                
+                occupied_.assign(width_ * height_, 0);
+                
+                for (size_t cy = 0; cy < height_; cy++) {
+                        std::fill(sums.begin(), sums.end(), 0.0);
+                        for (size_t y = cy * resolution_; y < (cy + 1) * resolution_; y++) {
+                                const float *row = data + y * w;
+                                for (size_t cx = 0; cx < width_; cx++) {
+                                        const float *p = row + cx * resolution_;
+                                        double sum = 0.0;
+                                        for (size_t i = 0; i < resolution_; i++)
+                                                sum += p[i];
+                                        sums[cx] += sum;
+                                }
+                        }
+                        for (size_t cx = 0; cx < width_; cx++)
+                                occupied_[cy * width_ + cx] = (sums[cx] > 0.0);
+                }
+
+                generator_.setWorldSize({ (int) width_, (int) height_ });
+                // The octagonal distance is the cost of the
+                // shortest path without obstacles, so it never
+                // overestimates and the detours are optimal.
+                generator_.setHeuristic(AStar::Heuristic::octagonal);
+                generator_.setDiagonalMovement(true);
+                generator_.setJumpPointSearch(jump_points_);
+                for (size_t cy = 0; cy < height_; cy++) {
+                        for (size_t cx = 0; cx < width_; cx++) {
+                                if (occupied_[cy * width_ + cx])
+                                        generator_.addCollision({ (int) cx, (int) cy });
+                        }
+                }
+                
+                initialized_ = true;
+        }
+
+        AStar::Generator& ObstacleGrid::generator()
+        {
+                if (!initialized_)
+                        init();
+                return generator_;
+        }
+
+        bool ObstacleGrid::is_occupied(size_t x, size_t y)
+        {
+                if (!initialized_)
+                        init();
+                return x < width_ && y < height_ && occupied_[y * width_ + x];
+        }
+
+        bool ObstacleGrid::is_initialized()
+        {
+                return initialized_;
+        }
+
+        void ObstacleGrid::store(ISession& session, const std::string& name)
+        {
+                Image image(Image::BW, width_ * resolution_, height_ * resolution_);
+                std::vector<float>& data = image.data();
+                size_t w = image.width();
+                
+                for (size_t y = 0; y < image.height(); y++) {
+                        for (size_t x = 0; x < w; x++) {
+                                if (is_occupied(x / resolution_, y / resolution_))
+                                        data[y * w + x] = 1.0f;
+                        }
+                }
+                session.store_png(name, image);
+        }
+}
@@ -0,0 +1,299 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "weeder/PathOrdering.h"
+
+namespace romi {
+
+        static const double kEpsilon = 1e-9;
+        
+        PathOrdering::PathOrdering(v3 home)
+                : home_(home)
+        {
+        }
+
+        double PathOrdering::distance(v3 a, v3 b)
+        {
+                return std::hypot(a.x() - b.x(), a.y() - b.y());
+        }
+
+        v3 PathOrdering::entry(const Path& path, bool reversed)
+        {
+                return reversed? path.back() : path.front();
+        }
+
+        v3 PathOrdering::exit(const Path& path, bool reversed)
+        {
+                return reversed? path.front() : path.back();
+        }
+
+        void PathOrdering::order(std::vector<Path>& paths) const
+        {
+                paths.erase(std::remove_if(paths.begin(), paths.end(),
+                                           [](const Path& path) {
+                                                   return path.empty();
+                                           }),
+                            paths.end());
+                if (paths.size() < 2)
+                        return;
+                
+                std::vector<Leg> legs;
+                if (paths.size() <= kMaxExact) {
+                        legs = solve_exact(paths);
+                } else {
+                        legs = solve_greedy(paths);
+                        improve(paths, legs);
+                }
+
+                std::vector<Path> ordered;
+                for (auto& leg : legs) {
+                        ordered.emplace_back(std::move(paths[leg.path]));
+                        if (leg.reversed)
+                                std::reverse(ordered.back().begin(), ordered.back().end());
+                }
+                paths = std::move(ordered);
+        }
+
+        double PathOrdering::transfer_length(const std::vector<Path>& paths) const
+        {
+                double length = 0.0;
+                v3 position = home_;
+                for (auto& path : paths) {
+                        if (!path.empty()) {
+                                length += distance(position, path.front());
+                                position = path.back();
+                        }
+                }
+                return length + distance(position, home_);
+        }
+
+        /* Held-Karp over the subsets of paths. A state is a path
+         * together with its direction, s = 2 * path + reversed, and
+         * cost[subset][s] is the shortest lifted travel that visits
+         * the paths of the subset and ends with state s. */
+        std::vector<PathOrdering::Leg>
+        PathOrdering::solve_exact(const std::vector<Path>& paths) const
+        {
+                static const size_t kNone = std::numeric_limits<size_t>::max();
+                size_t n = paths.size();
+                size_t states = 2 * n;
+                size_t subsets = (size_t) 1 << n;
+                std::vector<double> cost(subsets * states,
+                                         std::numeric_limits<double>::infinity());
+                std::vector<size_t> previous(subsets * states, kNone);
+
+                for (size_t s = 0; s < states; s++) {
+                        size_t subset = (size_t) 1 << (s / 2);
+                        cost[subset * states + s] = distance(home_,
+                                                             entry(paths[s / 2], s % 2));
+                }
+
+                for (size_t subset = 1; subset < subsets; subset++) {
+                        for (size_t s = 0; s < states; s++) {
+                                double c = cost[subset * states + s];
+                                if (std::isinf(c))
+                                        continue;
+                                v3 from = exit(paths[s / 2], s % 2);
+                                for (size_t t = 0; t < states; t++) {
+                                        size_t bit = (size_t) 1 << (t / 2);
+                                        if (subset & bit)
+                                                continue;
+                                        size_t index = (subset | bit) * states + t;
+                                        double d = c + distance(from, entry(paths[t / 2], t % 2));
+                                        if (d < cost[index]) {
+                                                cost[index] = d;
+                                                previous[index] = s;
+                                        }
+                                }
+                        }
+                }
+
+                size_t all = subsets - 1;
+                size_t best = 0;
+                double best_cost = std::numeric_limits<double>::infinity();
+                for (size_t s = 0; s < states; s++) {
+                        double c = cost[all * states + s]
+                                + distance(exit(paths[s / 2], s % 2), home_);
+                        if (c < best_cost) {
+                                best_cost = c;
+                                best = s;
+                        }
+                }
+
+                std::vector<Leg> legs;
+                size_t subset = all;
+                size_t s = best;
+                while (s != kNone) {
+                        legs.push_back({ s / 2, s % 2 == 1 });
+                        size_t prev = previous[subset * states + s];
+                        subset &= ~((size_t) 1 << (s / 2));
+                        s = prev;
+                }
+                std::reverse(legs.begin(), legs.end());
+                return legs;
+        }
+
+        /* Starting from home, go to the nearest free end of a path
+         * that hasn't been visited yet. */
+        std::vector<PathOrdering::Leg>
+        PathOrdering::solve_greedy(const std::vector<Path>& paths) const
+        {
+                std::vector<Leg> legs;
+                std::vector<bool> visited(paths.size(), false);
+                v3 position = home_;
+                
+                while (legs.size() < paths.size()) {
+                        Leg best = { 0, false };
+                        double best_distance = std::numeric_limits<double>::infinity();
+                        for (size_t i = 0; i < paths.size(); i++) {
+                                if (visited[i])
+                                        continue;
+                                for (bool reversed : { false, true }) {
+                                        double d = distance(position, entry(paths[i], reversed));
+                                        if (d < best_distance) {
+                                                best_distance = d;
+                                                best = { i, reversed };
+                                        }
+                                }
+                        }
+                        visited[best.path] = true;
+                        legs.push_back(best);
+                        position = exit(paths[best.path], best.reversed);
+                }
+                return legs;
+        }
+
+        void PathOrdering::improve(const std::vector<Path>& paths,
+                                   std::vector<Leg>& legs) const
+        {
+                bool improved = true;
+                while (improved) {
+                        improved = two_opt(paths, legs);
+                        improved = or_opt(paths, legs) || improved;
+                }
+        }
+        
+        /* 2-opt on the sequence of legs. Reversing the legs i..j,
+         * and the direction of each of them, leaves the travel
+         * inside the sequence unchanged, so only the two transfers
+         * at its ends change. With i == j, the move turns a single
+         * path around. */
+        bool PathOrdering::two_opt(const std::vector<Path>& paths,
+                                   std::vector<Leg>& legs) const
+        {
+                size_t n = legs.size();
+                bool improved = false;
+                bool changed = true;
+                
+                while (changed) {
+                        changed = false;
+                        for (size_t i = 0; i < n; i++) {
+                                v3 before = (i == 0)? home_
+                                        : exit(paths[legs[i-1].path], legs[i-1].reversed);
+                                v3 first = entry(paths[legs[i].path], legs[i].reversed);
+                                
+                                for (size_t j = i; j < n; j++) {
+                                        v3 after = (j + 1 == n)? home_
+                                                : entry(paths[legs[j+1].path], legs[j+1].reversed);
+                                        v3 last = exit(paths[legs[j].path], legs[j].reversed);
+                                        
+                                        double delta = distance(before, last)
+                                                + distance(first, after)
+                                                - distance(before, first)
+                                                - distance(last, after);
+                                        
+                                        if (delta < -kEpsilon) {
+                                                std::reverse(legs.begin() + (long) i,
+                                                             legs.begin() + (long) j + 1);
+                                                for (size_t k = i; k <= j; k++)
+                                                        legs[k].reversed = !legs[k].reversed;
+                                                first = entry(paths[legs[i].path],
+                                                              legs[i].reversed);
+                                                changed = true;
+                                                improved = true;
+                                        }
+                                }
+                        }
+                }
+                return improved;
+        }
+
+        /* Or-opt: takes a single leg out of the sequence and puts it
+         * back, in either direction, where it adds the least
+         * travel. */
+        bool PathOrdering::or_opt(const std::vector<Path>& paths,
+                                  std::vector<Leg>& legs) const
+        {
+                size_t n = legs.size();
+                bool improved = false;
+                
+                for (size_t k = 0; k < n; k++) {
+                        Leg leg = legs[k];
+                        std::vector<Leg> rest(legs);
+                        rest.erase(rest.begin() + (long) k);
+                        
+                        v3 before = (k == 0)? home_
+                                : exit(paths[rest[k-1].path], rest[k-1].reversed);
+                        v3 after = (k + 1 == n)? home_
+                                : entry(paths[rest[k].path], rest[k].reversed);
+                        double gain = distance(before, entry(paths[leg.path], leg.reversed))
+                                + distance(exit(paths[leg.path], leg.reversed), after)
+                                - distance(before, after);
+
+                        // Insert the leg in front of rest[position]
+                        size_t best_position = k;
+                        bool best_reversed = leg.reversed;
+                        double best_cost = gain;
+                        for (size_t position = 0; position <= rest.size(); position++) {
+                                v3 a = (position == 0)? home_
+                                        : exit(paths[rest[position-1].path],
+                                               rest[position-1].reversed);
+                                v3 b = (position == rest.size())? home_
+                                        : entry(paths[rest[position].path],
+                                                rest[position].reversed);
+                                for (bool reversed : { false, true }) {
+                                        double cost = distance(a, entry(paths[leg.path], reversed))
+                                                + distance(exit(paths[leg.path], reversed), b)
+                                                - distance(a, b);
+                                        if (cost < best_cost - kEpsilon) {
+                                                best_cost = cost;
+                                                best_position = position;
+                                                best_reversed = reversed;
+                                        }
+                                }
+                        }
+
+                        if (best_cost < gain - kEpsilon) {
+                                leg.reversed = best_reversed;
+                                rest.insert(rest.begin() + (long) best_position, leg);
+                                legs = std::move(rest);
+                                improved = true;
+                        }
+                }
+                return improved;
+        }
+}
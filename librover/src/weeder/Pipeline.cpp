@@ -22,25 +22,57 @@
 
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <map>
 #include <cv/cv.h>
 #include <util/Logger.h>
 #include "weeder/Pipeline.h"
+#include "weeder/ObstacleGrid.h"
+#include "weeder/DistanceTransform.h"
 #include "astar/AStar.hpp"
 
 namespace romi {
 
         static const size_t kAstarResolution = 25;
+
+        // The distances are square roots of integers, so a small
+        // epsilon turns "farther than" into "at least as far as".
+        static const double kEpsilon = 1e-6;
+
+        static double distance_to_segment(v3 p, v3 a, v3 b)
+        {
+                double dx = b.x() - a.x();
+                double dy = b.y() - a.y();
+                double length2 = dx * dx + dy * dy;
+                double t = 0.0;
+                if (length2 > 0.0) {
+                        t = ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / length2;
+                        t = std::max(0.0, std::min(1.0, t));
+                }
+                return std::hypot(p.x() - a.x() - t * dx, p.y() - a.y() - t * dy);
+        }
         
         Pipeline::Pipeline(std::unique_ptr<IImageCropper>& cropper,
                            std::unique_ptr<IImageSegmentation>& segmentation,
                            std::unique_ptr<IConnectedComponents>& connected_components,
-                           std::unique_ptr<IPathPlanner>& planner)
+                           std::unique_ptr<IPathPlanner>& planner,
+                           std::shared_ptr<ThreadPool> pool,
+                           double clearance,
+                           double simplification,
+                           bool jump_points)
                 : cropper_(),
                   segmentation_(),
                   connected_components_(),
-                  planner_()
+                  planner_(),
+                  pool_(pool),
+                  clearance_(clearance),
+                  simplification_(simplification),
+                  jump_points_(jump_points)
         {
+                if (!pool_)
+                        pool_ = std::make_shared<ThreadPool>(1);
                 cropper_ = std::move(cropper);
                 segmentation_ = std::move(segmentation);
                 connected_components_ = std::move(connected_components);
@@ -60,6 +92,11 @@ namespace romi {
                 return result;
         }
         
+        void Pipeline::set_displacement(double dx, double dy)
+        {
+                planner_->set_displacement(dx, dy);
+        }
+        
         std::vector<Path> Pipeline::try_run(ISession& session, Image& camera,
                                             double tool_diameter)
         {       
@@ -74,37 +111,10 @@ namespace romi {
                 romi::filter_mask(mask, mask, 8);
                 session.store_png("mask", mask);
 
-                Image dilated_mask;
-                
-                // TODO
-                if (false) {
-                        mask.dilate(1 + kAstarResolution / 2, dilated_mask);
-                        session.store_png("dilated-mask", dilated_mask);
-                } else {
-                        dilated_mask = mask;
-                }
-
-                r_debug("Pipeline: connected_components_->compute");
-                Image components;
-                connected_components_->compute(session, dilated_mask, components);
-                session.store_png("components", components);
-                r_debug("Pipeline: connected_components done");
-
-                double diameter_pixels = cropper_->map_meters_to_pixels(tool_diameter
-                                                                        + 0.010);
-                size_t max_centers = (size_t) ((double) (mask.width() * mask.height())
-                                               / (diameter_pixels * diameter_pixels));
-
-                r_info("calculate_centers (slic): start");
-                Centers centers = romi::calculate_centers(dilated_mask, max_centers);
-                r_info("calculate_centers (slic): done");
-                {
-                        rcom::MemBuffer buffer;
-                        for (auto & center: centers)
-                                buffer.printf("%zu\t%zu\n", center.first, center.second);
-                        session.store_txt("centers", buffer.tostring());
-                }
-
+                // The distances to the plants answer all the crossing
+                // and clearance checks of this run
+                auto distances = std::make_shared<DistanceTransform>(mask, pool_);
+                double clearance = cropper_->map_meters_to_pixels(clearance_);
 
                 double diameter = cropper_->map_meters_to_pixels(tool_diameter);
                 size_t border = (size_t) (diameter / 2.0);
@@ -113,44 +123,33 @@ namespace romi {
                 size_t y0 = border;
                 size_t y1 = mask.height() - border;
 
-                auto it = centers.begin();
-                while (it != centers.end()) {
-
-                        size_t cx = (size_t) (*it).first;
-                        size_t cy = (size_t) (*it).second;
+                planner_->set_scale(cropper_->map_meters_to_pixels(1.0), tool_diameter);
+                planner_->set_distance_transform(distances);
 
-                        if (cx < x0)
-                                cx = x0;
-                        if (cx > x1)
-                                cx = x1;
-                        if (cy < y0)
-                                cy = y0;
-                        if (cy > y1)
-                                cy = y1;
-
-                        float value = dilated_mask.get(Image::kGreyChannel, cx, cy);
-                        if (value > 0.0f) {
-                                it = centers.erase(it);
-                        } else {
-                                (*it).first = (uint32_t) cx;
-                                (*it).second = (uint32_t) cy;
-                                it++;
-                        }
+                std::vector<Centers> component_centers;
+                if (planner_->needs_centers()) {
+                        compute_centers(session, mask, *distances, clearance,
+                                        tool_diameter, component_centers);
+                } else {
+                        r_debug("Pipeline: the planner doesn't need centers");
+                        component_centers.emplace_back();
                 }
-                
-                std::vector<Centers> component_centers
-                        = romi::sort_centers(centers, components);
 
                 r_debug("Pipeline: number of components : %zu", component_centers.size());
                 
                 char filename[64];
                 std::vector<Path> paths;
                 //paths.push_back(Path());
+                ObstacleGrid obstacles(mask, kAstarResolution, jump_points_);
+
+                // Compute shortest path through centers
+                std::vector<Path> initial_paths = trace_paths(session, component_centers,
+                                                              mask);
+                planner_->set_distance_transform(nullptr);
                 
                 for (size_t i = 0; i < component_centers.size(); i++) {
 
-                        // Compute shortest path through centers
-                        Path initial_path = trace_path(session, component_centers[i], mask);
+                        Path& initial_path = initial_paths[i];
                         snprintf(filename, sizeof(filename), "path-initial-%02zu", i);
                         session.store_path(filename, 0, initial_path);
 
@@ -207,13 +206,26 @@ namespace romi {
                         }
                         
                         // check path for plant crossings
-                        check_path(session, mask, initial_path, paths, i);
+                        check_path(session, mask, *distances, clearance, diameter / 2.0,
+                                   obstacles, initial_path, paths, i);
                         
                         // snprintf(filename, sizeof(filename), "path-%02zu", i);
                         // session.store_path(filename, 0, paths.back());
                 }
 
+                if (obstacles.is_initialized())
+                        obstacles.store(session, "mask-astar");
+
                 r_debug("Pipeline: number of paths: %zu", paths.size());
+
+                // The tolerance of the simplification is a fraction
+                // of the tool diameter
+                double tolerance = simplification_ * diameter;
+                if (tolerance > 0.0) {
+                        for (auto& path : paths)
+                                simplify_path(*distances, clearance, diameter / 2.0,
+                                              tolerance, path);
+                }
                 
                 std::vector<Path> normalized_paths;
                 for (size_t k = 0; k < paths.size(); k++) {
@@ -237,9 +249,7 @@ namespace romi {
                                         y = (double) y1;
                                 }
 
-                                float value = mask.get(Image::kGreyChannel, (size_t) x,
-                                                       (size_t) y);
-                                if (value > 0.0f) {
+                                if (!distances->is_clear(v3(x, y, 0.0), 0.0)) {
                                         r_err("Pipeline::try_run: Failed to re-route path "
                                               "inside workspace without hurting a plant");
                                         throw std::runtime_error("Failed to re-route path");
@@ -255,6 +265,68 @@ namespace romi {
                 return normalized_paths;
         }
 
+        /* The centers closer to a plant than the clearance, in
+         * pixels, are removed. */
+        void Pipeline::compute_centers(ISession& session, Image& mask,
+                                       DistanceTransform& distances, double clearance,
+                                       double tool_diameter,
+                                       std::vector<Centers>& component_centers)
+        {
+                r_debug("Pipeline: connected_components_->compute");
+                Image components;
+                connected_components_->compute(session, mask, components);
+                session.store_png("components", components);
+                r_debug("Pipeline: connected_components done");
+
+                double diameter_pixels = cropper_->map_meters_to_pixels(tool_diameter
+                                                                        + 0.010);
+                size_t max_centers = (size_t) ((double) (mask.width() * mask.height())
+                                               / (diameter_pixels * diameter_pixels));
+
+                r_info("calculate_centers (slic): start");
+                Centers centers = romi::calculate_centers(mask, max_centers);
+                r_info("calculate_centers (slic): done");
+                {
+                        rcom::MemBuffer buffer;
+                        for (auto & center: centers)
+                                buffer.printf("%zu\t%zu\n", center.first, center.second);
+                        session.store_txt("centers", buffer.tostring());
+                }
+
+                double diameter = cropper_->map_meters_to_pixels(tool_diameter);
+                size_t border = (size_t) (diameter / 2.0);
+                size_t x0 = border;
+                size_t x1 = mask.width() - border;
+                size_t y0 = border;
+                size_t y1 = mask.height() - border;
+
+                auto it = centers.begin();
+                while (it != centers.end()) {
+
+                        size_t cx = (size_t) (*it).first;
+                        size_t cy = (size_t) (*it).second;
+
+                        if (cx < x0)
+                                cx = x0;
+                        if (cx > x1)
+                                cx = x1;
+                        if (cy < y0)
+                                cy = y0;
+                        if (cy > y1)
+                                cy = y1;
+
+                        if (distances.distance(cx, cy) <= clearance) {
+                                it = centers.erase(it);
+                        } else {
+                                (*it).first = (uint32_t) cx;
+                                (*it).second = (uint32_t) cy;
+                                it++;
+                        }
+                }
+                
+                component_centers = romi::sort_centers(centers, components);
+        }
+
         void Pipeline::crop_image(ISession& session, Image& camera,
                                   double tool_diameter, Image& crop)
         {
@@ -275,8 +347,217 @@ namespace romi {
                 return planner_->trace_path(session, centers, mask);
         }
 
-        void Pipeline::check_path(ISession& session, Image& mask, Path& path,
-                                  std::vector<Path>& paths, size_t index)
+        /* The components are planned concurrently when the planner
+         * is thread-safe. The paths are returned in component order
+         * and the files of the session are written afterwards, in
+         * the same order, so the results don't depend on the number
+         * of threads. */
+        std::vector<Path> Pipeline::trace_paths(ISession& session,
+                                                std::vector<Centers>& component_centers,
+                                                Image& mask)
+        {
+                size_t count = component_centers.size();
+                std::vector<Path> paths(count);
+
+                if (count < 2 || pool_->size() == 1 || !planner_->is_thread_safe()) {
+                        for (size_t i = 0; i < count; i++)
+                                paths[i] = trace_path(session, component_centers[i], mask);
+                } else {
+                        // The components differ a lot in size. Instead of
+                        // a fixed range, each chunk takes the next
+                        // component that hasn't been started yet.
+                        std::atomic<size_t> next(0);
+                        pool_->parallel_for(pool_->size(), [&](size_t, size_t, size_t) {
+                                size_t i;
+                                while ((i = next++) < count) {
+                                        paths[i] = trace_path(session, component_centers[i],
+                                                              mask);
+                                }
+                        });
+                }
+                return paths;
+        }
+
+        /* The detours are independent A* searches on the same
+         * occupancy grid. They are computed in parallel, each chunk
+         * of the thread pool using its own copy of the A* generator,
+         * and then spliced into the path in order. The SVG with the
+         * plant crossings is written afterwards, from the detours. A
+         * detour goes from the start to the end of the segment and
+         * is empty when A* failed. */
+        void Pipeline::check_path(ISession& session, Image& mask,
+                                  DistanceTransform& distances, double clearance,
+                                  double tool_radius, ObstacleGrid& obstacles,
+                                  Path& path, std::vector<Path>& paths, size_t index)
+        {
+                std::vector<size_t> crossings;
+                std::vector<Path> detours;
+
+                find_crossings(distances, clearance, path, crossings);
+                find_detours(distances, clearance, tool_radius, obstacles, path,
+                             crossings, detours);
+                splice_detours(path, crossings, detours, paths);
+                store_crossings(session, mask, path, crossings, detours, index);
+        }
+
+        void Pipeline::find_crossings(DistanceTransform& distances, double clearance,
+                                      Path& path, std::vector<size_t>& crossings)
+        {
+                for (size_t i = 0; i + 1 < path.size(); i++) {
+                        if (!distances.segment_is_clear(path[i], path[i+1], clearance))
+                                crossings.push_back(i);
+                }
+        }
+
+        void Pipeline::find_detours(DistanceTransform& distances, double clearance,
+                                    double tool_radius, ObstacleGrid& obstacles, Path& path,
+                                    std::vector<size_t>& crossings,
+                                    std::vector<Path>& detours)
+        {
+                detours.resize(crossings.size());
+                if (crossings.empty())
+                        return;
+
+                // The generator keeps its search state, so the copies
+                // are made before any of the chunks starts searching.
+                // The grid is coarse and a copy is cheap.
+                AStar::Generator& shared = obstacles.generator();
+                std::vector<AStar::Generator> generators(pool_->size() - 1, shared);
+                
+                pool_->parallel_for(crossings.size(),
+                                    [&](size_t chunk, size_t begin, size_t end) {
+                        AStar::Generator& generator = (chunk == 0)?
+                                shared : generators[chunk - 1];
+                        for (size_t k = begin; k < end; k++) {
+                                size_t i = crossings[k];
+                                AStar::CoordinateList cells = go_around(generator,
+                                                                        path[i], path[i+1]);
+                                detours[k] = smooth_detour(distances, clearance,
+                                                           tool_radius, path[i], path[i+1],
+                                                           cells);
+                        }
+                });
+        }
+
+        AStar::CoordinateList Pipeline::go_around(AStar::Generator& generator,
+                                                  v3 start, v3 end)
+        {
+                double d = (double) kAstarResolution;
+                return generator.findPath(
+                        { (int) (start.x() / d), (int) (start.y() / d) },
+                        { (int) (end.x() / d), (int) (end.y() / d) });
+        }
+
+        /* Converts the A* cells to pixels and pulls the string tight:
+         * from each waypoint, the detour goes straight to the
+         * farthest following waypoint that can be reached without
+         * coming closer to a plant than the clearance, and than the
+         * stair steps it replaces, or at least a tool radius. The
+         * stair steps of the grid are removed and only the
+         * waypoints where the path bends around a plant remain. */
+        Path Pipeline::smooth_detour(DistanceTransform& distances, double clearance,
+                                     double tool_radius, v3 start, v3 end,
+                                     AStar::CoordinateList& cells)
+        {
+                int d = (int) kAstarResolution;
+                int d2 = d / 2;
+                Path points;
+                Path detour;
+                
+                if (cells.empty())
+                        return detour;
+                
+                // The A* algorithm returns the path from end to
+                // start. Its first and last cells are replaced by the
+                // end and start points of the segment.
+                points.emplace_back(start);
+                for (size_t j = cells.size() - 1; j-- > 1; ) {
+                        int x = d * cells[j].x + d2;
+                        int y = d * cells[j].y + d2;
+                        points.emplace_back((double) x, (double) y, 0.0);
+                }
+                points.emplace_back(end);
+
+                size_t last = points.size() - 1;
+                std::vector<double> segment_clearance(last);
+                for (size_t k = 0; k < last; k++)
+                        segment_clearance[k] = distances.segment_clearance(points[k],
+                                                                           points[k+1]);
+
+                // required[j]: how far from the plants the chord from
+                // points[i] to points[j] must stay
+                std::vector<double> required(points.size());
+                size_t i = 0;
+                detour.emplace_back(points[0]);
+                while (i < last) {
+                        double span_clearance = segment_clearance[i];
+                        for (size_t k = i + 1; k <= last; k++) {
+                                span_clearance = std::min(span_clearance,
+                                                          segment_clearance[k-1]);
+                                required[k] = std::min(span_clearance, tool_radius);
+                        }
+                        
+                        size_t j = last;
+                        while (j > i + 1
+                               && !(distances.segment_is_clear(points[i], points[j],
+                                                               clearance)
+                                    && distances.segment_is_clear(points[i], points[j],
+                                                                  required[j] - kEpsilon)))
+                                j--;
+                        detour.emplace_back(points[j]);
+                        i = j;
+                }
+                return detour;
+        }
+
+        void Pipeline::splice_detours(Path& path, std::vector<size_t>& crossings,
+                                      std::vector<Path>& detours,
+                                      std::vector<Path>& paths)
+        {
+                size_t k = 0;
+                
+                paths.push_back(Path());
+                
+                for (size_t i = 0; i + 1 < path.size(); i++) {
+                        v3 start = path[i];
+                        paths.back().emplace_back(start);
+                        
+                        if (k == crossings.size() || crossings[k] != i)
+                                continue;
+
+                        Path& detour = detours[k++];
+                        
+                        r_debug("Using A* to go around plant, from (%.1f,%.1f) to (%.1f,%.1f)",
+                                start.x(), start.y(), path[i+1].x(), path[i+1].y());
+                
+                        // TODO
+                        if (detour.empty()) {
+                                r_debug("Pipeline: A*: Failed to find a path");
+                                r_debug("From: %f, %f", start.x(), start.y());
+                                r_debug("To:   %f, %f", path[i+1].x(), path[i+1].y());
+                                r_debug("Starting new path");
+                                //throw std::runtime_error("*** A*: FAILED TO FIND A PATH ***");
+                        
+                                // Start a new path
+                                paths.push_back(Path());
+                        } else {
+                                // Don't add the first point. This is the start
+                                // point... and it has already been added
+                                // above. Don't add the last point (which is the
+                                // end point) because it will be added by the
+                                // next segment (to avoid duplicates).
+                                for (size_t j = 1; j + 1 < detour.size(); j++)
+                                        paths.back().emplace_back(detour[j]);
+                        }
+                }
+                
+                paths.back().emplace_back(path.back());
+        }
+
+        void Pipeline::store_crossings(ISession& session, Image& mask, Path& path,
+                                       std::vector<size_t>& crossings,
+                                       std::vector<Path>& detours,
+                                       size_t index)
         {
                 rcom::MemBuffer buffer;
                 int w = (int) mask.width();
@@ -296,11 +577,26 @@ namespace romi {
                               "width=\"%dpx\" height=\"%dpx\" />\n",
                               w, h);
 
-                paths.push_back(Path());
-                for (size_t i = 0; i < path.size() - 1; i++) {
-                        check_segment(session, buffer, mask, path[i], path[i+1], paths);
+                for (size_t k = 0; k < crossings.size(); k++) {
+                        Path& detour = detours[k];
+                        if (detour.empty())
+                                continue;
+                        
+                        v3 start = path[crossings[k]];
+                        v3 end = path[crossings[k] + 1];
+                        
+                        buffer.printf("    <g>\n");
+                        buffer.printf("    <path d=\"M %d,%d L %d,%d\" "
+                                      "fill=\"transparent\" stroke=\"blue\"/>\n",
+                                      (int) start.x(), (int) start.y(),
+                                      (int) end.x(), (int) end.y());
+                        for (size_t j = 1; j + 1 < detour.size(); j++) {
+                                buffer.printf("    <circle cx=\"%dpx\" cy=\"%dpx\" "
+                                              "r=\"3px\" fill=\"red\" stroke=\"none\" />\n",
+                                              (int) detour[j].x(), (int) detour[j].y());
+                        }
+                        buffer.printf("    </g>\n");
                 }
-                paths.back().emplace_back(path.back());
 
                 buffer.printf("</svg>\n");
                 
@@ -308,135 +604,74 @@ namespace romi {
                 snprintf(filename, sizeof(filename), "plant-crossings-%02zu.svg", index);
                 session.store_svg(filename, buffer.tostring());
         }
-        
-        void Pipeline::check_segment(ISession& session,
-                                     rcom::MemBuffer& buffer,
-                                     Image& mask, v3 start, v3 end,
-                                     std::vector<Path>& paths)
-        {
-                if (segment_crosses_white_area(mask, start, end)) {
-                        go_around(session, buffer, mask, start, end, paths);
-                } else {
-                        //path.emplace_back(start);
-                        paths.back().emplace_back(start);
-                }
-        }
 
-        void Pipeline::go_around(ISession& session,
-                                 rcom::MemBuffer& buffer,
-                                 Image& mask,
-                                 v3 start, v3 end,
-                                 std::vector<Path>& paths)
+        /* Ramer-Douglas-Peucker, checked against the mask. The
+         * points of a span that are closer to its chord than the
+         * tolerance are dropped, as long as the chord keeps the
+         * clearance, and keeps as far from the plants as the part
+         * of the path it replaces, or at least a tool radius. A
+         * chord can't cut through the arcs that a planner traced
+         * around a plant. Otherwise the span is split at its
+         * farthest point. The segments of the original path are
+         * kept as they are. */
+        void Pipeline::simplify_path(DistanceTransform& distances, double clearance,
+                                     double tool_radius, double tolerance, Path& path)
         {
-                int d = (int) kAstarResolution;
-                int d2 = d / 2;
-                int w = (int) mask.width();
-                int h = (int) mask.height();
-                float *data = mask.data().data();
-                float sum;
+                if (path.size() < 3)
+                        return;
 
-                AStar::Generator generator;
-                generator.setWorldSize({ (int) (w / d), (int) (h / d) });
-                generator.setHeuristic(AStar::Heuristic::euclidean);
-                generator.setDiagonalMovement(true);
+                std::vector<double> segment_clearance(path.size() - 1);
+                for (size_t k = 0; k + 1 < path.size(); k++)
+                        segment_clearance[k] = distances.segment_clearance(path[k], path[k+1]);
 
-                size_t iw = (mask.width() / kAstarResolution) * kAstarResolution;
-                size_t ih = (mask.height() / kAstarResolution) * kAstarResolution;
-                Image mask_astar(Image::BW, iw, ih);
+                std::vector<bool> keep(path.size(), false);
+                keep.front() = true;
+                keep.back() = true;
                 
-                for (int y = d2; y < h - d2; y += d) {
-                        for (int x = d2; x < w - d2; x += d) {
-                                int off = y * w + x;
-
-                                // Sum the values over an area of size
-                                // dxd and centered on (x,y)
-                                sum = 0.0f;
-                                for (int j = -d2; j <= d2; j++) {
-                                        int offy = off + j * w;
-                                        for (int i = -d2; i <= d2; i++) {
-                                                sum += data[offy + i];
-                                        }
-                                }
-                                
-                                if (sum > 0.0f) {
-                                        generator.addCollision(AStar::Vec2i((int)(x / d),
-                                                                            (int)(y / d)));
-
-                                        for (size_t yi = (size_t) (y - d2); yi < (size_t) (y + d2); yi++) { 
-                                                for (size_t xi = (size_t) (x - d2); xi < (size_t) (x + d2); xi++) { 
-                                                        mask_astar.set(Image::kGreyChannel,
-                                                                       xi, yi, 1.0f);
-                                                }
-                                        }
+                std::vector<std::pair<size_t, size_t>> spans;
+                spans.emplace_back(0, path.size() - 1);
+                
+                while (!spans.empty()) {
+                        size_t first = spans.back().first;
+                        size_t last = spans.back().second;
+                        spans.pop_back();
+                        if (last - first < 2)
+                                continue;
+
+                        size_t farthest = first + 1;
+                        double max_deviation = 0.0;
+                        double span_clearance = segment_clearance[first];
+                        for (size_t k = first + 1; k < last; k++) {
+                                span_clearance = std::min(span_clearance,
+                                                          segment_clearance[k]);
+                                double d = distance_to_segment(path[k], path[first],
+                                                               path[last]);
+                                if (d > max_deviation) {
+                                        max_deviation = d;
+                                        farthest = k;
                                 }
                         }
-                }
-
-                
-                size_t x0 = (size_t) start.x();
-                size_t y0 = (size_t) start.y();
-                size_t x1 = (size_t) end.x();
-                size_t y1 = (size_t) end.y();
-                mask_astar.set(Image::kGreyChannel, x0, y0, 0.5f);
-                mask_astar.set(Image::kGreyChannel, x1, y1, 0.5f);
-                
-                
-                char filename[64];
-                snprintf(filename, sizeof(filename), "mask-astart-%04d-%04d",
-                         (int) start.x(), (int) start.y());
-                session.store_png(filename, mask_astar);
-                
-                r_debug("Using A* to go around plant, from (%.1f,%.1f) to (%.1f,%.1f)",
-                        start.x(), start.y(), end.x(), end.y());
-                
-                auto new_path = generator.findPath(
-                        { (int) (start.x() / (double) d), (int) (start.y() / (double) d) },
-                        { (int) (end.x() / (double) d), (int) (end.y() / (double) d) });
-                
-                int length = (int) new_path.size();
 
+                        double required = std::min(span_clearance, tool_radius);
+                        if (max_deviation <= tolerance
+                            && distances.segment_is_clear(path[first], path[last],
+                                                          clearance)
+                            && distances.segment_is_clear(path[first], path[last],
+                                                          required - kEpsilon))
+                                continue;
+
+                        keep[farthest] = true;
+                        spans.emplace_back(first, farthest);
+                        spans.emplace_back(farthest, last);
+                }
 
-                
-                // TODO
-                if (length == 0) {
-                        r_debug("Pipeline: A*: Failed to find a path");
-                        r_debug("From: %f, %f", start.x(), start.y());
-                        r_debug("To:   %f, %f", end.x(), end.y());
-                        r_debug("Starting new path");
-                        paths.back().emplace_back(start);
-                        //throw std::runtime_error("*** A*: FAILED TO FIND A PATH ***");
-                        
-                        // Start a new path
-                        paths.push_back(Path());
-                        
-                } else {
-                
-                        buffer.printf("    <g>\n");
-                        buffer.printf("    <path d=\"M %d,%d L %d,%d\" "
-                                      "fill=\"transparent\" stroke=\"blue\"/>\n",
-                                      (int) start.x(), (int) start.y(),
-                                      (int) end.x(), (int) end.y());
-                
-                        paths.back().emplace_back(start);
-                        //path.emplace_back(start.x(), start.y(), 0.0);
-                
-                        // The A* algorithm returns the path from end to
-                        // start. So we have to iterate backwards. Don't add
-                        // the last point. This is the start point... and it
-                        // has already been added above. Don't add the first
-                        // point (which is the end point) because it will be
-                        // added by the next segment (to avoid duplicates).
-                
-                        for (int i = length-2; i > 0; i--) {
-                                int x = (int) d * new_path[(size_t)i].x + d2;
-                                int y = (int) d * new_path[(size_t)i].y + d2;
-                                buffer.printf("    <circle cx=\"%dpx\" cy=\"%dpx\" "
-                                              "r=\"3px\" fill=\"red\" stroke=\"none\" />\n",
-                                              x, y);
-                                paths.back().emplace_back((double) x, (double) y, 0.0);
-                                //path.emplace_back((double) x, (double) y, 0.0);                        
-                        }
-                        buffer.printf("    </g>\n");
+                Path simplified;
+                for (size_t k = 0; k < path.size(); k++) {
+                        if (keep[k])
+                                simplified.emplace_back(path[k]);
                 }
+                r_debug("Pipeline::simplify_path: %zu -> %zu points",
+                        path.size(), simplified.size());
+                path = simplified;
         }
 }
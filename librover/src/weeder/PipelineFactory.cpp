@@ -27,7 +27,9 @@
 // TBD: Move all the fake code to FakePipelineFactory.
 // In build_pipeline build fake if it's in config OR options. If not call base class and build real class.
 
+#ifdef ROMI_WITH_ORTOOLS
 #include <constraintsolver/GConstraintSolver.h>
+#endif
 #include <cv/ImageCropper.h>
 
 #include "weeder/PipelineFactory.h"
@@ -39,6 +41,7 @@
 #include "unet/PythonTriple.h"
 #include "som/SOM.h"
 #include "quincunx/Quincunx.h"
+#include "tsp/TSP.h"
 
 namespace romi {
         
@@ -100,14 +103,70 @@ namespace romi {
                         return std::make_unique<Quincunx>(properties);
                 } else if (name ==  kSOM) {
                         return std::make_unique<SOM>(properties);
+                } else if (name == kTSP) {
+                        return std::make_unique<TSP>(properties);
                 } else if (name ==  kORTools) {
+#ifdef ROMI_WITH_ORTOOLS
                         return std::make_unique<GConstraintSolver>(properties);
+#else
+                        r_err("The OR-tools path planner is not included in this build");
+                        throw std::runtime_error("Path planner not available");
+#endif
                 } else {
                         r_err("Failed to find the path planner class: %s", name.c_str());
                         throw std::runtime_error("Invalid path planner class");
                 }
         }
         
+        /* The pool used by the pipeline for the A* detours. The
+         * "threads" setting of the weeder gives its size, 0 meaning
+         * all the cores. */
+        std::shared_ptr<ThreadPool>
+        PipelineFactory::build_thread_pool(nlohmann::json& weeder)
+        {
+                size_t threads = weeder.value("threads", (size_t) 1);
+                if (threads > kMaxThreads) {
+                        r_err("Invalid number of threads: %zu", threads);
+                        throw std::runtime_error("Invalid number of threads");
+                }
+                if (threads == 0)
+                        threads = ThreadPool::default_size();
+                return std::make_shared<ThreadPool>(threads);
+        }
+
+        /* The minimum distance, in meters, between the path and the
+         * plants. */
+        double PipelineFactory::get_clearance(nlohmann::json& weeder)
+        {
+                double clearance = weeder.value("clearance", 0.0);
+                if (clearance < 0.0 || clearance > kMaxClearance) {
+                        r_err("Invalid clearance: %f", clearance);
+                        throw std::runtime_error("Invalid clearance");
+                }
+                return clearance;
+        }
+
+        /* The tolerance of the path simplification, as a fraction
+         * of the tool diameter. Zero, the default, turns the
+         * simplification off. */
+        double PipelineFactory::get_simplification(nlohmann::json& weeder)
+        {
+                double simplification = weeder.value("simplification", 0.0);
+                if (simplification < 0.0 || simplification > kMaxSimplification) {
+                        r_err("Invalid simplification: %f", simplification);
+                        throw std::runtime_error("Invalid simplification");
+                }
+                return simplification;
+        }
+
+        /* Whether the A* detours use Jump Point Search. The
+         * detours have the same cost, but JPS may pick another one
+         * among the equally short ones. */
+        bool PipelineFactory::get_jump_points(nlohmann::json& weeder)
+        {
+                return weeder.value("jump-point-search", false);
+        }
+        
         IPipeline& PipelineFactory::build(CNCRange &range, nlohmann::json& config)
         {
                 nlohmann::json weeder = config["weeder"];
@@ -117,9 +176,15 @@ namespace romi {
                 
                 auto segmentation = build_segmentation(weeder);
                 auto planner = build_planner(weeder);
+                auto pool = build_thread_pool(weeder);
+                double clearance = get_clearance(weeder);
+                double simplification = get_simplification(weeder);
+                bool jump_points = get_jump_points(weeder);
                 
                 _pipeline = std::make_unique<Pipeline>(cropper, segmentation,
-                                                       connected_components, planner);
+                                                       connected_components, planner,
+                                                       pool, clearance, simplification,
+                                                       jump_points);
                 return *_pipeline;
         }
 }
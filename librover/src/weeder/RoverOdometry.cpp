@@ -0,0 +1,57 @@
+/*
+  romi-rover
+
+  Copyright (C) 2019 Sony Computer Science Laboratories
+  Author(s) Peter Hanappe
+
+  romi-rover is collection of applications for the Romi Rover.
+
+  romi-rover is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <cmath>
+#include "weeder/RoverOdometry.h"
+
+namespace romi {
+
+        RoverOdometry::RoverOdometry(WheelOdometry& odometry, v3 forward)
+                : odometry_(odometry),
+                  forward_(forward),
+                  initialized_(false),
+                  location_()
+        {
+        }
+
+        /* The first call only records the location of the rover:
+         * there is no previous image to compare with. */
+        bool RoverOdometry::get_displacement(double& dx, double& dy)
+        {
+                v3 location = odometry_.get_location();
+                double orientation = odometry_.get_orientation();
+                bool valid = initialized_;
+                
+                if (valid) {
+                        double distance = ((location.x() - location_.x()) * cos(orientation)
+                                           + (location.y() - location_.y()) * sin(orientation));
+                        dx = -distance * forward_.x();
+                        dy = -distance * forward_.y();
+                }
+                
+                location_ = location;
+                initialized_ = true;
+                return valid;
+        }
+}
@@ -24,6 +24,7 @@
 
 #include <util/Logger.h>
 #include "weeder/Weeder.h"
+#include "weeder/PathOrdering.h"
 
 // ToDo: Observation_id
 const std::string observation_id = "row_1";
@@ -37,7 +38,8 @@ namespace romi {
                        double z0,
                        double speed,
                        double diameter_tool,
-                       ISession& session)
+                       ISession& session,
+                       std::shared_ptr<IOdometry> odometry)
                 : _camera(camera),
                   _pipeline(pipeline),
                   _cnc(cnc),
@@ -45,7 +47,8 @@ namespace romi {
                   _z0(z0),
                   _speed(speed),
                   _diameter_tool(diameter_tool),
-                  session_(session)
+                  session_(session),
+                  odometry_(odometry)
         {
                 _cnc.get_range(_range);
         }
@@ -78,6 +81,7 @@ namespace romi {
         {
                 Image image;
                 grab_image(image);
+                update_displacement();
                 
                 std::vector<Path> paths = analyse_image(image);
                 
@@ -86,6 +90,8 @@ namespace romi {
                         store_svg(paths[i], i);
                 }
 
+                order_paths(paths);
+                
                 if (paths.size() > 0) {
                         
                         Path path = paths[0];
@@ -108,6 +114,21 @@ namespace romi {
                 camera_grab(image);
         }
 
+        /* The planners that track the field from one image to the
+         * next are told how far it moved since the previous
+         * image. */
+        void Weeder::update_displacement()
+        {
+                double dx;
+                double dy;
+                if (odometry_ && odometry_->get_displacement(dx, dy)) {
+                        r_debug("Weeder: field displacement %.3f, %.3f m", dx, dy);
+                        // The y-axis of the image is inverted with
+                        // respect to the workspace.
+                        _pipeline.set_displacement(dx, -dy);
+                }
+        }
+
         void Weeder::camera_grab(Image& image)
         {
                 if (!_camera.grab(image)) {
@@ -238,6 +259,18 @@ namespace romi {
                 // }
         }
         
+        /* The arm leaves from the camera position and goes back
+         * to it after the hoeing. The paths are ordered, and turned
+         * around, to make the lifted travel in between short. */
+        void Weeder::order_paths(std::vector<Path>& paths)
+        {
+                PathOrdering ordering(v3(0.0, _range.ymax(), 0.0));
+                double before = ordering.transfer_length(paths);
+                ordering.order(paths);
+                r_debug("Weeder::order_paths: lifted travel %.3f m, was %.3f m",
+                        ordering.transfer_length(paths), before);
+        }
+        
         void Weeder::append_path(Path& combined, Path& extension)
         {
                 if (extension.size() > 0) {
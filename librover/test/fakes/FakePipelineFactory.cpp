@@ -91,9 +91,15 @@ namespace romi {
                 
                 auto segmentation = build_segmentation(weeder, options);
                 auto planner = build_planner(weeder);
+                auto pool = build_thread_pool(weeder);
+                double clearance = get_clearance(weeder);
+                double simplification = get_simplification(weeder);
+                bool jump_points = get_jump_points(weeder);
                 
                 _pipeline = std::make_unique<Pipeline>(cropper, segmentation,
-                                                       connected_components, planner);
+                                                       connected_components, planner,
+                                                       pool, clearance, simplification,
+                                                       jump_points);
                 return *_pipeline;
         }
 
@@ -0,0 +1,308 @@
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "astar/AStar.hpp"
+
+using namespace AStar;
+
+class AStar_tests : public ::testing::Test
+{
+protected:
+        static constexpr int kWidth = 32;
+        static constexpr int kHeight = 24;
+
+        std::vector<uint8_t> walls;
+
+        AStar_tests() : walls() {
+        }
+
+        ~AStar_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        void make_walls(std::mt19937& generator, double density) {
+                std::bernoulli_distribution wall(density);
+                walls.resize(kWidth * kHeight);
+                for (auto& w : walls)
+                        w = wall(generator);
+        }
+
+        bool is_wall(Vec2i p) {
+                return (p.x < 0 || p.x >= kWidth || p.y < 0 || p.y >= kHeight
+                        || walls[(size_t) (p.y * kWidth + p.x)]);
+        }
+
+        void init_generator(Generator& generator, bool diagonal,
+                            HeuristicFunction heuristic) {
+                generator.setWorldSize({ kWidth, kHeight });
+                generator.setDiagonalMovement(diagonal);
+                generator.setHeuristic(heuristic);
+                for (int y = 0; y < kHeight; y++) {
+                        for (int x = 0; x < kWidth; x++) {
+                                if (walls[(size_t) (y * kWidth + x)])
+                                        generator.addCollision({ x, y });
+                        }
+                }
+        }
+
+        // The search of the original implementation: the open and
+        // closed sets are lists, and the open cell with the lowest
+        // score that comes last in the list is expanded first.
+        struct Node {
+                uint G;
+                uint H;
+                Vec2i coordinates;
+                int parent;
+        };
+
+        static int find(std::vector<Node>& nodes, std::vector<int>& list, Vec2i p) {
+                for (int index : list) {
+                        if (nodes[(size_t) index].coordinates == p)
+                                return index;
+                }
+                return -1;
+        }
+
+        CoordinateList reference_path(Vec2i source, Vec2i target, bool diagonal,
+                                      HeuristicFunction heuristic) {
+                const Vec2i direction[] = {
+                        { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 },
+                        { -1, -1 }, { 1, 1 }, { -1, 1 }, { 1, -1 }
+                };
+                uint directions = diagonal? 8 : 4;
+                std::vector<Node> nodes;
+                std::vector<int> open;
+                std::vector<int> closed;
+                int current = -1;
+                bool reached_target = false;
+
+                nodes.push_back({ 0, 0, source, -1 });
+                open.push_back(0);
+
+                while (!open.empty()) {
+                        size_t current_index = 0;
+                        current = open[0];
+                        for (size_t i = 0; i < open.size(); i++) {
+                                Node& node = nodes[(size_t) open[i]];
+                                Node& best = nodes[(size_t) current];
+                                if (node.G + node.H <= best.G + best.H) {
+                                        current = open[i];
+                                        current_index = i;
+                                }
+                        }
+                        if (nodes[(size_t) current].coordinates == target) {
+                                reached_target = true;
+                                break;
+                        }
+                        closed.push_back(current);
+                        open.erase(open.begin() + (long) current_index);
+
+                        for (uint i = 0; i < directions; i++) {
+                                Vec2i p(nodes[(size_t) current].coordinates.x + direction[i].x,
+                                        nodes[(size_t) current].coordinates.y + direction[i].y);
+                                if (is_wall(p) || find(nodes, closed, p) >= 0)
+                                        continue;
+                                uint cost = nodes[(size_t) current].G + ((i < 4)? 10 : 14);
+                                int successor = find(nodes, open, p);
+                                if (successor < 0) {
+                                        nodes.push_back({ cost, heuristic(p, target), p, current });
+                                        open.push_back((int) nodes.size() - 1);
+                                } else if (cost < nodes[(size_t) successor].G) {
+                                        nodes[(size_t) successor].parent = current;
+                                        nodes[(size_t) successor].G = cost;
+                                }
+                        }
+                }
+
+                CoordinateList path;
+                while (reached_target && current >= 0) {
+                        path.push_back(nodes[(size_t) current].coordinates);
+                        current = nodes[(size_t) current].parent;
+                }
+                return path;
+        }
+
+        // The cost of the shortest 8-connected path, by Dijkstra,
+        // or -1 if the target can't be reached
+        int shortest_cost(Vec2i source, Vec2i target) {
+                const Vec2i direction[] = {
+                        { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 },
+                        { -1, -1 }, { 1, 1 }, { -1, 1 }, { 1, -1 }
+                };
+                std::vector<int> cost(walls.size(), -1);
+                std::vector<bool> done(walls.size(), false);
+                cost[(size_t) (source.y * kWidth + source.x)] = 0;
+                while (true) {
+                        int best = -1;
+                        for (size_t i = 0; i < cost.size(); i++) {
+                                if (!done[i] && cost[i] >= 0
+                                    && (best < 0 || cost[i] < cost[(size_t) best]))
+                                        best = (int) i;
+                        }
+                        if (best < 0)
+                                return -1;
+                        if (best == target.y * kWidth + target.x)
+                                return cost[(size_t) best];
+                        done[(size_t) best] = true;
+                        for (int i = 0; i < 8; i++) {
+                                Vec2i p(best % kWidth + direction[i].x,
+                                        best / kWidth + direction[i].y);
+                                if (is_wall(p))
+                                        continue;
+                                size_t index = (size_t) (p.y * kWidth + p.x);
+                                int c = cost[(size_t) best] + ((i < 4)? 10 : 14);
+                                if (!done[index] && (cost[index] < 0 || c < cost[index]))
+                                        cost[index] = c;
+                        }
+                }
+        }
+
+        // The cost of a path of neighbouring free cells, or -1 if
+        // two cells aren't neighbours or a cell is a wall
+        int path_cost(CoordinateList& path) {
+                int cost = 0;
+                for (size_t i = 0; i < path.size(); i++) {
+                        if (is_wall(path[i]))
+                                return -1;
+                        if (i == 0)
+                                continue;
+                        int dx = abs(path[i].x - path[i-1].x);
+                        int dy = abs(path[i].y - path[i-1].y);
+                        if (dx > 1 || dy > 1 || dx + dy == 0)
+                                return -1;
+                        cost += (dx + dy == 2)? 14 : 10;
+                }
+                return cost;
+        }
+
+        Vec2i random_free_cell(std::mt19937& generator) {
+                std::uniform_int_distribution<int> x(0, kWidth - 1);
+                std::uniform_int_distribution<int> y(0, kHeight - 1);
+                Vec2i p;
+                do {
+                        p = Vec2i(x(generator), y(generator));
+                } while (is_wall(p));
+                return p;
+        }
+
+        void assert_same_paths(int seed, bool diagonal, HeuristicFunction heuristic) {
+                std::mt19937 random(seed);
+                for (int grid = 0; grid < 10; grid++) {
+                        make_walls(random, 0.3);
+                        Generator generator;
+                        init_generator(generator, diagonal, heuristic);
+                        for (int search = 0; search < 5; search++) {
+                                Vec2i source = random_free_cell(random);
+                                Vec2i target = random_free_cell(random);
+                                CoordinateList expected = reference_path(source, target,
+                                                                         diagonal, heuristic);
+                                
+                                CoordinateList path = generator.findPath(source, target);
+                                
+                                ASSERT_EQ(path.size(), expected.size());
+                                for (size_t i = 0; i < path.size(); i++) {
+                                        ASSERT_EQ(path[i].x, expected[i].x);
+                                        ASSERT_EQ(path[i].y, expected[i].y);
+                                }
+                        }
+                }
+        }
+};
+
+TEST_F(AStar_tests, heap_search_finds_the_original_paths)
+{
+        assert_same_paths(1, false, Heuristic::manhattan);
+}
+
+TEST_F(AStar_tests, heap_search_finds_the_original_paths_with_diagonals)
+{
+        assert_same_paths(2, true, Heuristic::octagonal);
+        assert_same_paths(3, true, Heuristic::euclidean);
+}
+
+TEST_F(AStar_tests, path_is_empty_when_the_target_is_walled_in)
+{
+        // Arrange
+        walls.assign(kWidth * kHeight, 0);
+        for (int y = 9; y <= 11; y++)
+                for (int x = 9; x <= 11; x++)
+                        walls[(size_t) (y * kWidth + x)] = (x != 10 || y != 10);
+        Generator generator;
+        init_generator(generator, true, Heuristic::octagonal);
+
+        // Act
+        CoordinateList path = generator.findPath({ 0, 0 }, { 10, 10 });
+
+        //Assert
+        ASSERT_TRUE(path.empty());
+}
+
+TEST_F(AStar_tests, octagonal_heuristic_finds_the_shortest_paths)
+{
+        std::mt19937 random(4);
+        for (int grid = 0; grid < 10; grid++) {
+                // Arrange
+                make_walls(random, 0.3);
+                Generator generator;
+                init_generator(generator, true, Heuristic::octagonal);
+                for (int search = 0; search < 5; search++) {
+                        Vec2i source = random_free_cell(random);
+                        Vec2i target = random_free_cell(random);
+                        int expected = shortest_cost(source, target);
+
+                        // Act
+                        CoordinateList path = generator.findPath(source, target);
+
+                        //Assert
+                        if (expected < 0) {
+                                ASSERT_TRUE(path.empty());
+                        } else {
+                                ASSERT_EQ(path.front().x, target.x);
+                                ASSERT_EQ(path.front().y, target.y);
+                                ASSERT_EQ(path.back().x, source.x);
+                                ASSERT_EQ(path.back().y, source.y);
+                                ASSERT_EQ(path_cost(path), expected);
+                        }
+                }
+        }
+}
+
+TEST_F(AStar_tests, jump_point_search_finds_paths_with_the_same_cost)
+{
+        std::mt19937 random(5);
+        const double densities[] = { 0.1, 0.3, 0.45 };
+        for (double density : densities) {
+                for (int grid = 0; grid < 10; grid++) {
+                        // Arrange
+                        make_walls(random, density);
+                        Generator astar;
+                        init_generator(astar, true, Heuristic::octagonal);
+                        Generator jps;
+                        init_generator(jps, true, Heuristic::octagonal);
+                        jps.setJumpPointSearch(true);
+                        for (int search = 0; search < 5; search++) {
+                                Vec2i source = random_free_cell(random);
+                                Vec2i target = random_free_cell(random);
+                                CoordinateList expected = astar.findPath(source, target);
+
+                                // Act
+                                CoordinateList path = jps.findPath(source, target);
+
+                                //Assert
+                                ASSERT_EQ(path.empty(), expected.empty());
+                                if (!path.empty()) {
+                                        ASSERT_EQ(path.front().x, target.x);
+                                        ASSERT_EQ(path.front().y, target.y);
+                                        ASSERT_EQ(path.back().x, source.x);
+                                        ASSERT_EQ(path.back().y, source.y);
+                                        ASSERT_EQ(path_cost(path), path_cost(expected));
+                                }
+                        }
+                }
+        }
+}
@@ -0,0 +1,381 @@
+#include <cmath>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "quincunx/Correlation.h"
+
+using namespace romi;
+
+class CorrelationKernels : public Correlation
+{
+public:
+        explicit CorrelationKernels(Method method = kAuto) : Correlation(method) {}
+
+        Image& bell(size_t w) {
+                return get_kernel(w).bell;
+        }
+
+        const std::vector<float>& gaussian(size_t w) {
+                return get_kernel(w).gaussian;
+        }
+};
+
+class Correlation_tests : public ::testing::Test
+{
+protected:
+        static constexpr size_t kWidth = 47;
+        static constexpr size_t kHeight = 38;
+
+        Correlation_tests() = default;
+
+        ~Correlation_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // A binary mask with about a third of the pixels set
+        static void make_mask(Image& mask, size_t width, size_t height,
+                              std::mt19937& generator) {
+                std::bernoulli_distribution white(0.3);
+                mask.init(Image::BW, width, height);
+                for (size_t y = 0; y < height; y++)
+                        for (size_t x = 0; x < width; x++)
+                                mask.set(0, x, y, white(generator)? 1.0f : 0.0f);
+        }
+
+        // The original per-pixel convolution of the quincunx
+        // planner, kept as the reference for kDirect.
+        static float original_convolution(Image& image, Image& mask,
+                                          ssize_t x0, ssize_t y0) {
+                float r = 0.0;
+                ssize_t xi_min = x0;
+                ssize_t xi_max = x0 + (ssize_t) mask.width();
+                ssize_t yi_min = y0;
+                ssize_t yi_max = y0 + (ssize_t) mask.height();
+                size_t xm_min = 0;
+                size_t ym_min = 0;
+                auto& data1 = image.data();
+                auto& data2 = mask.data();
+
+                if (xi_max < 0
+                    || yi_max < 0
+                    || xi_min >= (ssize_t) image.width()
+                    || yi_min >= (ssize_t) image.height())
+                        return 0.0f;
+
+                if (x0 < 0) {
+                        xi_min = 0;
+                        xm_min = (size_t) -x0;
+                }
+                if (y0 < 0) {
+                        yi_min = 0;
+                        ym_min = (size_t) -y0;
+                }
+                if (xi_max > (ssize_t) image.width())
+                        xi_max = (ssize_t) image.width();
+                if (yi_max > (ssize_t) image.height())
+                        yi_max = (ssize_t) image.height();
+
+                float area = (float) ((xi_max - xi_min) * (yi_max - yi_min));
+
+                for (size_t yi = (size_t) yi_min, ym = ym_min; yi < (size_t) yi_max; yi++, ym++) {
+                        size_t yi_off = yi * image.width();
+                        size_t ym_off = ym * mask.width();
+                        for (size_t xi = (size_t) xi_min, xm = xm_min; xi < (size_t) xi_max; xi++, xm++) {
+                                float c1 = data1[yi_off + xi];
+                                float c2 = data2[ym_off + xm];
+                                r += c1 * c2;
+                        }
+                }
+                return r / area;
+        }
+
+        static float original_correlation(Image& image, Image& bell, Image& out) {
+                size_t width = image.width();
+                size_t height = image.height();
+                ssize_t c = (ssize_t) (bell.width() / 2);
+                float corr_avg = 0.0f;
+
+                out.init(Image::BW, width, height);
+                for (size_t x = 0; x < width; x++) {
+                        for (size_t y = 0; y < height; y++) {
+                                float v = original_convolution(image, bell,
+                                                               (ssize_t) x - c,
+                                                               (ssize_t) y - c);
+                                corr_avg += v;
+                                out.set(0, x, y, v);
+                        }
+                }
+                return corr_avg / (float) (width * height);
+        }
+
+        // The sum of the products over the part of the w-by-w kernel
+        // that overlaps the image, divided by the number of
+        // overlapping pixels, in double precision.
+        template <typename K>
+        static double brute_force(Image& image, size_t w, ssize_t x, ssize_t y, K kernel) {
+                ssize_t c = (ssize_t) (w / 2);
+                double sum = 0.0;
+                double area = 0.0;
+                for (size_t ym = 0; ym < w; ym++) {
+                        for (size_t xm = 0; xm < w; xm++) {
+                                ssize_t xi = x - c + (ssize_t) xm;
+                                ssize_t yi = y - c + (ssize_t) ym;
+                                if (xi < 0 || yi < 0
+                                    || xi >= (ssize_t) image.width()
+                                    || yi >= (ssize_t) image.height())
+                                        continue;
+                                sum += (double) image.get(0, (size_t) xi, (size_t) yi)
+                                        * kernel(xm, ym);
+                                area += 1.0;
+                        }
+                }
+                return sum / area;
+        }
+
+        static double max_difference(Image& a, Image& b) {
+                double d = 0.0;
+                for (size_t i = 0; i < a.data().size(); i++)
+                        d = std::max(d, (double) std::fabs(a.data()[i] - b.data()[i]));
+                return d;
+        }
+
+        // Includes widths larger than the image
+        std::vector<size_t> widths_ = { 7, 13, 31, 40, 61, 95 };
+};
+
+TEST_F(Correlation_tests, direct_is_identical_to_the_original_convolution)
+{
+        std::mt19937 generator(1);
+        for (size_t w : widths_) {
+                // Arrange
+                Image mask;
+                Image expected;
+                Image out;
+                make_mask(mask, kWidth, kHeight, generator);
+                CorrelationKernels correlation(Correlation::kDirect);
+                float expected_avg = original_correlation(mask, correlation.bell(w),
+                                                          expected);
+
+                // Act
+                float avg = correlation.compute(mask, w, out);
+
+                //Assert
+                ASSERT_EQ(avg, expected_avg) << "w=" << w;
+                for (size_t i = 0; i < out.data().size(); i++)
+                        ASSERT_EQ(out.data()[i], expected.data()[i]) << "w=" << w << ", i=" << i;
+        }
+}
+
+TEST_F(Correlation_tests, direct_normalises_by_the_overlapping_area)
+{
+        std::mt19937 generator(2);
+        for (size_t w : widths_) {
+                // Arrange
+                Image mask;
+                Image out;
+                make_mask(mask, kWidth, kHeight, generator);
+                CorrelationKernels correlation(Correlation::kDirect);
+                Image& bell = correlation.bell(w);
+
+                // Act
+                correlation.compute(mask, w, out);
+
+                //Assert
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                double expected = brute_force(mask, w, (ssize_t) x, (ssize_t) y,
+                                                              [&](size_t u, size_t v) {
+                                                                      return bell.get(0, u, v);
+                                                              });
+                                ASSERT_NEAR(out.get(0, x, y), expected, 1e-5)
+                                        << "w=" << w << ", x=" << x << ", y=" << y;
+                        }
+                }
+        }
+}
+
+TEST_F(Correlation_tests, border_values_of_a_white_image_are_the_mean_of_the_visible_kernel)
+{
+        // Arrange
+        size_t w = 31;
+        size_t c = w / 2;
+        Image white(Image::BW, kWidth, kHeight);
+        white.fill(0, 1.0f);
+        CorrelationKernels correlation(Correlation::kDirect);
+        Image& bell = correlation.bell(w);
+        double corner = 0.0;
+        for (size_t v = c; v < w; v++)
+                for (size_t u = c; u < w; u++)
+                        corner += bell.get(0, u, v);
+        corner /= (double) ((w - c) * (w - c));
+
+        for (auto method : { Correlation::kDirect, Correlation::kFFT }) {
+                Image out;
+                Correlation engine(method);
+
+                // Act
+                engine.compute(white, w, out);
+
+                //Assert
+                ASSERT_NEAR(out.get(0, 0, 0), corner, 1e-6);
+                ASSERT_NEAR(out.get(0, kWidth - 1, kHeight - 1),
+                            brute_force(white, w, kWidth - 1, kHeight - 1,
+                                        [&](size_t u, size_t v) {
+                                                return bell.get(0, u, v);
+                                        }), 1e-6);
+        }
+}
+
+TEST_F(Correlation_tests, fft_matches_direct)
+{
+        std::mt19937 generator(3);
+        for (size_t w : widths_) {
+                // Arrange
+                Image mask;
+                Image expected;
+                Image out;
+                make_mask(mask, kWidth, kHeight, generator);
+                Correlation direct(Correlation::kDirect);
+                Correlation fft(Correlation::kFFT);
+                float expected_avg = direct.compute(mask, w, expected);
+
+                // Act
+                float avg = fft.compute(mask, w, out);
+
+                //Assert
+                ASSERT_LT(max_difference(out, expected), 1e-6) << "w=" << w;
+                ASSERT_NEAR(avg, expected_avg, 1e-6) << "w=" << w;
+        }
+}
+
+TEST_F(Correlation_tests, separable_matches_the_unclipped_gaussian)
+{
+        std::mt19937 generator(4);
+        for (size_t w : widths_) {
+                // Arrange
+                Image mask;
+                Image out;
+                make_mask(mask, kWidth, kHeight, generator);
+                CorrelationKernels correlation(Correlation::kSeparable);
+                const std::vector<float>& g = correlation.gaussian(w);
+
+                // Act
+                correlation.compute(mask, w, out);
+
+                //Assert
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                double expected = brute_force(mask, w, (ssize_t) x, (ssize_t) y,
+                                                              [&](size_t u, size_t v) {
+                                                                      return (double) g[u] * g[v];
+                                                              });
+                                ASSERT_NEAR(out.get(0, x, y), expected, 1e-5)
+                                        << "w=" << w << ", x=" << x << ", y=" << y;
+                        }
+                }
+        }
+}
+
+TEST_F(Correlation_tests, separable_is_close_to_direct)
+{
+        // The separable kernel keeps the corners outside the
+        // 3-sigma circle, where the weights are below exp(-4.5).
+        // kAuto uses it for the kernels narrower than kMinFFTWidth.
+        std::mt19937 generator(5);
+        for (size_t w : widths_) {
+                // Arrange
+                Image mask;
+                Image expected;
+                Image out;
+                make_mask(mask, kWidth, kHeight, generator);
+                Correlation direct(Correlation::kDirect);
+                Correlation separable(Correlation::kSeparable);
+                direct.compute(mask, w, expected);
+
+                // Act
+                separable.compute(mask, w, out);
+
+                //Assert
+                ASSERT_LT(max_difference(out, expected), 1e-3) << "w=" << w;
+        }
+}
+
+TEST_F(Correlation_tests, several_widths_keep_the_maximum_of_each_width)
+{
+        std::mt19937 generator(6);
+        std::vector<size_t> widths = { 13, 40, 61 };
+        for (auto method : { Correlation::kAuto, Correlation::kDirect,
+                                Correlation::kSeparable, Correlation::kFFT }) {
+                // Arrange
+                Image mask;
+                Image out;
+                Image expected;
+                make_mask(mask, kWidth, kHeight, generator);
+                Correlation reference(method);
+                reference.compute(mask, widths[0], expected);
+                for (size_t i = 1; i < widths.size(); i++) {
+                        Image single;
+                        reference.compute(mask, widths[i], single);
+                        for (size_t j = 0; j < single.data().size(); j++)
+                                expected.data()[j] = std::max(expected.data()[j],
+                                                              single.data()[j]);
+                }
+                Correlation correlation(method);
+
+                // Act
+                float avg = correlation.compute(mask, widths, out);
+
+                //Assert
+                // With the FFT, all widths share the spectrum of the
+                // image padded for the widest kernel, which changes
+                // the rounding.
+                double tolerance = (method == Correlation::kDirect
+                                    || method == Correlation::kSeparable)? 0.0 : 1e-6;
+                double sum = 0.0;
+                for (size_t i = 0; i < out.data().size(); i++) {
+                        ASSERT_NEAR(out.data()[i], expected.data()[i], tolerance)
+                                << "method " << method << ", i=" << i;
+                        sum += out.data()[i];
+                }
+                ASSERT_NEAR(avg, sum / (double) out.data().size(), 1e-6);
+        }
+}
+
+TEST_F(Correlation_tests, cached_kernels_follow_the_padded_size)
+{
+        std::mt19937 generator(7);
+        Image small;
+        Image large;
+        make_mask(small, kWidth, kHeight, generator);
+        make_mask(large, 3 * kWidth, 3 * kHeight, generator);
+
+        // Arrange
+        Correlation correlation(Correlation::kFFT);
+        Image first;
+        correlation.compute(small, 40, first);
+
+        // Act
+        // The larger image, then a wider kernel, change the size
+        // of the padded spectra for the cached kernel of width 40.
+        Image out_large;
+        Image out_wide;
+        Image second;
+        correlation.compute(large, 40, out_large);
+        correlation.compute(small, std::vector<size_t>{ 40, 95 }, out_wide);
+        correlation.compute(small, 40, second);
+
+        //Assert
+        Image expected_large;
+        Image expected_wide;
+        Correlation(Correlation::kFFT).compute(large, 40, expected_large);
+        Correlation(Correlation::kFFT).compute(small, std::vector<size_t>{ 40, 95 },
+                                               expected_wide);
+        ASSERT_EQ(max_difference(out_large, expected_large), 0.0);
+        ASSERT_EQ(max_difference(out_wide, expected_wide), 0.0);
+        ASSERT_EQ(max_difference(second, first), 0.0);
+}
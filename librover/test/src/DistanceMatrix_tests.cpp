@@ -0,0 +1,114 @@
+#include <atomic>
+#include <memory>
+
+#include "gtest/gtest.h"
+
+#include "constraintsolver/DistanceMatrix.h"
+
+using namespace romi;
+
+class DistanceMatrixIndex : public DistanceMatrix
+{
+public:
+        explicit DistanceMatrixIndex(size_t n) : DistanceMatrix(n) {}
+
+        size_t get_index(size_t i, size_t j) const {
+                return index(i, j);
+        }
+};
+
+class DistanceMatrix_tests : public ::testing::Test
+{
+protected:
+        DistanceMatrix_tests() = default;
+
+        ~DistanceMatrix_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        static int64_t value(size_t i, size_t j) {
+                return (int64_t) (i * 1000 + j);
+        }
+};
+
+TEST_F(DistanceMatrix_tests, index_enumerates_the_upper_triangle_row_by_row)
+{
+        const size_t sizes[] = { 2, 3, 7, 50 };
+        for (size_t n : sizes) {
+                // Arrange
+                DistanceMatrixIndex matrix(n);
+                size_t expected = 0;
+
+                for (size_t i = 0; i < n; i++) {
+                        for (size_t j = i + 1; j < n; j++) {
+                                // Act
+                                size_t index = matrix.get_index(i, j);
+
+                                //Assert
+                                ASSERT_EQ(index, expected) << "n " << n << ", pair "
+                                                           << i << ", " << j;
+                                expected++;
+                        }
+                }
+                ASSERT_EQ(expected, n * (n - 1) / 2);
+        }
+}
+
+TEST_F(DistanceMatrix_tests, fill_computes_each_pair_once)
+{
+        const size_t sizes[] = { 0, 1, 2, 3, 7, 50 };
+        const size_t threads[] = { 1, 2, 3, 8 };
+        for (size_t n : sizes) {
+                for (size_t count : threads) {
+                        // Arrange
+                        ThreadPool pool(count);
+                        DistanceMatrix matrix(n);
+                        std::unique_ptr<std::atomic<int>[]> calls(new std::atomic<int>[n * n + 1]);
+                        for (size_t k = 0; k < n * n; k++)
+                                calls[k] = 0;
+
+                        // Act
+                        matrix.fill(pool, [&](size_t i, size_t j) {
+                                        calls[i * n + j]++;
+                                        return value(i, j);
+                                });
+
+                        //Assert
+                        ASSERT_EQ(matrix.size(), n);
+                        for (size_t i = 0; i < n; i++) {
+                                for (size_t j = 0; j < n; j++) {
+                                        int expected_calls = (i < j)? 1 : 0;
+                                        ASSERT_EQ(calls[i * n + j].load(), expected_calls);
+                                        if (i == j)
+                                                ASSERT_EQ(matrix(i, j), 0);
+                                        else
+                                                ASSERT_EQ(matrix(i, j),
+                                                          value(std::min(i, j), std::max(i, j)));
+                                }
+                        }
+                }
+        }
+}
+
+TEST_F(DistanceMatrix_tests, segment_cost_is_the_length_or_the_crossing_cost)
+{
+        // Arrange
+        Image mask(Image::BW, 40, 40);
+        mask.fill(0, 0.0f);
+        mask.set(0, 20, 20, 1.0f);
+        DistanceTransform distances(mask);
+
+        // Act
+        int64_t clear = DistanceMatrix::segment_cost(v3(2.5, 2.5, 0.0), v3(32.5, 2.5, 0.0),
+                                                     distances);
+        int64_t crossing = DistanceMatrix::segment_cost(v3(2.5, 20.5, 0.0), v3(32.5, 20.5, 0.0),
+                                                        distances);
+
+        //Assert
+        ASSERT_EQ(clear, 30);
+        ASSERT_EQ(crossing, DistanceMatrix::kCrossingCost);
+}
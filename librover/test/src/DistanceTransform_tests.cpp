@@ -0,0 +1,230 @@
+#include <cmath>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "weeder/DistanceTransform.h"
+
+using namespace romi;
+
+class DistanceTransform_tests : public ::testing::Test
+{
+protected:
+        static constexpr size_t kWidth = 60;
+        static constexpr size_t kHeight = 45;
+
+        DistanceTransform_tests() = default;
+
+        ~DistanceTransform_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // A mask with a few round plants and isolated white pixels
+        static void make_mask(Image& mask, std::mt19937& generator) {
+                std::uniform_real_distribution<double> x(0.0, (double) kWidth);
+                std::uniform_real_distribution<double> y(0.0, (double) kHeight);
+                std::uniform_real_distribution<double> r(0.5, 6.0);
+                mask.init(Image::BW, kWidth, kHeight);
+                mask.fill(0, 0.0f);
+                for (int plant = 0; plant < 4; plant++) {
+                        double xc = x(generator);
+                        double yc = y(generator);
+                        double radius = r(generator);
+                        for (size_t yi = 0; yi < kHeight; yi++) {
+                                for (size_t xi = 0; xi < kWidth; xi++) {
+                                        if (std::hypot((double) xi - xc, (double) yi - yc) <= radius)
+                                                mask.set(0, xi, yi, 1.0f);
+                                }
+                        }
+                }
+                for (int dot = 0; dot < 3; dot++)
+                        mask.set(0, (size_t) x(generator), (size_t) y(generator), 1.0f);
+        }
+
+        // The distance to the nearest white pixel, by brute force
+        static std::vector<double> brute_force(Image& mask) {
+                std::vector<double> distances(kWidth * kHeight, 1e20);
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                for (size_t v = 0; v < kHeight; v++) {
+                                        for (size_t u = 0; u < kWidth; u++) {
+                                                if (mask.get(0, u, v) <= 0.0f)
+                                                        continue;
+                                                double d = std::hypot((double) x - (double) u,
+                                                                      (double) y - (double) v);
+                                                double& current = distances[y * kWidth + x];
+                                                current = std::min(current, d);
+                                        }
+                                }
+                        }
+                }
+                return distances;
+        }
+
+        // Whether the segment passes through the pixel [x,x+1[ x
+        // [y,y+1[, by clipping the segment to the square
+        static bool segment_crosses_pixel(v3 p0, v3 p1, double x, double y) {
+                double t0 = 0.0;
+                double t1 = 1.0;
+                double d[2] = { p1.x() - p0.x(), p1.y() - p0.y() };
+                double p[2] = { p0.x(), p0.y() };
+                double low[2] = { x, y };
+                for (int axis = 0; axis < 2; axis++) {
+                        if (d[axis] == 0.0) {
+                                if (p[axis] < low[axis] || p[axis] >= low[axis] + 1.0)
+                                        return false;
+                                continue;
+                        }
+                        double a = (low[axis] - p[axis]) / d[axis];
+                        double b = (low[axis] + 1.0 - p[axis]) / d[axis];
+                        t0 = std::max(t0, std::min(a, b));
+                        t1 = std::min(t1, std::max(a, b));
+                }
+                return t0 < t1;
+        }
+
+        // The rasterised check: the segment is clear when none of
+        // the pixels it passes through is within the radius of a
+        // white pixel.
+        static bool reference_is_clear(std::vector<double>& distances,
+                                       v3 p0, v3 p1, double radius) {
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                if (distances[y * kWidth + x] <= radius
+                                    && segment_crosses_pixel(p0, p1, (double) x, (double) y))
+                                        return false;
+                        }
+                }
+                return true;
+        }
+};
+
+TEST_F(DistanceTransform_tests, distances_are_identical_to_brute_force)
+{
+        std::mt19937 generator(1);
+        auto pool = std::make_shared<ThreadPool>(3);
+        for (int i = 0; i < 5; i++) {
+                // Arrange
+                Image mask;
+                make_mask(mask, generator);
+                std::vector<double> expected = brute_force(mask);
+
+                // Act
+                DistanceTransform distances(mask, pool);
+
+                //Assert
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                ASSERT_NEAR(distances.distance(x, y),
+                                            expected[y * kWidth + x], 1e-5)
+                                        << "pixel " << x << ", " << y;
+                        }
+                }
+        }
+}
+
+TEST_F(DistanceTransform_tests, empty_mask_is_clear_everywhere)
+{
+        // Arrange
+        Image mask(Image::BW, kWidth, kHeight);
+        mask.fill(0, 0.0f);
+
+        // Act
+        DistanceTransform distances(mask);
+
+        //Assert
+        ASSERT_GT(distances.distance((size_t) 0, (size_t) 0), (double) (kWidth + kHeight));
+        ASSERT_TRUE(distances.segment_is_clear(v3(0.5, 0.5, 0.0),
+                                               v3(59.5, 44.5, 0.0), 10.0));
+}
+
+TEST_F(DistanceTransform_tests, segment_is_clear_agrees_with_the_rasterised_check)
+{
+        std::mt19937 generator(2);
+        std::uniform_real_distribution<double> x(0.0, (double) kWidth);
+        std::uniform_real_distribution<double> y(0.0, (double) kHeight);
+        std::uniform_real_distribution<double> r(0.0, 8.0);
+        int clear = 0;
+        int blocked = 0;
+        
+        for (int i = 0; i < 5; i++) {
+                // Arrange
+                Image mask;
+                make_mask(mask, generator);
+                std::vector<double> expected = brute_force(mask);
+                DistanceTransform distances(mask);
+                
+                for (int j = 0; j < 400; j++) {
+                        v3 p0(x(generator), y(generator), 0.0);
+                        v3 p1(x(generator), y(generator), 0.0);
+                        // Half of the radii are just above or just
+                        // below the clearance of the segment
+                        double radius = r(generator);
+                        if (j % 2 == 0) {
+                                double min_distance = 1e20;
+                                for (size_t v = 0; v < kHeight; v++) {
+                                        for (size_t u = 0; u < kWidth; u++) {
+                                                if (segment_crosses_pixel(p0, p1, (double) u,
+                                                                          (double) v))
+                                                        min_distance = std::min(min_distance,
+                                                                                expected[v * kWidth + u]);
+                                        }
+                                }
+                                radius = min_distance + ((j % 4 == 0)? 1e-3 : -1e-3);
+                        }
+                        bool reference = reference_is_clear(expected, p0, p1, radius);
+
+                        // Act
+                        bool result = distances.segment_is_clear(p0, p1, radius);
+
+                        //Assert
+                        ASSERT_EQ(result, reference)
+                                << "segment (" << p0.x() << ", " << p0.y() << ") - ("
+                                << p1.x() << ", " << p1.y() << "), radius " << radius;
+                        if (result)
+                                clear++;
+                        else
+                                blocked++;
+                }
+        }
+        ASSERT_GT(clear, 100);
+        ASSERT_GT(blocked, 100);
+}
+
+TEST_F(DistanceTransform_tests, segment_clearance_is_the_smallest_distance_along_the_segment)
+{
+        std::mt19937 generator(3);
+        std::uniform_real_distribution<double> x(0.0, (double) kWidth);
+        std::uniform_real_distribution<double> y(0.0, (double) kHeight);
+        
+        for (int i = 0; i < 3; i++) {
+                // Arrange
+                Image mask;
+                make_mask(mask, generator);
+                std::vector<double> expected = brute_force(mask);
+                DistanceTransform distances(mask);
+                
+                for (int j = 0; j < 100; j++) {
+                        v3 p0(x(generator), y(generator), 0.0);
+                        v3 p1(x(generator), y(generator), 0.0);
+                        double min_distance = 1e20;
+                        for (size_t v = 0; v < kHeight; v++) {
+                                for (size_t u = 0; u < kWidth; u++) {
+                                        if (segment_crosses_pixel(p0, p1, (double) u, (double) v))
+                                                min_distance = std::min(min_distance,
+                                                                        expected[v * kWidth + u]);
+                                }
+                        }
+
+                        // Act
+                        double clearance = distances.segment_clearance(p0, p1);
+
+                        //Assert
+                        ASSERT_NEAR(clearance, min_distance, 1e-5);
+                }
+        }
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "weeder/ObstacleGrid.h"
+
+using namespace romi;
+
+class ObstacleGrid_tests : public ::testing::Test
+{
+protected:
+        ObstacleGrid_tests() = default;
+
+        ~ObstacleGrid_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // A mask with a few white blobs and isolated white pixels
+        static void make_mask(Image& mask, size_t width, size_t height,
+                              std::mt19937& generator) {
+                std::uniform_int_distribution<size_t> x(0, width - 1);
+                std::uniform_int_distribution<size_t> y(0, height - 1);
+                std::uniform_int_distribution<int> size(1, 20);
+                std::uniform_real_distribution<float> value(0.01f, 1.0f);
+                mask.init(Image::BW, width, height);
+                mask.fill(0, 0.0f);
+                for (int blob = 0; blob < 6; blob++) {
+                        size_t x0 = x(generator);
+                        size_t y0 = y(generator);
+                        int w = size(generator);
+                        int h = size(generator);
+                        for (size_t yi = y0; yi < std::min(height, y0 + (size_t) h); yi++)
+                                for (size_t xi = x0; xi < std::min(width, x0 + (size_t) w); xi++)
+                                        mask.set(0, xi, yi, 1.0f);
+                }
+                for (int dot = 0; dot < 10; dot++)
+                        mask.set(0, x(generator), y(generator), value(generator));
+        }
+
+        // The cells of the original implementation: the sum over a
+        // block of d x d pixels centred on every d-th pixel.
+        static std::vector<uint8_t> reference_cells(Image& mask, int d) {
+                int w = (int) mask.width();
+                int h = (int) mask.height();
+                int d2 = d / 2;
+                float *data = mask.data().data();
+                std::vector<uint8_t> cells((size_t) ((w / d) * (h / d)), 0);
+                for (int y = d2; y < h - d2; y += d) {
+                        for (int x = d2; x < w - d2; x += d) {
+                                int off = y * w + x;
+                                float sum = 0.0f;
+                                for (int j = -d2; j <= d2; j++) {
+                                        int offy = off + j * w;
+                                        for (int i = -d2; i <= d2; i++)
+                                                sum += data[offy + i];
+                                }
+                                if (sum > 0.0f)
+                                        cells[(size_t) ((y / d) * (w / d) + x / d)] = 1;
+                        }
+                }
+                return cells;
+        }
+};
+
+TEST_F(ObstacleGrid_tests, cells_are_identical_to_the_original_sums)
+{
+        std::mt19937 generator(1);
+        const size_t resolutions[] = { 25, 7, 1 };
+        const size_t sizes[][2] = { { 400, 300 }, { 413, 298 }, { 99, 151 } };
+
+        for (size_t resolution : resolutions) {
+                for (auto& size : sizes) {
+                        // Arrange
+                        Image mask;
+                        make_mask(mask, size[0], size[1], generator);
+                        std::vector<uint8_t> expected = reference_cells(mask, (int) resolution);
+                        size_t width = size[0] / resolution;
+                        size_t height = size[1] / resolution;
+
+                        // Act
+                        ObstacleGrid grid(mask, resolution);
+
+                        //Assert
+                        for (size_t y = 0; y < height; y++) {
+                                for (size_t x = 0; x < width; x++) {
+                                        ASSERT_EQ(grid.is_occupied(x, y),
+                                                  expected[y * width + x] != 0)
+                                                << "resolution " << resolution
+                                                << ", cell " << x << ", " << y;
+                                }
+                        }
+                        ASSERT_FALSE(grid.is_occupied(width, 0));
+                        ASSERT_FALSE(grid.is_occupied(0, height));
+                }
+        }
+}
+
+TEST_F(ObstacleGrid_tests, grid_is_built_on_first_use)
+{
+        // Arrange
+        std::mt19937 generator(2);
+        Image mask;
+        make_mask(mask, 100, 100, generator);
+        ObstacleGrid grid(mask, 25);
+
+        // Act
+        bool before = grid.is_initialized();
+        grid.generator();
+
+        //Assert
+        ASSERT_FALSE(before);
+        ASSERT_TRUE(grid.is_initialized());
+}
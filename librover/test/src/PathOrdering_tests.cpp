@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "weeder/PathOrdering.h"
+
+using namespace romi;
+
+class GreedyPathOrdering : public PathOrdering
+{
+public:
+        explicit GreedyPathOrdering(v3 home) : PathOrdering(home) {}
+
+        // The paths in the nearest-neighbour order, before the
+        // local search
+        std::vector<Path> greedy(const std::vector<Path>& paths) const {
+                std::vector<Path> ordered;
+                for (auto& leg : solve_greedy(paths)) {
+                        ordered.push_back(paths[leg.path]);
+                        if (leg.reversed)
+                                std::reverse(ordered.back().begin(), ordered.back().end());
+                }
+                return ordered;
+        }
+};
+
+class PathOrdering_tests : public ::testing::Test
+{
+protected:
+        v3 home;
+        
+        PathOrdering_tests() : home(0.0, 500.0, 0.0) {
+        }
+
+        ~PathOrdering_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // Short open paths of two to four points
+        static std::vector<Path> random_paths(std::mt19937& generator, size_t n) {
+                std::uniform_real_distribution<double> coordinate(0.0, 500.0);
+                std::uniform_real_distribution<double> step(-40.0, 40.0);
+                std::uniform_int_distribution<int> length(2, 4);
+                std::vector<Path> paths(n);
+                for (auto& path : paths) {
+                        double x = coordinate(generator);
+                        double y = coordinate(generator);
+                        for (int i = length(generator); i > 0; i--) {
+                                path.emplace_back(x, y, 0.0);
+                                x += step(generator);
+                                y += step(generator);
+                        }
+                }
+                return paths;
+        }
+
+        // The shortest transfer over all the orders and directions
+        double shortest_transfer(const PathOrdering& ordering,
+                                 const std::vector<Path>& paths) {
+                size_t n = paths.size();
+                std::vector<size_t> order(n);
+                for (size_t i = 0; i < n; i++)
+                        order[i] = i;
+                double best = std::numeric_limits<double>::infinity();
+                do {
+                        for (size_t directions = 0; directions < (1u << n); directions++) {
+                                std::vector<Path> candidate;
+                                for (size_t i = 0; i < n; i++) {
+                                        candidate.push_back(paths[order[i]]);
+                                        if (directions & (1u << i))
+                                                std::reverse(candidate.back().begin(),
+                                                             candidate.back().end());
+                                }
+                                best = std::min(best, ordering.transfer_length(candidate));
+                        }
+                } while (std::next_permutation(order.begin(), order.end()));
+                return best;
+        }
+
+        static bool same_points(const Path& a, const Path& b) {
+                if (a.size() != b.size())
+                        return false;
+                for (size_t i = 0; i < a.size(); i++) {
+                        if (a[i].x() != b[i].x() || a[i].y() != b[i].y())
+                                return false;
+                }
+                return true;
+        }
+
+        // Every original path appears once, possibly reversed
+        static void assert_same_paths(const std::vector<Path>& original,
+                                      const std::vector<Path>& ordered) {
+                ASSERT_EQ(ordered.size(), original.size());
+                std::vector<bool> used(ordered.size(), false);
+                for (auto& path : original) {
+                        Path reversed = path;
+                        std::reverse(reversed.begin(), reversed.end());
+                        bool found = false;
+                        for (size_t i = 0; i < ordered.size() && !found; i++) {
+                                if (!used[i] && (same_points(ordered[i], path)
+                                                 || same_points(ordered[i], reversed))) {
+                                        used[i] = true;
+                                        found = true;
+                                }
+                        }
+                        ASSERT_TRUE(found);
+                }
+        }
+};
+
+TEST_F(PathOrdering_tests, exact_order_is_the_shortest)
+{
+        std::mt19937 generator(1);
+        PathOrdering ordering(home);
+        for (size_t n = 2; n <= 6; n++) {
+                for (int i = 0; i < 5; i++) {
+                        // Arrange
+                        std::vector<Path> paths = random_paths(generator, n);
+                        std::vector<Path> original = paths;
+                        double expected = shortest_transfer(ordering, paths);
+
+                        // Act
+                        ordering.order(paths);
+
+                        //Assert
+                        assert_same_paths(original, paths);
+                        ASSERT_NEAR(ordering.transfer_length(paths), expected, 1e-6);
+                }
+        }
+}
+
+TEST_F(PathOrdering_tests, local_search_improves_the_greedy_order)
+{
+        std::mt19937 generator(2);
+        GreedyPathOrdering ordering(home);
+        const size_t sizes[] = { PathOrdering::kMaxExact + 1, 30, 100 };
+        int improved = 0;
+        
+        for (size_t n : sizes) {
+                for (int i = 0; i < 5; i++) {
+                        // Arrange
+                        std::vector<Path> paths = random_paths(generator, n);
+                        std::vector<Path> original = paths;
+                        double greedy = ordering.transfer_length(ordering.greedy(paths));
+                        double initial = ordering.transfer_length(paths);
+
+                        // Act
+                        ordering.order(paths);
+
+                        //Assert
+                        double length = ordering.transfer_length(paths);
+                        assert_same_paths(original, paths);
+                        ASSERT_LE(length, greedy + 1e-9);
+                        ASSERT_LE(length, initial + 1e-9);
+                        if (length < greedy - 1e-9)
+                                improved++;
+                }
+        }
+        ASSERT_GT(improved, 0);
+}
+
+TEST_F(PathOrdering_tests, empty_paths_are_removed)
+{
+        // Arrange
+        std::mt19937 generator(3);
+        std::vector<Path> paths = random_paths(generator, 3);
+        paths.insert(paths.begin() + 1, Path());
+        paths.emplace_back();
+
+        // Act
+        PathOrdering(home).order(paths);
+
+        //Assert
+        ASSERT_EQ(paths.size(), 3u);
+        for (auto& path : paths)
+                ASSERT_FALSE(path.empty());
+}
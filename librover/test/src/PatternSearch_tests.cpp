@@ -0,0 +1,169 @@
+#include <cmath>
+#include <memory>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "quincunx/PatternSearch.h"
+
+using namespace romi;
+
+class PatternSearch_tests : public ::testing::Test
+{
+protected:
+        // Large enough for the pyramid to be used
+        static constexpr int kDistancePlants = 72;
+        static constexpr int kDistanceRows = 64;
+        static constexpr size_t kWidth = 3 * kDistanceRows + 40;
+        static constexpr size_t kHeight = 4 * kDistancePlants + 20;
+
+        PatternSearch_tests() = default;
+
+        ~PatternSearch_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // The scan of the original implementation
+        static float reference_search(Image& map, int dp, int dr, int& x_max, int& y_max) {
+                float p_max = -1.0f;
+                x_max = 0;
+                y_max = 0;
+                for (int y = 0; y < dp + 1; y++) {
+                        for (int x = 0; x < dr + 1; x++) {
+                                float v = (get(map, x, y)
+                                           + get(map, x, y + dp)
+                                           + get(map, x, y + 2 * dp)
+                                           + get(map, x + dr, y - dp / 2)
+                                           + get(map, x + dr, y - dp / 2 + dp)
+                                           + get(map, x + dr, y - dp / 2 + 2 * dp)
+                                           + get(map, x + dr, y - dp / 2 + 3 * dp)
+                                           + get(map, x + 2 * dr, y)
+                                           + get(map, x + 2 * dr, y + dp)
+                                           + get(map, x + 2 * dr, y + 2 * dp));
+                                if (v > p_max) {
+                                        p_max = v;
+                                        x_max = x;
+                                        y_max = y;
+                                }
+                        }
+                }
+                return p_max;
+        }
+
+        static float get(Image& map, int x, int y) {
+                if (x < 0 || y < 0)
+                        return 0.0f;
+                return map.get(0, (size_t) x, (size_t) y);
+        }
+
+        // A smooth map with bells at the plant positions of the
+        // pattern at offset (x0, y0), as the correlation produces
+        static void make_field(Image& map, int x0, int y0, float sigma) {
+                map.init(Image::BW, kWidth, kHeight);
+                map.fill(0, 0.0f);
+                for (int row = -1; row < 4; row++) {
+                        int dy = (row % 2 == 0)? 0 : -kDistancePlants / 2;
+                        for (int plant = -1; plant < 5; plant++) {
+                                add_bell(map, (float) (x0 + row * kDistanceRows),
+                                         (float) (y0 + dy + plant * kDistancePlants),
+                                         sigma);
+                        }
+                }
+        }
+
+        static void add_bell(Image& map, float xc, float yc, float sigma) {
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                float dx = (float) x - xc;
+                                float dy = (float) y - yc;
+                                float v = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+                                map.set(0, x, y, map.get(0, x, y) + v);
+                        }
+                }
+        }
+
+        static void make_noise(Image& map, std::mt19937& generator) {
+                std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+                map.init(Image::BW, kWidth, kHeight);
+                for (auto& v : map.data())
+                        v = uniform(generator);
+        }
+};
+
+TEST_F(PatternSearch_tests, exhaustive_search_is_identical_to_original_scan)
+{
+        // Arrange
+        std::mt19937 generator(1);
+        Image map;
+        make_noise(map, generator);
+        PatternSearch search(PatternSearch::kExhaustive, std::make_shared<ThreadPool>(3));
+        int x_expected;
+        int y_expected;
+        float expected = reference_search(map, kDistancePlants, kDistanceRows,
+                                          x_expected, y_expected);
+        point_t pos;
+
+        // Act
+        float p_max = search.estimate(map, (float) kDistancePlants, (float) kDistanceRows, pos);
+
+        //Assert
+        ASSERT_EQ(p_max, expected);
+        ASSERT_EQ((int) pos.x, x_expected);
+        ASSERT_EQ((int) pos.y, y_expected);
+}
+
+TEST_F(PatternSearch_tests, default_search_is_exhaustive)
+{
+        // Arrange
+        std::mt19937 generator(2);
+        Image map;
+        make_noise(map, generator);
+        PatternSearch search;
+        int x_expected;
+        int y_expected;
+        float expected = reference_search(map, kDistancePlants, kDistanceRows,
+                                          x_expected, y_expected);
+        point_t pos;
+
+        // Act
+        float p_max = search.estimate(map, (float) kDistancePlants, (float) kDistanceRows, pos);
+
+        //Assert
+        ASSERT_EQ(p_max, expected);
+        ASSERT_EQ((int) pos.x, x_expected);
+        ASSERT_EQ((int) pos.y, y_expected);
+}
+
+TEST_F(PatternSearch_tests, pyramid_and_exhaustive_agree_on_smooth_fields)
+{
+        // Arrange
+        std::mt19937 generator(3);
+        std::uniform_int_distribution<int> offset_x(0, kDistanceRows);
+        std::uniform_int_distribution<int> offset_y(0, kDistancePlants);
+        auto pool = std::make_shared<ThreadPool>(2);
+        PatternSearch exhaustive(PatternSearch::kExhaustive, pool);
+        PatternSearch pyramid(PatternSearch::kPyramid, pool);
+
+        for (int i = 0; i < 10; i++) {
+                Image map;
+                make_field(map, offset_x(generator), offset_y(generator),
+                           (float) kDistancePlants / 8.0f);
+                point_t expected;
+                point_t pos;
+
+                // Act
+                float p_expected = exhaustive.estimate(map, (float) kDistancePlants,
+                                                       (float) kDistanceRows, expected);
+                float p_max = pyramid.estimate(map, (float) kDistancePlants,
+                                               (float) kDistanceRows, pos);
+
+                //Assert
+                ASSERT_EQ(p_max, p_expected);
+                ASSERT_EQ(pos.x, expected.x);
+                ASSERT_EQ(pos.y, expected.y);
+        }
+}
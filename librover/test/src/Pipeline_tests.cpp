@@ -0,0 +1,391 @@
+#include <atomic>
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "mock_session.h"
+
+#include "weeder/Pipeline.h"
+
+using namespace romi;
+using namespace testing;
+
+class FakeCropper : public IImageCropper
+{
+public:
+        static constexpr double kMetersToPixels = 1000.0;
+
+        bool crop(ISession&, Image& camera, double, Image& crop) override {
+                crop = camera;
+                return true;
+        }
+
+        double map_meters_to_pixels(double meters) override {
+                return kMetersToPixels * meters;
+        }
+};
+
+// The camera image is already the mask
+class FakeSegmentation : public IImageSegmentation
+{
+public:
+        bool create_mask(ISession&, Image& image, Image& mask) override {
+                mask = image;
+                return true;
+        }
+};
+
+class CountingComponents : public IConnectedComponents
+{
+public:
+        std::atomic<int>& calls_;
+
+        explicit CountingComponents(std::atomic<int>& calls) : calls_(calls) {}
+
+        void compute(ISession&, Image& mask, Image& components) override {
+                calls_++;
+                components = mask;
+        }
+};
+
+/* Traces a horizontal line through the first center, or through
+ * the middle of the mask when it is given no centers. */
+class FakePlanner : public IPathPlanner
+{
+public:
+        std::atomic<int>& calls_;
+        bool needs_centers_;
+        bool thread_safe_;
+
+        FakePlanner(std::atomic<int>& calls, bool needs_centers, bool thread_safe)
+                : calls_(calls), needs_centers_(needs_centers), thread_safe_(thread_safe) {
+        }
+
+        Path trace_path(ISession&, Centers& centers, Image& mask) override {
+                calls_++;
+                double y = (double) mask.height() / 2.0;
+                if (!centers.empty())
+                        y = (double) centers.front().second;
+                Path path;
+                path.emplace_back(10.0, y, 0.0);
+                path.emplace_back((double) mask.width() - 10.0, y, 0.0);
+                return path;
+        }
+
+        bool needs_centers() override {
+                return needs_centers_;
+        }
+
+        bool is_thread_safe() override {
+                return thread_safe_;
+        }
+};
+
+class PipelineSimplifier : public Pipeline
+{
+public:
+        PipelineSimplifier(std::unique_ptr<IImageCropper> cropper = nullptr,
+                           std::unique_ptr<IImageSegmentation> segmentation = nullptr,
+                           std::unique_ptr<IConnectedComponents> components = nullptr,
+                           std::unique_ptr<IPathPlanner> planner = nullptr)
+                : Pipeline(cropper, segmentation, components, planner) {
+        }
+
+        void simplify(DistanceTransform& distances, double clearance,
+                      double tool_radius, double tolerance, Path& path) {
+                simplify_path(distances, clearance, tool_radius, tolerance, path);
+        }
+};
+
+class PipelineDetours : public Pipeline
+{
+public:
+        explicit PipelineDetours(std::shared_ptr<ThreadPool> pool,
+                                 std::unique_ptr<IImageCropper> cropper = nullptr,
+                                 std::unique_ptr<IImageSegmentation> segmentation = nullptr,
+                                 std::unique_ptr<IConnectedComponents> components = nullptr,
+                                 std::unique_ptr<IPathPlanner> planner = nullptr)
+                : Pipeline(cropper, segmentation, components, planner, pool) {
+        }
+
+        // Replaces the segments that cross a plant by detours
+        void reroute(DistanceTransform& distances, double clearance, double tool_radius,
+                     ObstacleGrid& obstacles, Path& path,
+                     std::vector<size_t>& crossings, std::vector<Path>& paths) {
+                std::vector<Path> detours;
+                find_crossings(distances, clearance, path, crossings);
+                find_detours(distances, clearance, tool_radius, obstacles, path,
+                             crossings, detours);
+                splice_detours(path, crossings, detours, paths);
+        }
+
+        // The smoothed detour from start to end, and the staircase
+        // through the centers of the A* cells that it replaces
+        Path detour(DistanceTransform& distances, double clearance, double tool_radius,
+                    ObstacleGrid& obstacles, v3 start, v3 end, Path& staircase) {
+                AStar::CoordinateList cells = go_around(obstacles.generator(), start, end);
+                staircase.emplace_back(start);
+                for (size_t j = cells.size() - 1; j-- > 1; )
+                        staircase.emplace_back(25.0 * cells[j].x + 12.0,
+                                               25.0 * cells[j].y + 12.0, 0.0);
+                staircase.emplace_back(end);
+                return smooth_detour(distances, clearance, tool_radius, start, end, cells);
+        }
+};
+
+class PipelineTracer : public Pipeline
+{
+public:
+        PipelineTracer(std::shared_ptr<ThreadPool> pool,
+                       std::unique_ptr<IPathPlanner> planner,
+                       std::unique_ptr<IImageCropper> cropper = nullptr,
+                       std::unique_ptr<IImageSegmentation> segmentation = nullptr,
+                       std::unique_ptr<IConnectedComponents> components = nullptr)
+                : Pipeline(cropper, segmentation, components, planner, pool) {
+        }
+
+        std::vector<Path> trace(ISession& session, std::vector<Centers>& component_centers,
+                                Image& mask) {
+                return trace_paths(session, component_centers, mask);
+        }
+};
+
+class Pipeline_tests : public ::testing::Test
+{
+protected:
+        static constexpr size_t kWidth = 200;
+        static constexpr size_t kHeight = 200;
+        static constexpr double kPlantRadius = 10.0;
+        static constexpr double kToolRadius = 12.0;
+
+        Image mask;
+        
+        Pipeline_tests() : mask(Image::BW, kWidth, kHeight) {
+        }
+
+        ~Pipeline_tests() override = default;
+
+        void SetUp() override {
+                mask.fill(0, 0.0f);
+        }
+
+        void TearDown() override {
+        }
+
+        void add_plant(double xc, double yc) {
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                if (std::hypot((double) x - xc, (double) y - yc) <= kPlantRadius)
+                                        mask.set(0, x, y, 1.0f);
+                        }
+                }
+        }
+
+        // An arc of the given radius around (xc, yc), sampled
+        // every two pixels, as the quincunx planner traces them
+        static void add_arc(Path& path, double xc, double yc, double radius,
+                            double from, double to) {
+                int n = (int) (std::fabs(to - from) * radius / 2.0);
+                for (int i = 0; i <= n; i++) {
+                        double angle = from + (to - from) * i / n;
+                        path.emplace_back(xc + radius * std::cos(angle),
+                                          yc + radius * std::sin(angle), 0.0);
+                }
+        }
+
+        static double path_clearance(DistanceTransform& distances, Path& path) {
+                double clearance = 1e20;
+                for (size_t k = 0; k + 1 < path.size(); k++)
+                        clearance = std::min(clearance,
+                                             distances.segment_clearance(path[k], path[k+1]));
+                return clearance;
+        }
+};
+
+TEST_F(Pipeline_tests, simplification_keeps_the_arcs_around_the_plants)
+{
+        // Arrange
+        add_plant(70.0, 100.0);
+        add_plant(130.0, 100.0);
+        DistanceTransform distances(mask);
+        Path path;
+        add_arc(path, 70.0, 100.0, kPlantRadius + kToolRadius + 2.0, M_PI, 0.0);
+        add_arc(path, 130.0, 100.0, kPlantRadius + kToolRadius + 2.0, M_PI, 2.0 * M_PI);
+        double before = path_clearance(distances, path);
+        size_t size = path.size();
+        PipelineSimplifier pipeline;
+
+        // Act
+        pipeline.simplify(distances, 0.0, kToolRadius, 8.0, path);
+
+        //Assert
+        ASSERT_LT(path.size(), size);
+        ASSERT_GE(path_clearance(distances, path), std::min(before, kToolRadius));
+}
+
+TEST_F(Pipeline_tests, simplification_never_brings_the_path_closer_than_it_was)
+{
+        // Arrange
+        add_plant(100.0, 100.0);
+        DistanceTransform distances(mask);
+        Path path;
+        // The arc is closer to the plant than the tool radius
+        add_arc(path, 100.0, 100.0, kPlantRadius + 6.0, M_PI, 2.0 * M_PI);
+        double before = path_clearance(distances, path);
+        size_t size = path.size();
+        PipelineSimplifier pipeline;
+
+        // Act
+        pipeline.simplify(distances, 0.0, kToolRadius, 8.0, path);
+
+        //Assert
+        ASSERT_LT(path.size(), size);
+        ASSERT_GE(path_clearance(distances, path), before);
+}
+
+TEST_F(Pipeline_tests, straight_runs_are_reduced_to_their_ends)
+{
+        // Arrange
+        add_plant(100.0, 30.0);
+        DistanceTransform distances(mask);
+        Path path;
+        for (int i = 0; i <= 80; i++)
+                path.emplace_back(20.0 + 2.0 * i, 150.0 + ((i % 2)? 0.5 : -0.5), 0.0);
+        PipelineSimplifier pipeline;
+
+        // Act
+        pipeline.simplify(distances, 0.0, kToolRadius, 2.0, path);
+
+        //Assert
+        ASSERT_EQ(path.size(), 2u);
+        ASSERT_EQ(path.front().x(), 20.0);
+        ASSERT_EQ(path.back().x(), 180.0);
+}
+
+TEST_F(Pipeline_tests, a_planner_without_centers_is_called_once_on_the_mask)
+{
+        // Arrange
+        NiceMock<MockSession> session;
+        std::atomic<int> components_calls(0);
+        std::atomic<int> planner_calls(0);
+        std::unique_ptr<IImageCropper> cropper = std::make_unique<FakeCropper>();
+        std::unique_ptr<IImageSegmentation> segmentation
+                = std::make_unique<FakeSegmentation>();
+        std::unique_ptr<IConnectedComponents> components
+                = std::make_unique<CountingComponents>(components_calls);
+        std::unique_ptr<IPathPlanner> planner
+                = std::make_unique<FakePlanner>(planner_calls, false, false);
+        Pipeline pipeline(cropper, segmentation, components, planner);
+
+        // Act
+        std::vector<Path> paths = pipeline.run(session, mask, 0.01);
+
+        //Assert
+        ASSERT_EQ(components_calls, 0);
+        ASSERT_EQ(planner_calls, 1);
+        ASSERT_EQ(paths.size(), 1u);
+        ASSERT_EQ(paths[0].size(), 2u);
+}
+
+TEST_F(Pipeline_tests, detours_do_not_depend_on_the_number_of_threads)
+{
+        // Arrange
+        // The plants and the corners of the path are placed in
+        // different cells of the 25-pixel A* grid.
+        add_plant(37.0, 112.0);
+        add_plant(112.0, 112.0);
+        add_plant(162.0, 112.0);
+        add_plant(87.0, 187.0);
+        DistanceTransform distances(mask);
+        Path path;
+        path.emplace_back(12.0, 112.0, 0.0);
+        path.emplace_back(75.0, 112.0, 0.0);
+        path.emplace_back(140.0, 112.0, 0.0);
+        path.emplace_back(190.0, 112.0, 0.0);
+        path.emplace_back(190.0, 187.0, 0.0);
+        path.emplace_back(12.0, 187.0, 0.0);
+        std::vector<std::vector<Path>> results;
+
+        for (size_t threads : { 1, 4 }) {
+                ObstacleGrid obstacles(mask, 25, false);
+                PipelineDetours pipeline(std::make_shared<ThreadPool>(threads));
+                std::vector<size_t> crossings;
+                std::vector<Path> paths;
+
+                // Act
+                pipeline.reroute(distances, kToolRadius, kToolRadius, obstacles, path,
+                                 crossings, paths);
+
+                //Assert
+                ASSERT_EQ(crossings.size(), 4u);
+                ASSERT_EQ(paths.size(), 1u);
+                ASSERT_GT(paths[0].size(), path.size());
+                results.push_back(paths);
+        }
+
+        const Path& serial = results[0][0];
+        const Path& parallel = results[1][0];
+        ASSERT_EQ(serial.size(), parallel.size());
+        for (size_t i = 0; i < serial.size(); i++) {
+                ASSERT_EQ(serial[i].x(), parallel[i].x());
+                ASSERT_EQ(serial[i].y(), parallel[i].y());
+        }
+}
+
+TEST_F(Pipeline_tests, detours_keep_as_far_from_the_plants_as_the_staircase)
+{
+        // Arrange
+        add_plant(121.0, 101.0);
+        DistanceTransform distances(mask);
+        ObstacleGrid obstacles(mask, 25, false);
+        PipelineDetours pipeline(std::make_shared<ThreadPool>(1));
+        Path staircase;
+        
+        // Act
+        // Without a clearance, the longest chords that miss the
+        // plant would graze it.
+        Path detour = pipeline.detour(distances, 0.0, kToolRadius, obstacles,
+                                      v3(106.0, 18.0, 0.0), v3(116.0, 178.0, 0.0),
+                                      staircase);
+
+        //Assert
+        double before = path_clearance(distances, staircase);
+        ASSERT_GT(before, kToolRadius);
+        ASSERT_LT(detour.size(), staircase.size());
+        ASSERT_GE(path_clearance(distances, detour), kToolRadius - 1e-6);
+}
+
+TEST_F(Pipeline_tests, components_are_traced_in_order_whatever_the_number_of_threads)
+{
+        // Arrange
+        NiceMock<MockSession> session;
+        std::vector<Centers> component_centers(12);
+        for (size_t i = 0; i < component_centers.size(); i++)
+                component_centers[i].emplace_back(100, 10 + 15 * i);
+        std::vector<std::vector<Path>> results;
+
+        for (size_t threads : { 1, 4 }) {
+                std::atomic<int> planner_calls(0);
+                std::unique_ptr<IPathPlanner> planner
+                        = std::make_unique<FakePlanner>(planner_calls, true, true);
+                PipelineTracer pipeline(std::make_shared<ThreadPool>(threads),
+                                        std::move(planner));
+
+                // Act
+                results.push_back(pipeline.trace(session, component_centers, mask));
+
+                //Assert
+                ASSERT_EQ(planner_calls, 12);
+        }
+
+        for (size_t i = 0; i < component_centers.size(); i++) {
+                const Path& serial = results[0][i];
+                const Path& parallel = results[1][i];
+                ASSERT_EQ(serial.size(), 2u);
+                ASSERT_EQ(serial[0].y(), (double) component_centers[i][0].second);
+                ASSERT_EQ(parallel.size(), serial.size());
+                for (size_t j = 0; j < serial.size(); j++) {
+                        ASSERT_EQ(parallel[j].x(), serial[j].x());
+                        ASSERT_EQ(parallel[j].y(), serial[j].y());
+                }
+        }
+}
@@ -0,0 +1,225 @@
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "mock_session.h"
+
+#include "quincunx/Quincunx.h"
+
+using namespace romi;
+
+class QuincunxTracker : public Quincunx
+{
+public:
+        explicit QuincunxTracker(nlohmann::json& params) : Quincunx(params) {}
+
+        point_t find(Image& mask, double meters_to_pixels) {
+                float confidence;
+                compute_positions(mask, meters_to_pixels, confidence);
+                return _tracked_position;
+        }
+
+        double zone_radius(double meters_to_pixels) {
+                return _radius_zones * meters_to_pixels;
+        }
+
+        std::vector<point_t> positions(Image& mask, double meters_to_pixels,
+                                       float& confidence) {
+                return compute_positions(mask, meters_to_pixels, confidence);
+        }
+};
+
+class Quincunx_tests : public ::testing::Test
+{
+protected:
+        static constexpr double kScale = 500.0; // pixels per meter
+        static constexpr double kDistancePlants = 0.2;
+        static constexpr double kDistanceRows = 0.15;
+        static constexpr double kPlantSize = 0.04;
+        static constexpr double kToolDiameter = 0.02;
+        static constexpr double kRadiusZones = 0.04;
+        static constexpr size_t kWidth = 400;
+        static constexpr size_t kHeight = 450;
+
+        nlohmann::json params;
+
+        Quincunx_tests() : params() {
+                params["distance-plants"] = kDistancePlants;
+                params["distance-rows"] = kDistanceRows;
+                params["plant-sizes"] = { kPlantSize };
+                params["tracking"] = true;
+                params["tracking-window"] = 0.02;
+        }
+
+        ~Quincunx_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // A mask with round plants on a quincunx grid, shifted by
+        // (x0, y0) pixels
+        static void make_field(Image& mask, double x0, double y0) {
+                double dp = kDistancePlants * kScale;
+                double dr = kDistanceRows * kScale;
+                double radius = kPlantSize * kScale / 2.0;
+                mask.init(Image::BW, kWidth, kHeight);
+                mask.fill(0, 0.0f);
+                for (int row = -2; row < 6; row++) {
+                        double dy = (row % 2 == 0)? 0.0 : -dp / 2.0;
+                        for (int plant = -2; plant < 6; plant++) {
+                                double xc = x0 + row * dr;
+                                double yc = y0 + dy + plant * dp;
+                                add_disk(mask, xc, yc, radius);
+                        }
+                }
+        }
+
+        static void add_disk(Image& mask, double xc, double yc, double radius) {
+                for (size_t y = 0; y < kHeight; y++) {
+                        for (size_t x = 0; x < kWidth; x++) {
+                                double dx = (double) x - xc;
+                                double dy = (double) y - yc;
+                                if (dx * dx + dy * dy <= radius * radius)
+                                        mask.set(0, x, y, 1.0f);
+                        }
+                }
+        }
+
+        // The distance from the center of the nearest zone to the
+        // segment [a, b], minus the radius of the zones
+        static double zone_clearance(const std::vector<point_t>& zones, double radius,
+                                     const v3& a, const v3& b) {
+                double clearance = 1e20;
+                double ux = b.x() - a.x();
+                double uy = b.y() - a.y();
+                double length2 = ux * ux + uy * uy;
+                for (const point_t& zone : zones) {
+                        double t = 0.0;
+                        if (length2 > 0.0)
+                                t = ((zone.x - a.x()) * ux + (zone.y - a.y()) * uy) / length2;
+                        t = std::max(0.0, std::min(1.0, t));
+                        double d = std::hypot(a.x() + t * ux - zone.x, a.y() + t * uy - zone.y);
+                        clearance = std::min(clearance, d - radius);
+                }
+                return clearance;
+        }
+
+        // The offset found by a full search in a new planner
+        point_t full_search(Image& mask) {
+                QuincunxTracker planner(params);
+                return planner.find(mask, kScale);
+        }
+};
+
+TEST_F(Quincunx_tests, tracking_follows_the_displacement_of_the_field)
+{
+        // Arrange
+        QuincunxTracker planner(params);
+        Image first;
+        Image second;
+        make_field(first, 20.0, 30.0);
+        make_field(second, 20.0, 60.0); // The field moved 0.06 m along y
+        point_t expected = full_search(second);
+
+        // Act
+        planner.find(first, kScale);
+        planner.set_displacement(0.0, 30.0 / kScale);
+        point_t tracked = planner.find(second, kScale);
+
+        //Assert
+        ASSERT_EQ(tracked.x, expected.x);
+        ASSERT_EQ(tracked.y, expected.y);
+}
+
+TEST_F(Quincunx_tests, tracking_falls_back_to_a_full_search_without_displacement)
+{
+        // Arrange
+        QuincunxTracker planner(params);
+        Image first;
+        Image second;
+        make_field(first, 20.0, 30.0);
+        // The field moved 0.03 m, a little farther than the
+        // tracking window, and the planner isn't told. The window
+        // only catches the flanks of the plants.
+        make_field(second, 20.0, 45.0);
+        point_t expected = full_search(second);
+
+        // Act
+        planner.find(first, kScale);
+        point_t tracked = planner.find(second, kScale);
+
+        //Assert
+        ASSERT_EQ(tracked.x, expected.x);
+        ASSERT_EQ(tracked.y, expected.y);
+}
+
+TEST_F(Quincunx_tests, the_positions_do_not_depend_on_the_number_of_threads)
+{
+        for (auto method : { "direct", "separable", "fft" }) {
+                // Arrange
+                Image mask;
+                make_field(mask, 27.0, 41.0);
+                params["correlation"] = method;
+                params["plant-sizes"] = { kPlantSize, 2.0 * kPlantSize };
+                params["threads"] = 1;
+                QuincunxTracker single(params);
+                params["threads"] = 3;
+                QuincunxTracker multi(params);
+                float expected_confidence;
+                float confidence;
+
+                // Act
+                std::vector<point_t> expected = single.positions(mask, kScale,
+                                                                 expected_confidence);
+                std::vector<point_t> positions = multi.positions(mask, kScale, confidence);
+
+                //Assert
+                ASSERT_EQ(confidence, expected_confidence) << method;
+                ASSERT_EQ(positions.size(), expected.size()) << method;
+                ASSERT_FALSE(positions.empty());
+                for (size_t i = 0; i < positions.size(); i++) {
+                        ASSERT_EQ(positions[i].x, expected[i].x) << method;
+                        ASSERT_EQ(positions[i].y, expected[i].y) << method;
+                }
+        }
+}
+
+TEST_F(Quincunx_tests, trace_path_fails_without_the_scale)
+{
+        // Arrange
+        testing::NiceMock<MockSession> session;
+        Quincunx planner(params);
+        Image mask;
+        Centers centers;
+        make_field(mask, 20.0, 30.0);
+
+        // Act & Assert
+        ASSERT_THROW(planner.trace_path(session, centers, mask), std::runtime_error);
+}
+
+TEST_F(Quincunx_tests, the_path_goes_around_the_zones_with_few_waypoints)
+{
+        // Arrange
+        testing::NiceMock<MockSession> session;
+        Image mask;
+        make_field(mask, 27.0, 41.0);
+        params["radius-zones"] = kRadiusZones;
+        QuincunxTracker planner(params);
+        float confidence;
+        std::vector<point_t> zones = planner.positions(mask, kScale, confidence);
+        double radius = planner.zone_radius(kScale);
+        Path path;
+
+        // Act
+        bool success = planner.trace_path(session, mask, kToolDiameter, kScale, path);
+
+        //Assert
+        // 226 waypoints before the simplification
+        ASSERT_TRUE(success);
+        ASSERT_LE(path.size(), 214u);
+        for (size_t i = 0; i + 1 < path.size(); i++)
+                ASSERT_GE(zone_clearance(zones, radius, path[i], path[i+1]),
+                          -Quincunx::kZoneEpsilon) << "segment " << i;
+}
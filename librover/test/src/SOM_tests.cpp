@@ -0,0 +1,413 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mock_session.h"
+
+#include "som/SOM.h"
+#include "som/SelfOrganizedMap.h"
+
+using namespace romi;
+using namespace testing;
+
+class SOMWarmStart : public SOM
+{
+public:
+        explicit SOMWarmStart(nlohmann::json& params) : SOM(params) {}
+
+        void store(Path& path) {
+                store_path(path, _previous_paths.end());
+        }
+
+        std::vector<Path>& previous_paths() {
+                return _previous_paths;
+        }
+};
+
+class SOMKernel : public SelfOrganizedMap<double>
+{
+public:
+        SOMKernel(int num_cities, int path_length,
+                  std::shared_ptr<ThreadPool> pool = nullptr)
+                : SelfOrganizedMap<double>(num_cities, path_length,
+                                           0.2, 1.2, 0.01, pool) {}
+
+        using SelfOrganizedMap<double>::update_distance_forces;
+        using SelfOrganizedMap<double>::_cx;
+        using SelfOrganizedMap<double>::_cy;
+        using SelfOrganizedMap<double>::_px;
+        using SelfOrganizedMap<double>::_py;
+        using SelfOrganizedMap<double>::_dfx;
+        using SelfOrganizedMap<double>::_dfy;
+        using SelfOrganizedMap<double>::_dmax2;
+        using SelfOrganizedMap<double>::_k;
+};
+
+class SOMFixed : public SelfOrganizedMap<fixed_t>
+{
+public:
+        SOMFixed(int num_cities, int path_length)
+                : SelfOrganizedMap<fixed_t>(num_cities, path_length,
+                                            0.2, 1.2, 0.01) {}
+
+        using SelfOrganizedMap<fixed_t>::update_distance_forces;
+        using SelfOrganizedMap<fixed_t>::exponential;
+        using SelfOrganizedMap<fixed_t>::_dfx;
+        using SelfOrganizedMap<fixed_t>::_dfy;
+        using SelfOrganizedMap<fixed_t>::_exp_min;
+        using SelfOrganizedMap<fixed_t>::_k;
+};
+
+class SOM_tests : public ::testing::Test
+{
+protected:
+        static constexpr double kScale = 500.0; // pixels per meter
+
+        nlohmann::json params;
+        Path path;
+
+        SOM_tests() : params(), path() {
+                params["warm-start"] = true;
+                path.emplace_back(10.0, 20.0, 0.0);
+                path.emplace_back(30.0, 20.0, 0.0);
+                path.emplace_back(20.0, 40.0, 0.0);
+        }
+
+        ~SOM_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        static std::vector<double> random_points(size_t n, unsigned int seed) {
+                std::mt19937 generator(seed);
+                std::uniform_real_distribution<double> distribution(0.0, 1.0);
+                std::vector<double> points(n);
+                for (auto& value : points)
+                        value = distribution(generator);
+                return points;
+        }
+
+        // a / b in Q8.24, rounded half away from zero and saturated
+        static fixed_t reference_division(fixed_t a, int64_t b) {
+                __int128 n = (__int128) a * FIXED_FMAX;
+                __int128 d = b;
+                bool negative = (n < 0) != (d < 0);
+                if (n < 0)
+                        n = -n;
+                if (d < 0)
+                        d = -d;
+                __int128 q = (2 * n + d) / (2 * d);
+                if (negative)
+                        q = -q;
+                if (q > INT32_MAX)
+                        return INT32_MAX;
+                if (q < INT32_MIN)
+                        return INT32_MIN;
+                return (fixed_t) q;
+        }
+
+        // The length of the closed tour
+        static double tour_length(SOMKernel& som) {
+                Path path;
+                som.get_path(path, 1.0, 1.0);
+                double length = 0.0;
+                for (size_t i = 0; i < path.size(); i++) {
+                        const v3& next = path[(i + 1) % path.size()];
+                        length += std::hypot(next.x() - path[i].x(), next.y() - path[i].y());
+                }
+                return length;
+        }
+
+        /* The distance forces as they were computed before the
+         * fused kernel: the full N_cities x N_nodes matrices of the
+         * differences, squared distances and weights, filled and
+         * summed pass by pass. */
+        static void reference_forces(const SOMKernel& som, int num_cities, int path_length,
+                                     std::vector<double>& dfx, std::vector<double>& dfy,
+                                     double& dmax2) {
+                size_t n = static_cast<size_t>(num_cities);
+                size_t m = static_cast<size_t>(path_length);
+                std::vector<double> dx(n * m), dy(n * m), d2(n * m), w(n * m), sum(n, 0.0);
+                double coeff = 2.0 * (som._k * som._k);
+
+                for (size_t city = 0; city < n; city++) {
+                        for (size_t node = 0; node < m; node++) {
+                                dx[city * m + node] = som._cx[city] - som._px[node];
+                                dy[city * m + node] = som._cy[city] - som._py[node];
+                        }
+                }
+
+                dmax2 = 0.0;
+                for (size_t city = 0; city < n; city++) {
+                        double d2min = 1000000.0;
+                        for (size_t node = 0; node < m; node++) {
+                                size_t i = city * m + node;
+                                d2[i] = dx[i] * dx[i] + dy[i] * dy[i];
+                                if (d2[i] < d2min)
+                                        d2min = d2[i];
+                                w[i] = std::exp(-d2[i] / coeff);
+                        }
+                        if (d2min > dmax2)
+                                dmax2 = d2min;
+                }
+
+                for (size_t city = 0; city < n; city++)
+                        for (size_t node = 0; node < m; node++)
+                                sum[city] += w[city * m + node];
+
+                for (size_t city = 0; city < n; city++)
+                        for (size_t node = 0; node < m; node++)
+                                w[city * m + node] /= sum[city];
+
+                dfx.assign(m, 0.0);
+                dfy.assign(m, 0.0);
+                for (size_t city = 0; city < n; city++) {
+                        for (size_t node = 0; node < m; node++) {
+                                size_t i = city * m + node;
+                                dfx[node] += dx[i] * w[i];
+                                dfy[node] += dy[i] * w[i];
+                        }
+                }
+        }
+};
+
+TEST_F(SOM_tests, previous_paths_move_with_the_field)
+{
+        // Arrange
+        SOMWarmStart som(params);
+        som.set_scale(kScale, 0.05);
+        som.store(path);
+
+        // Act
+        som.set_displacement(0.01, -0.02);
+        som.set_scale(kScale, 0.05);
+
+        //Assert
+        ASSERT_EQ(som.previous_paths().size(), 1u);
+        Path& moved = som.previous_paths()[0];
+        ASSERT_EQ(moved.size(), path.size());
+        for (size_t i = 0; i < path.size(); i++) {
+                ASSERT_NEAR(moved[i].x(), path[i].x() + 5.0, 1e-9);
+                ASSERT_NEAR(moved[i].y(), path[i].y() - 10.0, 1e-9);
+        }
+}
+
+TEST_F(SOM_tests, previous_paths_are_dropped_without_displacement)
+{
+        // Arrange
+        SOMWarmStart som(params);
+        som.set_scale(kScale, 0.05);
+        som.store(path);
+
+        // Act
+        som.set_scale(kScale, 0.05);
+
+        //Assert
+        ASSERT_EQ(som.previous_paths().size(), 0u);
+}
+
+TEST_F(SOM_tests, the_fused_kernel_matches_the_full_matrices)
+{
+        for (size_t threads : { 1, 3 }) {
+                for (double k : { 0.2, 0.05 }) {
+                        // Arrange
+                        int num_cities = 60;
+                        int path_length = 150;
+                        std::vector<double> cx = random_points(static_cast<size_t>(num_cities), 1);
+                        std::vector<double> cy = random_points(static_cast<size_t>(num_cities), 2);
+                        SOMKernel som(num_cities, path_length, std::make_shared<ThreadPool>(threads));
+                        som.init_cities(cx.data(), cy.data());
+                        som.make_circle(0.1);
+                        som._k = k;
+                        std::vector<double> dfx;
+                        std::vector<double> dfy;
+                        double dmax2;
+                        reference_forces(som, num_cities, path_length, dfx, dfy, dmax2);
+
+                        // Act
+                        som.update_distance_forces();
+
+                        //Assert
+                        ASSERT_EQ(som._dmax2, dmax2);
+                        for (size_t node = 0; node < dfx.size(); node++) {
+                                ASSERT_EQ(som._dfx[node], dfx[node]);
+                                ASSERT_EQ(som._dfy[node], dfy[node]);
+                        }
+                }
+        }
+}
+
+TEST_F(SOM_tests, the_pruned_map_converges_to_the_same_tour_length)
+{
+        for (int num_cities : { 40, 80 }) {
+                // Arrange
+                NiceMock<MockSession> session;
+                int path_length = static_cast<int>(2.5 * num_cities);
+                std::vector<double> cx = random_points(static_cast<size_t>(num_cities), 3);
+                std::vector<double> cy = random_points(static_cast<size_t>(num_cities), 4);
+                SOMKernel full(num_cities, path_length);
+                SOMKernel pruned(num_cities, path_length);
+                full.init_cities(cx.data(), cy.data());
+                full.make_circle(0.1);
+                pruned.init_cities(cx.data(), cy.data());
+                pruned.make_circle(0.1);
+                pruned.set_pruning(true, 4.0);
+
+                // Act
+                bool full_success = full.compute_path(session);
+                bool pruned_success = pruned.compute_path(session);
+
+                //Assert
+                ASSERT_TRUE(full_success);
+                ASSERT_TRUE(pruned_success);
+                double length = tour_length(full);
+                ASSERT_NEAR(tour_length(pruned), length, 0.01 * length);
+        }
+}
+
+TEST_F(SOM_tests, the_paths_do_not_depend_on_the_number_of_threads)
+{
+        for (bool prune : { false, true }) {
+                // Arrange
+                NiceMock<MockSession> session;
+                int num_cities = 50;
+                int path_length = 125;
+                std::vector<double> cx = random_points(static_cast<size_t>(num_cities), 5);
+                std::vector<double> cy = random_points(static_cast<size_t>(num_cities), 6);
+                SOMKernel serial(num_cities, path_length, std::make_shared<ThreadPool>(1));
+                SOMKernel parallel(num_cities, path_length, std::make_shared<ThreadPool>(4));
+                serial.init_cities(cx.data(), cy.data());
+                serial.make_circle(0.1);
+                serial.set_pruning(prune, 4.0);
+                parallel.init_cities(cx.data(), cy.data());
+                parallel.make_circle(0.1);
+                parallel.set_pruning(prune, 4.0);
+
+                // Act
+                bool serial_success = serial.compute_path(session);
+                bool parallel_success = parallel.compute_path(session);
+
+                //Assert
+                ASSERT_EQ(serial_success, parallel_success);
+                Path serial_path;
+                Path parallel_path;
+                serial.get_path(serial_path, 1.0, 1.0);
+                parallel.get_path(parallel_path, 1.0, 1.0);
+                ASSERT_EQ(serial_path.size(), parallel_path.size());
+                for (size_t i = 0; i < serial_path.size(); i++) {
+                        ASSERT_EQ(serial_path[i].x(), parallel_path[i].x());
+                        ASSERT_EQ(serial_path[i].y(), parallel_path[i].y());
+                }
+        }
+}
+
+TEST_F(SOM_tests, fxdiv_wide_rounds_to_the_nearest_quotient)
+{
+        // Arrange
+        std::mt19937_64 generator(7);
+        std::uniform_int_distribution<int32_t> numerators(INT32_MIN, INT32_MAX);
+
+        for (int bits = 0; bits < 63; bits++) {
+                std::uniform_int_distribution<int64_t> denominators(1, (int64_t) 1 << bits);
+                for (int i = 0; i < 2000; i++) {
+                        fixed_t a = numerators(generator);
+                        int64_t b = denominators(generator);
+                        if (i % 2)
+                                b = -b;
+                        fixed_t expected = reference_division(a, b);
+
+                        // Act
+                        fixed_t q = fxdiv_wide(a, b);
+
+                        //Assert
+                        ASSERT_EQ(q, expected) << a << " / " << b;
+                }
+        }
+}
+
+TEST_F(SOM_tests, fxdiv_wide_saturates)
+{
+        // Act & Assert
+        ASSERT_EQ(fxdiv_wide(itofx(100), itofx(1) / 4), INT32_MAX);
+        ASSERT_EQ(fxdiv_wide(itofx(-100), itofx(1) / 4), INT32_MIN);
+        ASSERT_EQ(fxdiv_wide(itofx(100), -(itofx(1) / 4)), INT32_MIN);
+        ASSERT_EQ(fxdiv_wide(INT32_MIN, 1), INT32_MIN);
+        ASSERT_EQ(fxdiv_wide(itofx(1), 0), INT32_MAX);
+        ASSERT_EQ(fxdiv_wide(itofx(-1), 0), INT32_MIN);
+        ASSERT_EQ(fxdiv_wide(0, 0), 0);
+        ASSERT_EQ(fxdiv_wide(itofx(3), (int64_t) 1 << 62), 0);
+}
+
+TEST_F(SOM_tests, the_fixed_point_exponential_follows_exp)
+{
+        // Arrange
+        SOMFixed som(1, 3);
+        // The linear interpolation of the table, with steps of
+        // 2^-9, is off by at most 2^-18 / 8, or 8 units of the last
+        // place of Q8.24. One more unit covers the rounding.
+        double tolerance = 9.0 / FIXED_FMAX;
+        
+        for (fixed_t a = 0; a >= som._exp_min; a -= 997) {
+                // Act
+                double y = fxtod(som.exponential(a));
+
+                //Assert
+                ASSERT_NEAR(y, std::exp(fxtod(a)), tolerance) << fxtod(a);
+        }
+}
+
+TEST_F(SOM_tests, a_city_whose_weights_all_underflow_pulls_the_nearest_node)
+{
+        // Arrange
+        int path_length = 12;
+        std::vector<double> px(static_cast<size_t>(path_length));
+        std::vector<double> py(static_cast<size_t>(path_length));
+        for (size_t i = 0; i < px.size(); i++) {
+                double theta = 2.0 * M_PI * (double) i / (double) path_length;
+                px[i] = 0.5 + 0.05 * std::cos(theta);
+                py[i] = 0.5 + 0.05 * std::sin(theta);
+        }
+        double cx[] = { 0.5, 0.9 };
+        double cy[] = { 0.5, 0.5 };
+        SOMFixed near(1, path_length);
+        SOMFixed both(2, path_length);
+        near.init_cities(cx, cy);
+        near.init_path(px.data(), py.data());
+        near._k = dtofx(0.01);
+        both.init_cities(cx, cy);
+        both.init_path(px.data(), py.data());
+        both._k = dtofx(0.01);
+
+        // Act
+        near.update_distance_forces();
+        both.update_distance_forces();
+
+        //Assert
+        // The far city only adds its full distance to node 0
+        ASSERT_EQ(both._dfx[0], near._dfx[0] + dtofx(0.9) - dtofx(px[0]));
+        ASSERT_EQ(both._dfy[0], near._dfy[0] + dtofx(0.5) - dtofx(py[0]));
+        for (int node = 1; node < path_length; node++) {
+                ASSERT_EQ(both._dfx[node], near._dfx[node]);
+                ASSERT_EQ(both._dfy[node], near._dfy[node]);
+        }
+}
+
+TEST_F(SOM_tests, only_a_map_without_warm_start_or_print_is_thread_safe)
+{
+        // Arrange
+        nlohmann::json plain = nlohmann::json::object();
+        nlohmann::json printing;
+        printing["print"] = true;
+        SOM plain_som(plain);
+        SOM warm_som(params);
+        SOM printing_som(printing);
+
+        // Act & Assert
+        ASSERT_TRUE(plain_som.is_thread_safe());
+        ASSERT_FALSE(warm_som.is_thread_safe());
+        ASSERT_FALSE(printing_som.is_thread_safe());
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "parallel/ThreadPool.h"
+
+using namespace romi;
+
+class ThreadPool_tests : public ::testing::Test
+{
+protected:
+        struct Chunk {
+                size_t index;
+                size_t begin;
+                size_t end;
+        };
+
+        ThreadPool_tests() = default;
+
+        ~ThreadPool_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        // The chunks that parallel_for() passes to the function,
+        // sorted by index
+        static std::vector<Chunk> record_chunks(ThreadPool& pool, size_t count) {
+                std::mutex mutex;
+                std::vector<Chunk> chunks;
+                pool.parallel_for(count, [&](size_t chunk, size_t begin, size_t end) {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                chunks.push_back({ chunk, begin, end });
+                        });
+                std::sort(chunks.begin(), chunks.end(),
+                          [](const Chunk& a, const Chunk& b) {
+                                  return a.index < b.index;
+                          });
+                return chunks;
+        }
+};
+
+TEST_F(ThreadPool_tests, chunks_are_contiguous_and_only_depend_on_count_and_size)
+{
+        for (size_t threads : { 1, 3, 4 }) {
+                ThreadPool pool(threads);
+                for (size_t count : { 0, 1, 2, 3, 7, 100 }) {
+                        // Act
+                        std::vector<Chunk> chunks = record_chunks(pool, count);
+
+                        //Assert
+                        size_t expected_begin = 0;
+                        for (const Chunk& chunk : chunks) {
+                                ASSERT_LT(chunk.index, threads);
+                                ASSERT_EQ(chunk.begin, count * chunk.index / threads);
+                                ASSERT_EQ(chunk.end, count * (chunk.index + 1) / threads);
+                                ASSERT_EQ(chunk.begin, expected_begin);
+                                ASSERT_LT(chunk.begin, chunk.end);
+                                expected_begin = chunk.end;
+                        }
+                        ASSERT_EQ(expected_begin, count);
+                }
+        }
+}
+
+TEST_F(ThreadPool_tests, the_exception_of_the_first_chunk_is_rethrown)
+{
+        // Arrange
+        ThreadPool pool(4);
+        std::atomic<size_t> done(0);
+        std::string message;
+
+        // Act
+        try {
+                pool.parallel_for(40, [&](size_t chunk, size_t begin, size_t end) {
+                                done += end - begin;
+                                if (chunk >= 2)
+                                        throw std::runtime_error(std::to_string(chunk));
+                        });
+        } catch (std::runtime_error& e) {
+                message = e.what();
+        }
+
+        //Assert
+        ASSERT_EQ(message, "2");
+        ASSERT_EQ(done, 40u); // All chunks ran before the rethrow
+}
+
+TEST_F(ThreadPool_tests, the_exception_of_the_calling_thread_comes_first)
+{
+        // Arrange
+        ThreadPool pool(3);
+        std::string message;
+
+        // Act
+        try {
+                pool.parallel_for(30, [&](size_t chunk, size_t, size_t) {
+                                throw std::runtime_error(std::to_string(chunk));
+                        });
+        } catch (std::runtime_error& e) {
+                message = e.what();
+        }
+
+        //Assert
+        ASSERT_EQ(message, "0");
+}
+
+TEST_F(ThreadPool_tests, nested_parallel_for_does_not_deadlock)
+{
+        // Arrange
+        ThreadPool pool(4);
+        std::vector<std::atomic<int>> visits(16 * 16);
+        for (auto& visit : visits)
+                visit = 0;
+
+        // Act
+        pool.parallel_for(16, [&](size_t, size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; i++) {
+                                pool.parallel_for(16, [&, i](size_t, size_t b, size_t e) {
+                                                for (size_t j = b; j < e; j++)
+                                                        visits[i * 16 + j]++;
+                                        });
+                        }
+                });
+
+        //Assert
+        for (auto& visit : visits)
+                ASSERT_EQ(visit, 1);
+}
+
+TEST_F(ThreadPool_tests, submit_from_a_worker_runs_inline)
+{
+        // Arrange
+        ThreadPool pool(2);
+        int value = 0;
+
+        // Act
+        pool.submit([&]() {
+                        pool.submit([&]() { value = 42; }).get();
+                }).get();
+
+        //Assert
+        ASSERT_EQ(value, 42);
+}
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "tsp/TourOptimizer.h"
+
+using namespace romi;
+
+class TourOptimizer_tests : public ::testing::Test
+{
+protected:
+        ThreadPool pool;
+        
+        TourOptimizer_tests() : pool(2) {
+        }
+
+        ~TourOptimizer_tests() override = default;
+
+        void SetUp() override {
+        }
+
+        void TearDown() override {
+        }
+
+        static Path random_points(std::mt19937& generator, size_t n) {
+                std::uniform_real_distribution<double> coordinate(0.0, 1000.0);
+                Path points;
+                for (size_t i = 0; i < n; i++)
+                        points.emplace_back(coordinate(generator), coordinate(generator), 0.0);
+                return points;
+        }
+
+        void fill_matrix(DistanceMatrix& matrix, Path& points) {
+                matrix.fill(pool, [&](size_t i, size_t j) {
+                                return (int64_t) std::hypot(points[i].x() - points[j].x(),
+                                                            points[i].y() - points[j].y());
+                        });
+        }
+
+        static int64_t tour_length(const DistanceMatrix& matrix,
+                                   const std::vector<size_t>& tour) {
+                int64_t sum = 0;
+                for (size_t i = 0; i < tour.size(); i++)
+                        sum += matrix(tour[i], tour[(i + 1) % tour.size()]);
+                return sum;
+        }
+
+        // The length of the shortest tour, by trying all the
+        // permutations of the nodes after node 0
+        static int64_t shortest_length(const DistanceMatrix& matrix) {
+                std::vector<size_t> tour(matrix.size());
+                for (size_t i = 0; i < tour.size(); i++)
+                        tour[i] = i;
+                int64_t best = tour_length(matrix, tour);
+                while (std::next_permutation(tour.begin() + 1, tour.end()))
+                        best = std::min(best, tour_length(matrix, tour));
+                return best;
+        }
+
+        static void assert_valid_tour(const TourOptimizer& optimizer,
+                                      const DistanceMatrix& matrix) {
+                std::vector<size_t> tour = optimizer.tour();
+                ASSERT_EQ(tour.size(), matrix.size());
+                if (tour.empty())
+                        return;
+                ASSERT_EQ(tour[0], 0u);
+                std::vector<bool> visited(tour.size(), false);
+                for (size_t node : tour) {
+                        ASSERT_LT(node, tour.size());
+                        ASSERT_FALSE(visited[node]);
+                        visited[node] = true;
+                }
+                ASSERT_EQ(optimizer.length(), tour_length(matrix, tour));
+        }
+};
+
+TEST_F(TourOptimizer_tests, tours_visit_every_node_once)
+{
+        std::mt19937 generator(1);
+        const size_t sizes[] = { 1, 2, 3, 4, 5, 20, 300 };
+        for (size_t n : sizes) {
+                for (int construction = 0; construction < 2; construction++) {
+                        // Arrange
+                        Path points = random_points(generator, n);
+                        DistanceMatrix matrix(n);
+                        fill_matrix(matrix, points);
+                        TourOptimizer optimizer(matrix, std::min(n - 1, (size_t) 8), pool);
+                        if (construction == 0)
+                                optimizer.construct_greedy();
+                        else
+                                optimizer.construct_hilbert(points);
+                        assert_valid_tour(optimizer, matrix);
+
+                        // Act
+                        optimizer.improve(0.0);
+
+                        //Assert
+                        assert_valid_tour(optimizer, matrix);
+                }
+        }
+}
+
+TEST_F(TourOptimizer_tests, improve_shortens_the_initial_tour)
+{
+        // Arrange
+        std::mt19937 generator(2);
+        Path points = random_points(generator, 200);
+        DistanceMatrix matrix(points.size());
+        fill_matrix(matrix, points);
+        TourOptimizer optimizer(matrix, 8, pool);
+        optimizer.construct_hilbert(points);
+        int64_t initial = optimizer.length();
+
+        // Act
+        bool finished = optimizer.improve(100.0);
+
+        //Assert
+        ASSERT_TRUE(finished);
+        ASSERT_LT(optimizer.length(), initial);
+        assert_valid_tour(optimizer, matrix);
+}
+
+TEST_F(TourOptimizer_tests, no_improving_2opt_move_is_left)
+{
+        // Arrange
+        std::mt19937 generator(3);
+        Path points = random_points(generator, 60);
+        size_t n = points.size();
+        DistanceMatrix matrix(n);
+        fill_matrix(matrix, points);
+        TourOptimizer optimizer(matrix, n - 1, pool);
+        optimizer.construct_greedy();
+
+        // Act
+        optimizer.improve(0.0);
+
+        //Assert
+        std::vector<size_t> tour = optimizer.tour();
+        for (size_t i = 0; i < n; i++) {
+                for (size_t j = i + 2; j < n; j++) {
+                        size_t a = tour[i];
+                        size_t b = tour[i + 1];
+                        size_t c = tour[j];
+                        size_t d = tour[(j + 1) % n];
+                        if (d == a)
+                                continue;
+                        ASSERT_LE(matrix(a, b) + matrix(c, d), matrix(a, c) + matrix(b, d))
+                                << "edges " << i << " and " << j;
+                }
+        }
+}
+
+TEST_F(TourOptimizer_tests, small_tours_are_close_to_the_shortest)
+{
+        std::mt19937 generator(4);
+        int count = 0;
+        int shortest = 0;
+        
+        for (size_t n = 4; n <= 8; n++) {
+                for (int i = 0; i < 40; i++) {
+                        // Arrange
+                        Path points = random_points(generator, n);
+                        DistanceMatrix matrix(n);
+                        fill_matrix(matrix, points);
+                        int64_t expected = shortest_length(matrix);
+                        TourOptimizer optimizer(matrix, n - 1, pool);
+                        optimizer.construct_greedy();
+
+                        // Act
+                        optimizer.improve(0.0);
+
+                        //Assert
+                        assert_valid_tour(optimizer, matrix);
+                        ASSERT_GE(optimizer.length(), expected);
+                        ASSERT_LE((double) optimizer.length(), 1.05 * (double) expected);
+                        count++;
+                        if (optimizer.length() == expected)
+                                shortest++;
+                }
+        }
+        // 2-opt and Or-opt are local moves, but they find the
+        // shortest tour of nearly all the small instances
+        ASSERT_GE(shortest, count * 95 / 100);
+}